@@ -29,6 +29,11 @@ ifeq ($(TARGET_BOARD_PLATFORM), msm8974)
     common_flags += -DVENUS_COLOR_FORMAT
 endif
 
+# Panel driver takes a region of interest with the display commit
+ifeq ($(TARGET_USES_PARTIAL_UPDATE),true)
+    common_flags += -DPARTIAL_UPDATE
+endif
+
 common_deps  :=
 kernel_includes :=
 
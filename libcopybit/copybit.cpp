@@ -37,6 +37,7 @@
 
 #include "gralloc_priv.h"
 #include "software_converter.h"
+#include "scratch_pool.h"
 
 #define DEBUG_MDP_ERRORS 1
 
@@ -376,112 +377,136 @@ static int get(struct copybit_device_t *dev, int name)
     return value;
 }
 
-/** do a stretch blit type operation */
-static int stretch_copybit(
-    struct copybit_device_t *dev,
+/** blit requests submitted with one ioctl */
+struct blit_req_list {
+    uint32_t count;
+    struct mdp_blit_req req[12];
+};
+
+/** add the requests of a stretch blit to list, submitting it when full */
+static int add_stretch(
+    struct copybit_context_t *ctx,
+    struct blit_req_list *list,
     struct copybit_image_t const *dst,
-    struct copybit_image_t const *src,
+    struct copybit_image_t const *src_img,
     struct copybit_rect_t const *dst_rect,
     struct copybit_rect_t const *src_rect,
     struct copybit_region_t const *region)
 {
-    struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
     int status = 0;
     private_handle_t *yv12_handle = NULL;
-    if (ctx) {
-        struct {
-            uint32_t count;
-            struct mdp_blit_req req[12];
-        } list;
-
-        if (ctx->mAlpha < 255) {
-            switch (src->format) {
-                // we don't support plane alpha with RGBA formats
-                case HAL_PIXEL_FORMAT_RGBA_8888:
-                case HAL_PIXEL_FORMAT_BGRA_8888:
-                case HAL_PIXEL_FORMAT_RGBA_5551:
-                case HAL_PIXEL_FORMAT_RGBA_4444:
-                    ALOGE ("%s : Unsupported Pixel format %d", __FUNCTION__,
-                           src->format);
-                    return -EINVAL;
-            }
+    struct copybit_image_t src_copy = *src_img;
+    struct copybit_image_t *src = &src_copy;
+
+    if (ctx->mAlpha < 255) {
+        switch (src->format) {
+            // we don't support plane alpha with RGBA formats
+            case HAL_PIXEL_FORMAT_RGBA_8888:
+            case HAL_PIXEL_FORMAT_BGRA_8888:
+            case HAL_PIXEL_FORMAT_RGBA_5551:
+            case HAL_PIXEL_FORMAT_RGBA_4444:
+                ALOGE ("%s : Unsupported Pixel format %d", __FUNCTION__,
+                       src->format);
+                return -EINVAL;
         }
+    }
 
-        if (src_rect->l < 0 || (uint32_t)src_rect->r > src->w ||
-            src_rect->t < 0 || (uint32_t)src_rect->b > src->h) {
-            // this is always invalid
-            ALOGE ("%s : Invalid source rectangle : src_rect l %d t %d r %d b %d",\
-                   __FUNCTION__, src_rect->l, src_rect->t, src_rect->r, src_rect->b);
+    if (src_rect->l < 0 || (uint32_t)src_rect->r > src->w ||
+        src_rect->t < 0 || (uint32_t)src_rect->b > src->h) {
+        // this is always invalid
+        ALOGE ("%s : Invalid source rectangle : src_rect l %d t %d r %d b %d",\
+               __FUNCTION__, src_rect->l, src_rect->t, src_rect->r, src_rect->b);
 
-            return -EINVAL;
-        }
+        return -EINVAL;
+    }
 
-        if (src->w > MAX_DIMENSION || src->h > MAX_DIMENSION) {
-            ALOGE ("%s : Invalid source dimensions w %d h %d", __FUNCTION__, src->w, src->h);
-            return -EINVAL;
-        }
+    if (src->w > MAX_DIMENSION || src->h > MAX_DIMENSION) {
+        ALOGE ("%s : Invalid source dimensions w %d h %d", __FUNCTION__, src->w, src->h);
+        return -EINVAL;
+    }
 
-        if (dst->w > MAX_DIMENSION || dst->h > MAX_DIMENSION) {
-            ALOGE ("%s : Invalid DST dimensions w %d h %d", __FUNCTION__, dst->w, dst->h);
-            return -EINVAL;
-        }
+    if (dst->w > MAX_DIMENSION || dst->h > MAX_DIMENSION) {
+        ALOGE ("%s : Invalid DST dimensions w %d h %d", __FUNCTION__, dst->w, dst->h);
+        return -EINVAL;
+    }
 
-        if(src->format ==  HAL_PIXEL_FORMAT_YV12) {
-            int usage =
-            GRALLOC_USAGE_PRIVATE_CAMERA_HEAP|GRALLOC_USAGE_PRIVATE_UNCACHED;
-            if (0 == alloc_buffer(&yv12_handle,src->w,src->h,
-                                  src->format, usage)){
-                if(0 == convertYV12toYCrCb420SP(src,yv12_handle)){
-                    (const_cast<copybit_image_t *>(src))->format =
-                        HAL_PIXEL_FORMAT_YCrCb_420_SP;
-                    (const_cast<copybit_image_t *>(src))->handle =
-                        yv12_handle;
-                    (const_cast<copybit_image_t *>(src))->base =
-                        (void *)yv12_handle->base;
-                }
-                else{
-                    ALOGE("Error copybit conversion from yv12 failed");
-                    if(yv12_handle)
-                        free_buffer(yv12_handle);
-                    return -EINVAL;
-                }
+    if(src->format ==  HAL_PIXEL_FORMAT_YV12) {
+        int usage =
+        GRALLOC_USAGE_PRIVATE_CAMERA_HEAP|GRALLOC_USAGE_PRIVATE_UNCACHED;
+        if (0 == gralloc::ScratchPool::getInstance()->get(&yv12_handle,
+                              src->w, src->h, src->format, usage)){
+            if(0 == convertYV12toYCrCb420SP(src,yv12_handle)){
+                src->format = HAL_PIXEL_FORMAT_YCrCb_420_SP;
+                src->handle = yv12_handle;
+                src->base = (void *)yv12_handle->base;
             }
             else{
-                ALOGE("Error:unable to allocate memeory for yv12 software conversion");
+                ALOGE("Error copybit conversion from yv12 failed");
+                gralloc::ScratchPool::getInstance()->put(yv12_handle,
+                                                         -1);
                 return -EINVAL;
             }
         }
-        const uint32_t maxCount = sizeof(list.req)/sizeof(list.req[0]);
-        const struct copybit_rect_t bounds = { 0, 0, dst->w, dst->h };
-        struct copybit_rect_t clip;
-        list.count = 0;
-        status = 0;
-        while ((status == 0) && region->next(region, &clip)) {
-            intersect(&clip, &bounds, &clip);
-            mdp_blit_req* req = &list.req[list.count];
-            int flags = 0;
-
-            private_handle_t* src_hnd = (private_handle_t*)src->handle;
-            if(src_hnd != NULL && src_hnd->flags & private_handle_t::PRIV_FLAGS_DO_NOT_FLUSH) {
-                flags |=  MDP_BLIT_NON_CACHED;
-            }
+        else{
+            ALOGE("Error:unable to allocate memeory for yv12 software conversion");
+            return -EINVAL;
+        }
+    }
+    const uint32_t maxCount = sizeof(list->req)/sizeof(list->req[0]);
+    const struct copybit_rect_t bounds = { 0, 0, dst->w, dst->h };
+    struct copybit_rect_t clip;
+    while ((status == 0) && region->next(region, &clip)) {
+        intersect(&clip, &bounds, &clip);
+        mdp_blit_req* req = &list->req[list->count];
+        int flags = 0;
+
+        private_handle_t* src_hnd = (private_handle_t*)src->handle;
+        if(src_hnd != NULL && src_hnd->flags & private_handle_t::PRIV_FLAGS_DO_NOT_FLUSH) {
+            flags |=  MDP_BLIT_NON_CACHED;
+        }
 
-            set_infos(ctx, req, flags);
-            set_image(&req->dst, dst);
-            set_image(&req->src, src);
-            set_rects(ctx, req, dst_rect, src_rect, &clip, src->horiz_padding, src->vert_padding);
+        set_infos(ctx, req, flags);
+        set_image(&req->dst, dst);
+        set_image(&req->src, src);
+        set_rects(ctx, req, dst_rect, src_rect, &clip, src->horiz_padding, src->vert_padding);
 
-            if (req->src_rect.w<=0 || req->src_rect.h<=0)
-                continue;
+        if (req->src_rect.w<=0 || req->src_rect.h<=0)
+            continue;
 
-            if (req->dst_rect.w<=0 || req->dst_rect.h<=0)
-                continue;
+        if (req->dst_rect.w<=0 || req->dst_rect.h<=0)
+            continue;
 
-            if (++list.count == maxCount) {
-                status = msm_copybit(ctx, &list);
-                list.count = 0;
-            }
+        if (++list->count == maxCount) {
+            status = msm_copybit(ctx, list);
+            list->count = 0;
         }
+    }
+    //The conversion buffer is only read until the blit ioctl returns
+    if(yv12_handle) {
+        if ((status == 0) && list->count) {
+            status = msm_copybit(ctx, list);
+            list->count = 0;
+        }
+        gralloc::ScratchPool::getInstance()->put(yv12_handle, -1);
+    }
+    return status;
+}
+
+/** do a stretch blit type operation */
+static int stretch_copybit(
+    struct copybit_device_t *dev,
+    struct copybit_image_t const *dst,
+    struct copybit_image_t const *src,
+    struct copybit_rect_t const *dst_rect,
+    struct copybit_rect_t const *src_rect,
+    struct copybit_region_t const *region)
+{
+    struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
+    int status = 0;
+    if (ctx) {
+        struct blit_req_list list;
+        list.count = 0;
+        status = add_stretch(ctx, &list, dst, src, dst_rect, src_rect, region);
         if ((status == 0) && list.count) {
             status = msm_copybit(ctx, &list);
         }
@@ -489,8 +514,42 @@ static int stretch_copybit(
         ALOGE ("%s : Invalid COPYBIT context", __FUNCTION__);
         status = -EINVAL;
     }
-    if(yv12_handle)
-        free_buffer(yv12_handle);
+    return status;
+}
+
+/** do the stretch blits of a batch of layers, with as few ioctls as the
+ *  request list allows */
+static int stretch_batch_copybit(
+    struct copybit_device_t *dev,
+    struct copybit_target_t const *target,
+    struct copybit_layer_t const *layers,
+    int count)
+{
+    struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
+    int status = 0;
+    if (!ctx) {
+        ALOGE ("%s : Invalid COPYBIT context", __FUNCTION__);
+        return -EINVAL;
+    }
+
+    struct blit_req_list list;
+    list.count = 0;
+    set_parameter_copybit(dev, COPYBIT_BLIT_TO_FRAMEBUFFER, target->blit_to_fb);
+    for (int i = 0; (status == 0) && i < count; i++) {
+        const struct copybit_layer_t *layer = &layers[i];
+        set_parameter_copybit(dev, COPYBIT_TRANSFORM, layer->transform);
+        set_parameter_copybit(dev, COPYBIT_PLANE_ALPHA, layer->alpha);
+        set_parameter_copybit(dev, COPYBIT_BLEND_MODE, layer->blend_mode);
+        set_parameter_copybit(dev, COPYBIT_DITHER, layer->dither);
+        status = add_stretch(ctx, &list, &target->image, &layer->src,
+                             &layer->dst_rect, &layer->src_rect,
+                             layer->region);
+    }
+    // Blits outside the batch, e.g. to scratch buffers, aren't to the FB
+    set_parameter_copybit(dev, COPYBIT_BLIT_TO_FRAMEBUFFER, COPYBIT_DISABLE);
+    if ((status == 0) && list.count) {
+        status = msm_copybit(ctx, &list);
+    }
     return status;
 }
 
@@ -542,6 +601,7 @@ static int open_copybit(const struct hw_module_t* module, const char* name,
     ctx->device.blit = blit_copybit;
     ctx->device.stretch = stretch_copybit;
     ctx->device.finish = finish_copybit;
+    ctx->device.stretch_batch = stretch_batch_copybit;
     ctx->mAlpha = MDP_ALPHA_NOP;
     ctx->mFlags = 0;
     ctx->mFD = open("/dev/graphics/fb0", O_RDWR, 0);
@@ -160,6 +160,36 @@ struct copybit_region_t {
     int (*next)(struct copybit_region_t const *region, struct copybit_rect_t *rect);
 };
 
+/* Destination of a batched stretch */
+struct copybit_target_t {
+    /* image blitted to */
+    struct copybit_image_t image;
+    /* as COPYBIT_FRAMEBUFFER_WIDTH and COPYBIT_FRAMEBUFFER_HEIGHT */
+    int fb_width;
+    int fb_height;
+    /* as COPYBIT_BLIT_TO_FRAMEBUFFER */
+    int blit_to_fb;
+};
+
+/* One layer of a batched stretch, with its own state */
+struct copybit_layer_t {
+    /* source image */
+    struct copybit_image_t src;
+    /* source and destination rectangles */
+    struct copybit_rect_t src_rect;
+    struct copybit_rect_t dst_rect;
+    /* the clip region */
+    struct copybit_region_t const *region;
+    /* as COPYBIT_TRANSFORM */
+    int transform;
+    /* as COPYBIT_PLANE_ALPHA */
+    int alpha;
+    /* as COPYBIT_BLEND_MODE */
+    int blend_mode;
+    /* as COPYBIT_DITHER */
+    int dither;
+};
+
 /**
  * Every hardware module must have a data structure named HAL_MODULE_INFO_SYM
  * and the fields of this data structure must begin with hw_module_t
@@ -250,6 +280,25 @@ struct copybit_device_t {
     * @return 0 if successful
     */
   int (*flush_get_fence)(struct copybit_device_t *dev, int* fd);
+
+  /**
+    * Execute the stretch blits of a batch of layers onto one target, in
+    * order, e.g. all copybit layers of a frame. Same as setting the state
+    * of each layer with set_parameter followed by a stretch, in one call.
+    * The parameters are left as set by the last layer.
+    * May be NULL if the module does not support batches.
+    *
+    * @param dev from open
+    * @param target is the destination image and its state
+    * @param layers are the sources, with their rectangles and state
+    * @param count is the number of layers
+    *
+    * @return 0 if successful
+    */
+  int (*stretch_batch)(struct copybit_device_t *dev,
+                       struct copybit_target_t const *target,
+                       struct copybit_layer_t const *layers,
+                       int count);
 };
 
 
@@ -728,20 +728,14 @@ static void set_rects(struct copybit_context_t *ctx,
 
 /*****************************************************************************/
 
-/** Set a parameter to value */
-static int set_parameter_copybit(
+/** Set a parameter to value, with wait_cleanup_lock held */
+static int set_parameter_locked(
     struct copybit_device_t *dev,
     int name,
     int value)
 {
     struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
     int status = COPYBIT_SUCCESS;
-    if (!ctx) {
-        ALOGE("%s: null context", __FUNCTION__);
-        return -EINVAL;
-    }
-
-    pthread_mutex_lock(&ctx->wait_cleanup_lock);
     switch(name) {
         case COPYBIT_PLANE_ALPHA:
         {
@@ -820,6 +814,24 @@ static int set_parameter_copybit(
             status = -EINVAL;
             break;
     }
+    return status;
+}
+
+/** Set a parameter to value */
+static int set_parameter_copybit(
+    struct copybit_device_t *dev,
+    int name,
+    int value)
+{
+    struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
+    int status = COPYBIT_SUCCESS;
+    if (!ctx) {
+        ALOGE("%s: null context", __FUNCTION__);
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&ctx->wait_cleanup_lock);
+    status = set_parameter_locked(dev, name, value);
     pthread_mutex_unlock(&ctx->wait_cleanup_lock);
     return status;
 }
@@ -1015,14 +1027,6 @@ static int copy_image(private_handle_t *src_handle,
     return ret;
 }
 
-static void delete_handle(private_handle_t *handle)
-{
-    if (handle) {
-        delete handle;
-        handle = 0;
-    }
-}
-
 static bool need_to_execute_draw(struct copybit_context_t* ctx,
                                           eC2DFlags flags)
 {
@@ -1122,19 +1126,16 @@ static int stretch_copybit_internal(
     bool need_temp_dst = need_temp_buffer(dst);
     bufferInfo dst_info;
     populate_buffer_info(dst, dst_info);
-    private_handle_t* dst_hnd = new private_handle_t(-1, 0, 0, 0, dst_info.format,
-                                                     dst_info.width, dst_info.height);
-    if (dst_hnd == NULL) {
-        ALOGE("%s: dst_hnd is null", __FUNCTION__);
-        return COPYBIT_FAILURE;
-    }
+    // Temp handles only live for this blit, keep them off the heap
+    private_handle_t dst_tmp_hnd(-1, 0, 0, 0, dst_info.format,
+                                 dst_info.width, dst_info.height);
+    private_handle_t* dst_hnd = &dst_tmp_hnd;
     if (need_temp_dst) {
         if (get_size(dst_info) != ctx->temp_dst_buffer.size) {
             free_temp_buffer(ctx->temp_dst_buffer);
             // Create a temp buffer and set that as the destination.
             if (COPYBIT_FAILURE == get_temp_buffer(dst_info, ctx->temp_dst_buffer)) {
                 ALOGE("%s: get_temp_buffer(dst) failed", __FUNCTION__);
-                delete_handle(dst_hnd);
                 return COPYBIT_FAILURE;
             }
         }
@@ -1151,7 +1152,6 @@ static int stretch_copybit_internal(
                        (eC2DFlags)flags, mapped_dst_idx);
     if(status) {
         ALOGE("%s: dst: set_image error", __FUNCTION__);
-        delete_handle(dst_hnd);
         unmap_gpuaddr(ctx, mapped_dst_idx);
         return COPYBIT_FAILURE;
     }
@@ -1172,14 +1172,12 @@ static int stretch_copybit_internal(
         } else {
             ALOGE("%s: src number of YUV planes is invalid src format = 0x%x",
                   __FUNCTION__, src->format);
-            delete_handle(dst_hnd);
             unmap_gpuaddr(ctx, mapped_dst_idx);
             return -EINVAL;
         }
     } else {
         ALOGE("%s: Invalid source surface format 0x%x", __FUNCTION__,
                                                         src->format);
-        delete_handle(dst_hnd);
         unmap_gpuaddr(ctx, mapped_dst_idx);
         return -EINVAL;
     }
@@ -1193,14 +1191,9 @@ static int stretch_copybit_internal(
     bool need_temp_src = need_temp_buffer(src);
     bufferInfo src_info;
     populate_buffer_info(src, src_info);
-    private_handle_t* src_hnd = new private_handle_t(-1, 0, 0, 0, src_info.format,
-                                                 src_info.width, src_info.height);
-    if (NULL == src_hnd) {
-        ALOGE("%s: src_hnd is null", __FUNCTION__);
-        delete_handle(dst_hnd);
-        unmap_gpuaddr(ctx, mapped_dst_idx);
-        return COPYBIT_FAILURE;
-    }
+    private_handle_t src_tmp_hnd(-1, 0, 0, 0, src_info.format,
+                                 src_info.width, src_info.height);
+    private_handle_t* src_hnd = &src_tmp_hnd;
     if (need_temp_src) {
         if (get_size(src_info) != ctx->temp_src_buffer.size) {
             free_temp_buffer(ctx->temp_src_buffer);
@@ -1208,8 +1201,6 @@ static int stretch_copybit_internal(
             if (COPYBIT_SUCCESS != get_temp_buffer(src_info,
                                                ctx->temp_src_buffer)) {
                 ALOGE("%s: get_temp_buffer(src) failed", __FUNCTION__);
-                delete_handle(dst_hnd);
-                delete_handle(src_hnd);
                 unmap_gpuaddr(ctx, mapped_dst_idx);
                 return COPYBIT_FAILURE;
             }
@@ -1227,8 +1218,6 @@ static int stretch_copybit_internal(
                                 CONVERT_TO_C2D_FORMAT);
         if (status == COPYBIT_FAILURE) {
             ALOGE("%s:copy_image failed in temp source",__FUNCTION__);
-            delete_handle(dst_hnd);
-            delete_handle(src_hnd);
             unmap_gpuaddr(ctx, mapped_dst_idx);
             return status;
         }
@@ -1238,8 +1227,6 @@ static int stretch_copybit_internal(
         if (memalloc->clean_buffer((void *)(src_hnd->base), src_hnd->size,
                                    src_hnd->offset, src_hnd->fd)) {
             ALOGE("%s: clean_buffer failed", __FUNCTION__);
-            delete_handle(dst_hnd);
-            delete_handle(src_hnd);
             unmap_gpuaddr(ctx, mapped_dst_idx);
             return COPYBIT_FAILURE;
         }
@@ -1251,8 +1238,6 @@ static int stretch_copybit_internal(
                        (eC2DFlags)flags, mapped_src_idx);
     if(status) {
         ALOGE("%s: set_image (src) error", __FUNCTION__);
-        delete_handle(dst_hnd);
-        delete_handle(src_hnd);
         unmap_gpuaddr(ctx, mapped_dst_idx);
         unmap_gpuaddr(ctx, mapped_src_idx);
         return COPYBIT_FAILURE;
@@ -1266,8 +1251,6 @@ static int stretch_copybit_internal(
             src_surface.config_mask &= ~C2D_ALPHA_BLEND_NONE;
             if(!(src_surface.global_alpha)) {
                 // src alpha is zero
-                delete_handle(dst_hnd);
-                delete_handle(src_hnd);
                 unmap_gpuaddr(ctx, mapped_dst_idx);
                 unmap_gpuaddr(ctx, mapped_src_idx);
                 return COPYBIT_FAILURE;
@@ -1318,8 +1301,6 @@ static int stretch_copybit_internal(
         status = copy_image(dst_hnd, dst, CONVERT_TO_ANDROID_FORMAT);
         if (status == COPYBIT_FAILURE) {
             ALOGE("%s:copy_image failed in temp Dest",__FUNCTION__);
-            delete_handle(dst_hnd);
-            delete_handle(src_hnd);
             unmap_gpuaddr(ctx, mapped_dst_idx);
             unmap_gpuaddr(ctx, mapped_src_idx);
             return status;
@@ -1329,8 +1310,6 @@ static int stretch_copybit_internal(
         memalloc->clean_buffer((void *)(dst_hnd->base), dst_hnd->size,
                                dst_hnd->offset, dst_hnd->fd);
     }
-    delete_handle(dst_hnd);
-    delete_handle(src_hnd);
 
     ctx->is_premultiplied_alpha = false;
     ctx->fb_width = 0;
@@ -1358,6 +1337,40 @@ static int stretch_copybit(
     return status;
 }
 
+/** Add the stretch blits of a batch of layers to the blit list, taking
+ *  wait_cleanup_lock once */
+static int stretch_batch_copybit(
+    struct copybit_device_t *dev,
+    struct copybit_target_t const *target,
+    struct copybit_layer_t const *layers,
+    int count)
+{
+    struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
+    int status = COPYBIT_SUCCESS;
+    if (!ctx) {
+        ALOGE("%s: null context", __FUNCTION__);
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&ctx->wait_cleanup_lock);
+    for (int i = 0; (status == COPYBIT_SUCCESS) && i < count; i++) {
+        const struct copybit_layer_t *layer = &layers[i];
+        // Each stretch resets the FB size, which rotated targets need
+        set_parameter_locked(dev, COPYBIT_FRAMEBUFFER_WIDTH, target->fb_width);
+        set_parameter_locked(dev, COPYBIT_FRAMEBUFFER_HEIGHT,
+                             target->fb_height);
+        set_parameter_locked(dev, COPYBIT_TRANSFORM, layer->transform);
+        set_parameter_locked(dev, COPYBIT_PLANE_ALPHA, layer->alpha);
+        set_parameter_locked(dev, COPYBIT_BLEND_MODE, layer->blend_mode);
+        bool needsBlending = (ctx->src_global_alpha != 0);
+        status = stretch_copybit_internal(dev, &target->image, &layer->src,
+                                          &layer->dst_rect, &layer->src_rect,
+                                          layer->region, needsBlending);
+    }
+    pthread_mutex_unlock(&ctx->wait_cleanup_lock);
+    return status;
+}
+
 /** Perform a blit type operation */
 static int blit_copybit(
     struct copybit_device_t *dev,
@@ -1498,6 +1511,7 @@ static int open_copybit(const struct hw_module_t* module, const char* name,
     ctx->device.stretch = stretch_copybit;
     ctx->device.finish = finish_copybit;
     ctx->device.flush_get_fence = flush_get_fence_copybit;
+    ctx->device.stretch_batch = stretch_batch_copybit;
 
     /* Create RGB Surface */
     surfDefinition.buffer = (void*)0xdddddddd;
@@ -37,6 +37,8 @@
 #include "external.h"
 #include "overlayUtils.h"
 #include "overlay.h"
+#include "display_config.h"
+#include "ioctl_backend.h"
 
 using namespace android;
 
@@ -112,7 +114,7 @@ int ExternalDisplay::configureWFDDisplay() {
     openFrameBuffer(mWfdFbNum);
     if(mFd == -1)
         return -1;
-    ret = ioctl(mFd, FBIOGET_VSCREENINFO, &mVInfo);
+    ret = qdutils::devIoctl(mFd, FBIOGET_VSCREENINFO, &mVInfo);
     if(ret < 0) {
         ALOGD("In %s: FBIOGET_VSCREENINFO failed Err Str = %s", __FUNCTION__,
                 strerror(errno));
@@ -522,9 +524,7 @@ int ExternalDisplay::getModeOrder(int mode)
 /// Returns the user mode set(if any) using adb shell
 int ExternalDisplay::getUserMode() {
     /* Based on the property set the resolution */
-    char property_value[PROPERTY_VALUE_MAX];
-    property_get("hw.hdmi.resolution", property_value, "-1");
-    int mode = atoi(property_value);
+    int mode = qdutils::DisplayConfig::getInstance().hdmiResolution;
     // We dont support interlaced modes
     if(isValidMode(mode) && !isInterlacedMode(mode)) {
         ALOGD_IF(DEBUG, "%s: setting the HDMI mode = %d", __FUNCTION__, mode);
@@ -582,7 +582,7 @@ void ExternalDisplay::setResolution(int ID)
 {
     struct fb_var_screeninfo info;
     int ret = 0;
-    ret = ioctl(mFd, FBIOGET_VSCREENINFO, &mVInfo);
+    ret = qdutils::devIoctl(mFd, FBIOGET_VSCREENINFO, &mVInfo);
     if(ret < 0) {
         ALOGD("In %s: FBIOGET_VSCREENINFO failed Err Str = %s", __FUNCTION__,
                                                             strerror(errno));
@@ -618,13 +618,13 @@ void ExternalDisplay::setResolution(int ID)
         memset(&metadata, 0 , sizeof(metadata));
         metadata.op = metadata_op_vic;
         metadata.data.video_info_code = mode->video_format;
-        if (ioctl(mFd, MSMFB_METADATA_SET, &metadata) == -1) {
+        if (qdutils::devIoctl(mFd, MSMFB_METADATA_SET, &metadata) == -1) {
             ALOGD("In %s: MSMFB_METADATA_SET failed Err Str = %s",
                                                  __FUNCTION__, strerror(errno));
         }
 #endif
         mVInfo.activate = FB_ACTIVATE_NOW | FB_ACTIVATE_ALL | FB_ACTIVATE_FORCE;
-        ret = ioctl(mFd, FBIOPUT_VSCREENINFO, &mVInfo);
+        ret = qdutils::devIoctl(mFd, FBIOPUT_VSCREENINFO, &mVInfo);
         if(ret < 0) {
             ALOGD("In %s: FBIOPUT_VSCREENINFO failed Err Str = %s",
                                                  __FUNCTION__, strerror(errno));
@@ -694,7 +694,7 @@ bool ExternalDisplay::post()
     struct mdp_display_commit ext_commit;
     memset(&ext_commit, 0, sizeof(struct mdp_display_commit));
     ext_commit.flags = MDP_DISPLAY_COMMIT_OVERLAY;
-    if (ioctl(mFd, MSMFB_DISPLAY_COMMIT, &ext_commit) == -1) {
+    if (qdutils::devIoctl(mFd, MSMFB_DISPLAY_COMMIT, &ext_commit) == -1) {
         ALOGE("%s: MSMFB_DISPLAY_COMMIT for external failed, str: %s",
                 __FUNCTION__, strerror(errno));
         return false;
@@ -35,6 +35,7 @@
 #include <sys/ioctl.h>
 
 #include "genlock.h"
+#include "ioctl_backend.h"
 
 #define GENLOCK_DEVICE "/dev/genlock"
 
@@ -83,7 +84,8 @@ namespace {
             lock.fd = hnd->genlockHandle;
 
 #ifdef GENLOCK_IOC_DREADLOCK
-            if (ioctl(hnd->genlockPrivFd, GENLOCK_IOC_DREADLOCK, &lock)) {
+            if (qdutils::devIoctl(hnd->genlockPrivFd, GENLOCK_IOC_DREADLOCK,
+                                  &lock)) {
                 ALOGE("%s: GENLOCK_IOC_DREADLOCK failed (lockType0x%x,"
                        "err=%s fd=%d)", __FUNCTION__,
                       lockType, strerror(errno), hnd->fd);
@@ -94,7 +96,8 @@ namespace {
             }
 #else
             // depreciated
-            if (ioctl(hnd->genlockPrivFd, GENLOCK_IOC_LOCK, &lock)) {
+            if (qdutils::devIoctl(hnd->genlockPrivFd, GENLOCK_IOC_LOCK,
+                                  &lock)) {
                 ALOGE("%s: GENLOCK_IOC_LOCK failed (lockType0x%x, err=%s fd=%d)"
                       ,__FUNCTION__, lockType, strerror(errno), hnd->fd);
                 if (ETIMEDOUT == errno)
@@ -150,7 +153,7 @@ genlock_status_t genlock_create_lock(native_handle_t *buffer_handle)
 
         // Create a new lock
         genlock_lock lock;
-        if (ioctl(fd, GENLOCK_IOC_NEW, NULL)) {
+        if (qdutils::devIoctl(fd, GENLOCK_IOC_NEW, NULL)) {
             ALOGE("%s: GENLOCK_IOC_NEW failed (error=%s)", __FUNCTION__,
                   strerror(errno));
             close_genlock_fd_and_handle(fd, lock.fd);
@@ -159,7 +162,7 @@ genlock_status_t genlock_create_lock(native_handle_t *buffer_handle)
 
         // Export the lock for other processes to be able to use it.
         if (GENLOCK_FAILURE != ret) {
-            if (ioctl(fd, GENLOCK_IOC_EXPORT, &lock)) {
+            if (qdutils::devIoctl(fd, GENLOCK_IOC_EXPORT, &lock)) {
                 ALOGE("%s: GENLOCK_IOC_EXPORT failed (error=%s)", __FUNCTION__,
                       strerror(errno));
                 close_genlock_fd_and_handle(fd, lock.fd);
@@ -238,7 +241,7 @@ genlock_status_t genlock_attach_lock(native_handle_t *buffer_handle)
         // Attach the local handle to an existing lock
         genlock_lock lock;
         lock.fd = hnd->genlockHandle;
-        if (ioctl(fd, GENLOCK_IOC_ATTACH, &lock)) {
+        if (qdutils::devIoctl(fd, GENLOCK_IOC_ATTACH, &lock)) {
             ALOGE("%s: GENLOCK_IOC_ATTACH failed (err=%s)", __FUNCTION__,
                   strerror(errno));
             close_genlock_fd_and_handle(fd, lock.fd);
@@ -331,7 +334,7 @@ genlock_status_t genlock_wait(native_handle_t *buffer_handle, int timeout) {
         genlock_lock lock;
         lock.fd = hnd->genlockHandle;
         lock.timeout = timeout;
-        if (ioctl(hnd->genlockPrivFd, GENLOCK_IOC_WAIT, &lock)) {
+        if (qdutils::devIoctl(hnd->genlockPrivFd, GENLOCK_IOC_WAIT, &lock)) {
             ALOGE("%s: GENLOCK_IOC_WAIT failed (err=%s)",  __FUNCTION__,
                   strerror(errno));
             return GENLOCK_FAILURE;
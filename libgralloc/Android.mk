@@ -35,9 +35,10 @@ include $(CLEAR_VARS)
 LOCAL_MODULE                  := libmemalloc
 LOCAL_MODULE_TAGS             := optional
 LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
-LOCAL_SHARED_LIBRARIES        := $(common_libs) libgenlock libqdutils libdl
+LOCAL_SHARED_LIBRARIES        := $(common_libs) libgenlock libqdutils libdl libsync
 LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdmemalloc\"
 LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps) $(kernel_deps)
-LOCAL_SRC_FILES               :=  ionalloc.cpp alloc_controller.cpp
+LOCAL_SRC_FILES               :=  ionalloc.cpp alloc_controller.cpp \
+                                 scratch_pool.cpp
 
 include $(BUILD_SHARED_LIBRARY)
@@ -323,6 +323,12 @@ size_t getBufferSizeAndDimensions(int width, int height, int format,
 // private_handle_t. It is the responsibility of the caller
 // to free the buffer using the free_buffer function
 int alloc_buffer(private_handle_t **pHnd, int w, int h, int format, int usage)
+{
+    return alloc_sized_buffer(pHnd, w, h, format, usage, 0);
+}
+
+int alloc_sized_buffer(private_handle_t **pHnd, int w, int h, int format,
+                       int usage, size_t minSize)
 {
     alloc_data data;
     int alignedw, alignedh;
@@ -332,6 +338,8 @@ int alloc_buffer(private_handle_t **pHnd, int w, int h, int format, int usage)
     data.fd = -1;
     data.offset = 0;
     data.size = getBufferSizeAndDimensions(w, h, format, alignedw, alignedh);
+    if(data.size < minSize)
+        data.size = minSize;
     data.align = getpagesize();
     data.uncached = useUncached(usage);
     int allocFlags = usage;
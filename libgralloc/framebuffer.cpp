@@ -42,6 +42,8 @@
 #include <genlock.h>
 #include <cutils/properties.h>
 #include <profiler.h>
+#include <display_config.h>
+#include <ioctl_backend.h>
 
 #define EVEN_OUT(x) if (x & 0x0001) {x--;}
 /** min of int a, b */
@@ -68,9 +70,8 @@ static int fb_setSwapInterval(struct framebuffer_device_t* dev,
 {
     //XXX: Get the value here and implement along with
     //single vsync in HWC
-    char pval[PROPERTY_VALUE_MAX];
-    property_get("debug.egl.swapinterval", pval, "-1");
-    int property_interval = atoi(pval);
+    int property_interval =
+            qdutils::DisplayConfig::getInstance().swapInterval;
     if (property_interval >= 0)
         interval = property_interval;
 
@@ -91,7 +92,13 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
     struct mdp_display_commit prim_commit;
     memset(&prim_commit, 0, sizeof(struct mdp_display_commit));
     prim_commit.flags = MDP_DISPLAY_COMMIT_OVERLAY;
-    if (ioctl(m->framebuffer->fd, MSMFB_DISPLAY_COMMIT, &prim_commit) == -1) {
+#ifdef PARTIAL_UPDATE
+    //ROI set by HWC applies to this post only, zero means full frame
+    prim_commit.roi = m->commit.roi;
+    memset(&m->commit.roi, 0, sizeof(m->commit.roi));
+#endif
+    if (qdutils::devIoctl(m->framebuffer->fd, MSMFB_DISPLAY_COMMIT,
+                          &prim_commit) == -1) {
         ALOGE("%s: MSMFB_DISPLAY_COMMIT for primary failed, str: %s",
                 __FUNCTION__, strerror(errno));
         return -errno;
@@ -138,11 +145,11 @@ int mapFrameBufferLocked(struct private_module_t* module)
     memset(&module->commit, 0, sizeof(struct mdp_display_commit));
 
     struct fb_fix_screeninfo finfo;
-    if (ioctl(fd, FBIOGET_FSCREENINFO, &finfo) == -1)
+    if (qdutils::devIoctl(fd, FBIOGET_FSCREENINFO, &finfo) == -1)
         return -errno;
 
     struct fb_var_screeninfo info;
-    if (ioctl(fd, FBIOGET_VSCREENINFO, &info) == -1)
+    if (qdutils::devIoctl(fd, FBIOGET_VSCREENINFO, &info) == -1)
         return -errno;
 
     info.reserved[0] = 0;
@@ -236,7 +243,7 @@ int mapFrameBufferLocked(struct private_module_t* module)
               info.yres_virtual, info.yres*2);
     }
 
-    if (ioctl(fd, FBIOGET_VSCREENINFO, &info) == -1)
+    if (qdutils::devIoctl(fd, FBIOGET_VSCREENINFO, &info) == -1)
         return -errno;
 
     if (int(info.width) <= 0 || int(info.height) <= 0) {
@@ -251,7 +258,7 @@ int mapFrameBufferLocked(struct private_module_t* module)
 #ifdef MSMFB_METADATA_GET
     memset(&metadata, 0 , sizeof(metadata));
     metadata.op = metadata_op_frame_rate;
-    if (ioctl(fd, MSMFB_METADATA_GET, &metadata) == -1) {
+    if (qdutils::devIoctl(fd, MSMFB_METADATA_GET, &metadata) == -1) {
         ALOGE("Error retrieving panel frame rate");
         return -errno;
     }
@@ -292,7 +299,7 @@ int mapFrameBufferLocked(struct private_module_t* module)
          );
 
 
-    if (ioctl(fd, FBIOGET_FSCREENINFO, &finfo) == -1)
+    if (qdutils::devIoctl(fd, FBIOGET_FSCREENINFO, &finfo) == -1)
         return -errno;
 
     if (finfo.smem_len <= 0)
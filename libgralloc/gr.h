@@ -61,6 +61,9 @@ int decideBufferHandlingMechanism(int format, const char *compositionUsed,
 // Allocate buffer from width, height, format into a private_handle_t
 // It is the responsibility of the caller to free the buffer
 int alloc_buffer(private_handle_t **pHnd, int w, int h, int format, int usage);
+// Same as alloc_buffer, with the buffer at least minSize bytes large
+int alloc_sized_buffer(private_handle_t **pHnd, int w, int h, int format,
+                       int usage, size_t minSize);
 void free_buffer(private_handle_t *hnd);
 
 /*****************************************************************************/
@@ -36,6 +36,7 @@
 #include <errno.h>
 #include "gralloc_priv.h"
 #include "ionalloc.h"
+#include "ioctl_backend.h"
 
 using gralloc::IonAlloc;
 
@@ -109,9 +110,9 @@ int IonAlloc::alloc_buffer(alloc_data& data)
         iFd = mIonFd;
     }
 
-    if(ioctl(iFd, ION_IOC_ALLOC, &ionAllocData)) {
+    if(qdutils::devIoctl(iFd, ION_IOC_ALLOC, &ionAllocData)) {
 #else
-    if(ioctl(mIonFd, ION_IOC_ALLOC, &ionAllocData)) {
+    if(qdutils::devIoctl(mIonFd, ION_IOC_ALLOC, &ionAllocData)) {
 #endif
         err = -errno;
         ALOGE("ION_IOC_ALLOC failed with error - %s", strerror(errno));
@@ -126,15 +127,15 @@ int IonAlloc::alloc_buffer(alloc_data& data)
     fd_data.handle = ionAllocData.handle;
     handle_data.handle = ionAllocData.handle;
 #ifndef NEW_ION_API
-    if(ioctl(iFd, ION_IOC_MAP, &fd_data))
+    if(qdutils::devIoctl(iFd, ION_IOC_MAP, &fd_data))
 #else
-    if(ioctl(mIonFd, ION_IOC_MAP, &fd_data))
+    if(qdutils::devIoctl(mIonFd, ION_IOC_MAP, &fd_data))
 #endif
     {
         err = -errno;
         ALOGE("%s: ION_IOC_MAP failed with error - %s",
               __FUNCTION__, strerror(errno));
-        ioctl(mIonFd, ION_IOC_FREE, &handle_data);
+        qdutils::devIoctl(mIonFd, ION_IOC_FREE, &handle_data);
 #ifndef NEW_ION_API
         if(ionSyncFd >= 0)
             close(ionSyncFd);
@@ -150,7 +151,7 @@ int IonAlloc::alloc_buffer(alloc_data& data)
             err = -errno;
             ALOGE("%s: Failed to map the allocated memory: %s",
                   __FUNCTION__, strerror(errno));
-            ioctl(mIonFd, ION_IOC_FREE, &handle_data);
+            qdutils::devIoctl(mIonFd, ION_IOC_FREE, &handle_data);
 #ifndef NEW_ION_API
             ionSyncFd = FD_INIT;
 #endif
@@ -170,7 +171,7 @@ int IonAlloc::alloc_buffer(alloc_data& data)
 
     data.base = base;
     data.fd = fd_data.fd;
-    ioctl(mIonFd, ION_IOC_FREE, &handle_data);
+    qdutils::devIoctl(mIonFd, ION_IOC_FREE, &handle_data);
     ALOGD_IF(DEBUG, "ion: Allocated buffer base:%p size:%d fd:%d",
           data.base, ionAllocData.len, data.fd);
     return 0;
@@ -242,7 +243,7 @@ int IonAlloc::clean_buffer(void *base, size_t size, int offset, int fd)
         return err;
 
     fd_data.fd = fd;
-    if (ioctl(mIonFd, ION_IOC_IMPORT, &fd_data)) {
+    if (qdutils::devIoctl(mIonFd, ION_IOC_IMPORT, &fd_data)) {
         err = -errno;
         ALOGE("%s: ION_IOC_IMPORT failed with error - %s",
               __FUNCTION__, strerror(errno));
@@ -260,18 +261,18 @@ int IonAlloc::clean_buffer(void *base, size_t size, int offset, int fd)
     d.cmd = ION_IOC_CLEAN_INV_CACHES;
     d.arg = (unsigned long int)&flush_data;
 
-    if(ioctl(mIonFd, ION_IOC_CUSTOM, &d)) {
+    if(qdutils::devIoctl(mIonFd, ION_IOC_CUSTOM, &d)) {
 #else
-    if(ioctl(mIonFd, ION_IOC_CLEAN_INV_CACHES, &flush_data)) {
+    if(qdutils::devIoctl(mIonFd, ION_IOC_CLEAN_INV_CACHES, &flush_data)) {
 #endif
         err = -errno;
         ALOGE("%s: ION_IOC_CLEAN_INV_CACHES failed with error - %s",
 
               __FUNCTION__, strerror(errno));
-        ioctl(mIonFd, ION_IOC_FREE, &handle_data);
+        qdutils::devIoctl(mIonFd, ION_IOC_FREE, &handle_data);
         return err;
     }
-    ioctl(mIonFd, ION_IOC_FREE, &handle_data);
+    qdutils::devIoctl(mIonFd, ION_IOC_FREE, &handle_data);
     return 0;
 }
 
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cutils/log.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sync/sync.h>
+#include "gralloc_priv.h"
+#include "gr.h"
+#include "scratch_pool.h"
+
+#define SCRATCH_DEBUG 0
+
+namespace gralloc {
+
+ScratchPool *ScratchPool::sInstance = NULL;
+pthread_once_t ScratchPool::sOnce = PTHREAD_ONCE_INIT;
+
+void ScratchPool::init()
+{
+    sInstance = new ScratchPool();
+}
+
+ScratchPool* ScratchPool::getInstance()
+{
+    //The first caller can be a blit or a dumpsys
+    pthread_once(&sOnce, init);
+    return sInstance;
+}
+
+ScratchPool::ScratchPool() : mTotalSize(0), mHits(0), mAllocs(0),
+        mFailures(0)
+{
+    memset(mEntries, 0, sizeof(mEntries));
+    for(int i = 0; i < MAX_SCRATCH_BUFFERS; i++)
+        mEntries[i].fence = -1;
+    pthread_mutex_init(&mLock, NULL);
+}
+
+int ScratchPool::getFreeSlot()
+{
+    for(int i = 0; i < MAX_SCRATCH_BUFFERS; i++) {
+        if(!mEntries[i].hnd)
+            return i;
+    }
+    return -1;
+}
+
+size_t ScratchPool::getBucketSize(size_t size)
+{
+    if(size < SCRATCH_LARGE_BUCKET)
+        return ALIGN(size, SCRATCH_SMALL_BUCKET);
+    return ALIGN(size, SCRATCH_LARGE_BUCKET);
+}
+
+bool ScratchPool::evict()
+{
+    int victim = -1;
+    for(int i = 0; i < MAX_SCRATCH_BUFFERS; i++) {
+        Entry& e = mEntries[i];
+        if(!e.hnd || e.inUse)
+            continue;
+        if(e.fence >= 0) {
+            if(sync_wait(e.fence, 0) < 0)
+                continue;
+            close(e.fence);
+            e.fence = -1;
+        }
+        if(victim < 0 || e.size > mEntries[victim].size)
+            victim = i;
+    }
+    if(victim < 0)
+        return false;
+
+    Entry& e = mEntries[victim];
+    ALOGD_IF(SCRATCH_DEBUG, "%s: freeing %zu bytes", __FUNCTION__, e.size);
+    free_buffer(e.hnd);
+    mTotalSize -= e.size;
+    memset(&e, 0, sizeof(e));
+    e.fence = -1;
+    return true;
+}
+
+int ScratchPool::get(private_handle_t **pHnd, int w, int h, int format,
+                     int usage)
+{
+    int alignedw, alignedh;
+    int needed = (int)getBufferSizeAndDimensions(w, h, format, alignedw,
+                                                 alignedh);
+    if(needed <= 0)
+        return -EINVAL;
+    size_t bucket = getBucketSize(needed);
+
+    pthread_mutex_lock(&mLock);
+    int index = -1;
+    for(int i = 0; i < MAX_SCRATCH_BUFFERS; i++) {
+        Entry& e = mEntries[i];
+        if(!e.hnd || e.inUse || e.usage != usage || e.size != bucket)
+            continue;
+        //Zero timeout only polls the fence
+        if(e.fence >= 0) {
+            if(sync_wait(e.fence, 0) < 0)
+                continue;
+            close(e.fence);
+            e.fence = -1;
+        }
+        index = i;
+        mHits++;
+        break;
+    }
+
+    if(index < 0) {
+        //Make room within the cap, and for the entry itself
+        while(mTotalSize + bucket > SCRATCH_POOL_MAX_SIZE && evict());
+        index = getFreeSlot();
+        if(index < 0 && evict())
+            index = getFreeSlot();
+        if(mTotalSize + bucket > SCRATCH_POOL_MAX_SIZE)
+            index = -1;
+        private_handle_t *hnd = NULL;
+        if(index < 0 || alloc_sized_buffer(&hnd, w, h, format, usage,
+                                           bucket) < 0) {
+            mFailures++;
+            pthread_mutex_unlock(&mLock);
+            ALOGE("%s: no scratch buffer of %zu bytes, pool holds %zu",
+                  __FUNCTION__, bucket, mTotalSize);
+            return -ENOMEM;
+        }
+        mEntries[index].hnd = hnd;
+        mEntries[index].size = bucket;
+        mEntries[index].usage = usage;
+        mEntries[index].fence = -1;
+        mTotalSize += bucket;
+        mAllocs++;
+    }
+
+    //Buffers are shared by sizes, so lay it out as asked for
+    Entry& e = mEntries[index];
+    e.inUse = true;
+    e.hnd->width = alignedw;
+    e.hnd->height = alignedh;
+    e.hnd->format = format;
+    *pHnd = e.hnd;
+    pthread_mutex_unlock(&mLock);
+    return 0;
+}
+
+void ScratchPool::put(private_handle_t *hnd, int releaseFence)
+{
+    pthread_mutex_lock(&mLock);
+    for(int i = 0; i < MAX_SCRATCH_BUFFERS; i++) {
+        Entry& e = mEntries[i];
+        if(e.hnd == hnd) {
+            e.inUse = false;
+            e.fence = releaseFence;
+            pthread_mutex_unlock(&mLock);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+    ALOGE("%s: buffer not from the pool", __FUNCTION__);
+    if(releaseFence >= 0)
+        close(releaseFence);
+}
+
+void ScratchPool::getDump(char *buf, size_t len)
+{
+    char str[256] = {'\0'};
+    pthread_mutex_lock(&mLock);
+    int count = 0;
+    for(int i = 0; i < MAX_SCRATCH_BUFFERS; i++) {
+        if(mEntries[i].hnd)
+            count++;
+    }
+    snprintf(str, sizeof(str), "  Scratch pool: buffers=%d bytes=%zu "
+             "hits=%u allocs=%u failures=%u\n", count, mTotalSize, mHits,
+             mAllocs, mFailures);
+    pthread_mutex_unlock(&mLock);
+    strlcat(buf, str, len);
+}
+
+} //end namespace gralloc
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GRALLOC_SCRATCHPOOL_H
+#define GRALLOC_SCRATCHPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+struct private_handle_t;
+
+//Scratch buffers the pool holds at most
+#define MAX_SCRATCH_BUFFERS 16
+//Bytes the pool may hold, in use or not
+#define SCRATCH_POOL_MAX_SIZE (32 * 1024 * 1024)
+//Sizes are rounded up to these steps, so that a buffer fits the
+//neighbouring sizes too
+#define SCRATCH_SMALL_BUCKET (64 * 1024)
+#define SCRATCH_LARGE_BUCKET (1024 * 1024)
+
+namespace gralloc {
+
+// Intermediate buffers for blits, e.g. the first pass of a two pass scale
+// or a color conversion. Buffers are bucketed by size and recycled once
+// the release fence they were returned with signals, so steady state
+// frames do no ION allocation, mapping or cache maintenance.
+class ScratchPool {
+public:
+    static ScratchPool* getInstance();
+    /* Returns a free buffer laid out as a w x h buffer of "format", from
+     * the heaps in "usage". Allocates one if none fits, within the cap */
+    int get(private_handle_t **pHnd, int w, int h, int format, int usage);
+    /* Returns a buffer from get() to the pool. It is handed out again once
+     * releaseFence, which the pool takes ownership of, signals. Pass -1 if
+     * the buffer is already idle */
+    void put(private_handle_t *hnd, int releaseFence);
+    void getDump(char *buf, size_t len);
+
+private:
+    struct Entry {
+        private_handle_t *hnd;
+        size_t size;
+        int usage;
+        int fence;
+        bool inUse;
+    };
+
+    ScratchPool();
+    static void init();
+    //Frees an idle buffer, preferring the largest, to make room
+    bool evict();
+    int getFreeSlot();
+    static size_t getBucketSize(size_t size);
+
+    Entry mEntries[MAX_SCRATCH_BUFFERS];
+    size_t mTotalSize;
+    pthread_mutex_t mLock;
+    static ScratchPool *sInstance;
+    static pthread_once_t sOnce;
+
+    //Stats
+    uint32_t mHits;
+    uint32_t mAllocs;
+    uint32_t mFailures;
+};
+
+} //end namespace gralloc
+#endif // GRALLOC_SCRATCHPOOL_H
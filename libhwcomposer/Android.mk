@@ -1,25 +1,60 @@
 LOCAL_PATH := $(call my-dir)
 include $(LOCAL_PATH)/../common.mk
+
+hwc_shared_libs := $(common_libs) libEGL liboverlay libgenlock \
+                   libexternal libqdutils libhardware_legacy \
+                   libdl libmemalloc libqservice libsync \
+                   libbinder libmedia
+
+hwc_src_files := hwc.cpp          \
+                 hwc_video.cpp    \
+                 hwc_utils.cpp    \
+                 hwc_uevents.cpp  \
+                 hwc_vsync.cpp    \
+                 hwc_fbupdate.cpp \
+                 hwc_mdpcomp.cpp  \
+                 hwc_copybit.cpp  \
+                 hwc_qclient.cpp  \
+                 hwc_trace.cpp    \
+                 hwc_worker.cpp   \
+                 hwc_damage.cpp   \
+                 hwc_eventloop.cpp \
+                 hwc_cost.cpp
+
 include $(CLEAR_VARS)
 
 LOCAL_MODULE                  := hwcomposer.$(TARGET_BOARD_PLATFORM)
 LOCAL_MODULE_PATH             := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_MODULE_TAGS             := optional
 LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
-LOCAL_SHARED_LIBRARIES        := $(common_libs) libEGL liboverlay libgenlock \
-                                 libexternal libqdutils libhardware_legacy \
-                                 libdl libmemalloc libqservice libsync \
-                                 libbinder libmedia
+LOCAL_SHARED_LIBRARIES        := $(hwc_shared_libs)
 LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdhwcomposer\"
 LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
-LOCAL_SRC_FILES               := hwc.cpp          \
-                                 hwc_video.cpp    \
-                                 hwc_utils.cpp    \
-                                 hwc_uevents.cpp  \
-                                 hwc_vsync.cpp    \
-                                 hwc_fbupdate.cpp \
-                                 hwc_mdpcomp.cpp  \
-                                 hwc_copybit.cpp  \
-                                 hwc_qclient.cpp
-
+LOCAL_SRC_FILES               := $(hwc_src_files)
 include $(BUILD_SHARED_LIBRARY)
+
+# Replays a frame trace on the fake MDP backend, the HAL built in
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                  := hwc_trace_replay
+LOCAL_MODULE_TAGS             := optional
+LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
+LOCAL_SHARED_LIBRARIES        := $(hwc_shared_libs)
+LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdhwcreplay\"
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+LOCAL_SRC_FILES               := $(hwc_src_files) hwc_fake.cpp \
+                                 hwc_trace_replay.cpp
+include $(BUILD_EXECUTABLE)
+
+# Times the composition decision paths on synthetic lists, fake MDP backend
+include $(CLEAR_VARS)
+
+LOCAL_MODULE                  := hwc_bench
+LOCAL_MODULE_TAGS             := optional
+LOCAL_C_INCLUDES              := $(common_includes) $(kernel_includes)
+LOCAL_SHARED_LIBRARIES        := $(hwc_shared_libs)
+LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdhwcbench\"
+LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
+LOCAL_SRC_FILES               := $(hwc_src_files) hwc_fake.cpp \
+                                 hwc_bench.cpp
+include $(BUILD_EXECUTABLE)
@@ -20,6 +20,8 @@
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
 #include <cutils/log.h>
 #include <cutils/atomic.h>
@@ -29,16 +31,29 @@
 #include <overlay.h>
 #include <fb_priv.h>
 #include <mdp_version.h>
+#include <ioctl_backend.h>
+#include <ioctl_stats.h>
 #include "hwc_utils.h"
 #include "hwc_video.h"
 #include "hwc_fbupdate.h"
 #include "hwc_mdpcomp.h"
 #include "external.h"
 #include "hwc_copybit.h"
+#include "hwc_trace.h"
+#include "hwc_worker.h"
+#include "hwc_damage.h"
+#include "hwc_vsync.h"
+#include "hwc_eventloop.h"
+#include "hwc_cost.h"
 
 using namespace qhwc;
 #define VSYNC_DEBUG 0
 
+//Fires when the next parked pipe expires. A screen that stops composing
+//runs no round that would age them.
+static int sParkTimerFd = -1;
+static nsecs_t sParkDeadline = 0;
+
 static int hwc_device_open(const struct hw_module_t* module,
                            const char* name,
                            struct hw_device_t** device);
@@ -61,6 +76,43 @@ hwc_module_t HAL_MODULE_INFO_SYM = {
     }
 };
 
+static void arm_park_timer(hwc_context_t *ctx) {
+    nsecs_t deadline = ctx->mOverlay->getParkDeadline();
+    if(sParkTimerFd < 0 || deadline == sParkDeadline)
+        return;
+    sParkDeadline = deadline;
+    //A zero value disarms the timer
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = deadline / 1000000000LL;
+    spec.it_value.tv_nsec = deadline % 1000000000LL;
+    if(timerfd_settime(sParkTimerFd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+        ALOGE("%s: timerfd_settime failed, %s", __FUNCTION__,
+                strerror(errno));
+}
+
+static void park_timer_event(void *data, uint32_t events) {
+    hwc_context_t *ctx = (hwc_context_t *)data;
+    uint64_t expirations;
+    if(read(sParkTimerFd, &expirations, sizeof(expirations)) < 0)
+        return;
+    Locker::Autolock _l(ctx->mBlankLock);
+    sParkDeadline = 0;
+    ctx->mOverlay->expireParked(false);
+    arm_park_timer(ctx);
+}
+
+static void init_park_timer(hwc_context_t *ctx) {
+    sParkTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if(sParkTimerFd < 0) {
+        ALOGE("%s: timerfd_create failed, %s", __FUNCTION__,
+                strerror(errno));
+        return;
+    }
+    ctx->mEventLoop->addFd(sParkTimerFd, EPOLLIN, park_timer_event, ctx,
+            "pipe expiry");
+}
+
 /*
  * Save callback functions registered to HWC
  */
@@ -76,17 +128,29 @@ static void hwc_registerProcs(struct hwc_composer_device_1* dev,
     ctx->proc = procs;
 
     // Now that we have the functions needed, kick off
-    // the uevent & vsync threads
-    init_uevent_thread(ctx);
-    init_vsync_thread(ctx);
+    // the uevent & vsync handling
+    init_uevent(ctx);
+    init_vsync(ctx);
+    init_park_timer(ctx);
+    ctx->mEventLoop->start();
 }
 
 //Helper
 static void reset(hwc_context_t *ctx, int numDisplays,
                   hwc_display_contents_1_t** displays) {
-    memset(ctx->listStats, 0, sizeof(ctx->listStats));
     for(int i = 0; i < MAX_DISPLAYS; i++) {
         hwc_display_contents_1_t *list = displays[i];
+
+        if(ctx->mCopyBit[i])
+            ctx->mCopyBit[i]->reset();
+
+        //Display keeps the setup of the last frame
+        if(ctx->mPlan[i]->match(ctx, list, i))
+            continue;
+
+        memset(&ctx->listStats[i], 0, sizeof(ctx->listStats[i]));
+        ctx->layerProp[i] = NULL;
+        ctx->mFrameArena[i]->reset();
         // XXX:SurfaceFlinger no longer guarantees that this
         // value is reset on every prepare. However, for the layer
         // cache we need to reset it.
@@ -101,23 +165,18 @@ static void reset(hwc_context_t *ctx, int numDisplays,
         if(ctx->mFBUpdate[i])
             ctx->mFBUpdate[i]->reset();
 
-        if(ctx->mCopyBit[i])
-            ctx->mCopyBit[i]->reset();
+        VideoOverlay::reset(i);
     }
-    VideoOverlay::reset();
 }
 
-//clear prev layer prop flags and realloc for current frame
+//clear prev layer prop flags and alloc for current frame
 static void reset_layer_prop(hwc_context_t* ctx, int dpy) {
     int layer_count = ctx->listStats[dpy].numAppLayers;
 
-    if(ctx->layerProp[dpy]) {
-       delete[] ctx->layerProp[dpy];
-       ctx->layerProp[dpy] = NULL;
-    }
-
+    ctx->layerProp[dpy] = NULL;
     if(layer_count) {
-       ctx->layerProp[dpy] = new LayerProp[layer_count];
+       ctx->layerProp[dpy] =
+               ctx->mFrameArena[dpy]->create<LayerProp>(layer_count);
     }
 }
 
@@ -125,31 +184,52 @@ static int hwc_prepare_primary(hwc_composer_device_1 *dev,
         hwc_display_contents_1_t *list) {
     hwc_context_t* ctx = (hwc_context_t*)(dev);
     const int dpy = HWC_DISPLAY_PRIMARY;
+    qdutils::IoctlStats::setDisplay(dpy);
     if (LIKELY(list && list->numHwLayers > 1 &&
         list->numHwLayers <= MAX_NUM_LAYERS) && ctx->dpyAttr[dpy].isActive) {
         uint32_t last = list->numHwLayers - 1;
         hwc_layer_1_t *fbLayer = &list->hwLayers[last];
         if(fbLayer->handle) {
-            setListStats(ctx, list, dpy);
-            reset_layer_prop(ctx, dpy);
-            int ret = ctx->mMDPComp->prepare(ctx, list);
-            if(!ret) {
-                // IF MDPcomp fails use this route
-                VideoOverlay::prepare(ctx, list, dpy);
-                ctx->mFBUpdate[dpy]->prepare(ctx, list);
+            int ret = 0;
+            if(ctx->mPlan[dpy]->isMatched()) {
+                //Only buffers changed, keep the last frame's setup
+                ctx->mPlan[dpy]->restore(ctx, list, dpy);
+                ret = ctx->mMDPComp->isUsed();
+            } else {
+                FrameTrace *trace = ctx->mFrameTrace;
+                int64_t t = systemTime();
+                setListStats(ctx, list, dpy);
+                t = trace->pathDone(dpy, TRACE_PATH_LISTSTATS, t);
+                reset_layer_prop(ctx, dpy);
+                ret = ctx->mMDPComp->prepare(ctx, list);
+                t = trace->pathDone(dpy, TRACE_PATH_MDPCOMP, t);
+                if(!ret) {
+                    // IF MDPcomp fails use this route
+                    VideoOverlay::prepare(ctx, list, dpy);
+                    t = trace->pathDone(dpy, TRACE_PATH_VIDEO, t);
+                    ctx->mFBUpdate[dpy]->prepare(ctx, list, 0);
+                    trace->pathDone(dpy, TRACE_PATH_FBUPDATE, t);
+                }
+                ctx->mPlan[dpy]->save(ctx, list, dpy);
             }
             ctx->mLayerCache[dpy]->updateLayerCache(list);
             // Use Copybit, when MDP comp fails
-            if(!ret && ctx->mCopyBit[dpy])
+            if(!ret && ctx->mCopyBit[dpy]) {
+                int64_t t = systemTime();
                 ctx->mCopyBit[dpy]->prepare(ctx, list, dpy);
+                ctx->mFrameTrace->pathDone(dpy, TRACE_PATH_COPYBIT, t);
+            }
         }
     }
     return 0;
 }
 
+//Sets "configured" once the display got its first frame set up, the
+//caller publishes it as the end of mExtDispConfiguring
 static int hwc_prepare_external(hwc_composer_device_1 *dev,
-        hwc_display_contents_1_t *list, int dpy) {
+        hwc_display_contents_1_t *list, int dpy, bool& configured) {
     hwc_context_t* ctx = (hwc_context_t*)(dev);
+    qdutils::IoctlStats::setDisplay(dpy);
 
     if (LIKELY(list && list->numHwLayers > 1 &&
         list->numHwLayers <= MAX_NUM_LAYERS) &&
@@ -159,14 +239,29 @@ static int hwc_prepare_external(hwc_composer_device_1 *dev,
         if(!ctx->dpyAttr[dpy].isPause) {
             hwc_layer_1_t *fbLayer = &list->hwLayers[last];
             if(fbLayer->handle) {
-                setListStats(ctx, list, dpy);
-                reset_layer_prop(ctx, dpy);
-                VideoOverlay::prepare(ctx, list, dpy);
-                ctx->mFBUpdate[dpy]->prepare(ctx, list);
+                if(ctx->mPlan[dpy]->isMatched()) {
+                    ctx->mPlan[dpy]->restore(ctx, list, dpy);
+                } else {
+                    FrameTrace *trace = ctx->mFrameTrace;
+                    int64_t t = systemTime();
+                    setListStats(ctx, list, dpy);
+                    t = trace->pathDone(dpy, TRACE_PATH_LISTSTATS, t);
+                    reset_layer_prop(ctx, dpy);
+                    VideoOverlay::prepare(ctx, list, dpy);
+                    t = trace->pathDone(dpy, TRACE_PATH_VIDEO, t);
+                    ctx->mFBUpdate[dpy]->prepare(ctx, list, 0);
+                    trace->pathDone(dpy, TRACE_PATH_FBUPDATE, t);
+                    ctx->mPlan[dpy]->save(ctx, list, dpy);
+                }
+                //Pipes are settled, primary can go ahead with its allocation
+                ctx->mOverlay->reserveDone(dpy);
                 ctx->mLayerCache[dpy]->updateLayerCache(list);
-                if(ctx->mCopyBit[dpy])
+                if(ctx->mCopyBit[dpy]) {
+                    int64_t t = systemTime();
                     ctx->mCopyBit[dpy]->prepare(ctx, list, dpy);
-                ctx->mExtDispConfiguring = false;
+                    ctx->mFrameTrace->pathDone(dpy, TRACE_PATH_COPYBIT, t);
+                }
+                configured = true;
             }
         } else {
             // External Display is in Pause state.
@@ -179,32 +274,111 @@ static int hwc_prepare_external(hwc_composer_device_1 *dev,
     return 0;
 }
 
+static int hwc_prepare_display(hwc_composer_device_1 *dev,
+        hwc_display_contents_1_t *list, int dpy, bool& extConfigured) {
+    switch(dpy) {
+        case HWC_DISPLAY_PRIMARY:
+            return hwc_prepare_primary(dev, list);
+        case HWC_DISPLAY_EXTERNAL:
+        case HWC_DISPLAY_VIRTUAL:
+            return hwc_prepare_external(dev, list, dpy, extConfigured);
+        default:
+            return -EINVAL;
+    }
+}
+
+struct PrepareJob {
+    hwc_composer_device_1 *dev;
+    int32_t numDisplays;
+    hwc_display_contents_1_t** displays;
+    //Read once the worker is done
+    bool extConfigured;
+};
+
+//Runs on the prepare worker
+static void prepare_secondary(void *data) {
+    PrepareJob *job = reinterpret_cast<PrepareJob *>(data);
+    hwc_context_t* ctx = (hwc_context_t*)(job->dev);
+    for (int32_t i = job->numDisplays; i > HWC_DISPLAY_PRIMARY; i--) {
+        hwc_prepare_display(job->dev, job->displays[i], i,
+                job->extConfigured);
+        ctx->mOverlay->reserveDone(i);
+    }
+}
+
+static bool canPrepareInParallel(hwc_context_t *ctx, size_t numDisplays) {
+    if(!ctx->mPrepareWorker || numDisplays <= HWC_DISPLAY_PRIMARY + 1)
+        return false;
+    //Primary MDP comp has to see the external config state as it is after
+    //external prepare, so hotplug frames go serially
+    if(ctx->mExtDispConfiguring)
+        return false;
+    return ctx->dpyAttr[HWC_DISPLAY_EXTERNAL].connected ||
+            ctx->dpyAttr[HWC_DISPLAY_VIRTUAL].connected;
+}
+
+//Video layers can only go on VG pipes. Keeps UI layers of any display off
+//the VG pipes each display's video will take, before the displays allocate.
+static void set_pipe_demand(hwc_context_t *ctx, size_t numDisplays,
+        hwc_display_contents_1_t** displays) {
+    for(size_t i = 0; i < numDisplays && i < MAX_DISPLAYS; i++) {
+        hwc_display_contents_1_t *list = displays[i];
+        //Displays keeping the last frame's setup hold on to their pipes
+        if(!list || list->numHwLayers <= 1 || ctx->mPlan[i]->isMatched())
+            continue;
+        //Primary tries MDP composition first, then the video path
+        int vgDemand = 0;
+        if(i == HWC_DISPLAY_PRIMARY)
+            vgDemand = ctx->mMDPComp->getVgDemand(ctx, list);
+        if(!vgDemand)
+            vgDemand = VideoOverlay::getVgDemand(ctx, list, i);
+        ctx->mOverlay->setDemand(overlay::utils::OV_MDP_PIPE_VG, i, vgDemand);
+    }
+}
+
 static int hwc_prepare(hwc_composer_device_1 *dev, size_t numDisplays,
                        hwc_display_contents_1_t** displays)
 {
     int ret = 0;
     hwc_context_t* ctx = (hwc_context_t*)(dev);
     Locker::Autolock _l(ctx->mBlankLock);
+    ctx->mFrameTrace->prepareBegin();
+    ctx->mCostModel->poll();
     reset(ctx, numDisplays, displays);
 
     ctx->mOverlay->configBegin();
-
-    for (int32_t i = numDisplays; i >= 0; i--) {
-        hwc_display_contents_1_t *list = displays[i];
-        switch(i) {
-            case HWC_DISPLAY_PRIMARY:
-                ret = hwc_prepare_primary(dev, list);
-                break;
-            case HWC_DISPLAY_EXTERNAL:
-            case HWC_DISPLAY_VIRTUAL:
-                ret = hwc_prepare_external(dev, list, i);
-                break;
-            default:
-                ret = -EINVAL;
+    set_pipe_demand(ctx, numDisplays, displays);
+
+    if(canPrepareInParallel(ctx, numDisplays)) {
+        //External and virtual go on the worker, in the serial order, while
+        //primary is prepared here. Overlay orders their pipe allocation.
+        PrepareJob job = {dev, numDisplays, displays, false};
+        int dpyMask = 0;
+        for (int32_t i = numDisplays; i > HWC_DISPLAY_PRIMARY; i--)
+            dpyMask |= (1 << i);
+        ctx->mOverlay->reserveBegin(dpyMask);
+        ctx->mPrepareWorker->post(prepare_secondary, &job);
+        bool unused = false;
+        ret = hwc_prepare_display(dev, displays[HWC_DISPLAY_PRIMARY],
+                HWC_DISPLAY_PRIMARY, unused);
+        ctx->mPrepareWorker->wait();
+        //Primary may not see it change while it prepares
+        if(job.extConfigured)
+            ctx->mExtDispConfiguring = false;
+    } else {
+        for (int32_t i = numDisplays; i >= 0; i--) {
+            bool extConfigured = false;
+            ret = hwc_prepare_display(dev, displays[i], i, extConfigured);
+            //Primary, prepared last, sees the external config done
+            if(extConfigured)
+                ctx->mExtDispConfiguring = false;
         }
     }
 
     ctx->mOverlay->configDone();
+    arm_park_timer(ctx);
+    ctx->mFrameTrace->prepareEnd(ctx, numDisplays, displays);
+    ctx->mPrepareEnd = systemTime();
     return ret;
 }
 
@@ -215,18 +389,24 @@ static int hwc_eventControl(struct hwc_composer_device_1* dev, int dpy,
     hwc_context_t* ctx = (hwc_context_t*)(dev);
     private_module_t* m = reinterpret_cast<private_module_t*>(
                 ctx->mFbDev->common.module);
+    if(dpy < 0 || dpy >= MAX_DISPLAYS)
+        return -EINVAL;
     pthread_mutex_lock(&ctx->vstate.lock);
     switch(event) {
         case HWC_EVENT_VSYNC:
-            if (ctx->vstate.enable == enable)
+            if (ctx->vstate.enable[dpy] == !!enable)
                 break;
             ret = hwc_vsync_control(ctx, dpy, enable);
             if(ret == 0) {
-                ctx->vstate.enable = !!enable;
-                pthread_cond_signal(&ctx->vstate.cond);
+                ctx->vstate.enable[dpy] = !!enable;
+                //Kick the event loop to pick up the change
+                if(ctx->vstate.wakefd[1] >= 0 &&
+                        write(ctx->vstate.wakefd[1], "w", 1) < 0)
+                    ALOGW("%s: vsync wake failed: %s", __FUNCTION__,
+                            strerror(errno));
             }
-            ALOGD_IF (VSYNC_DEBUG, "VSYNC state changed to %s",
-                      (enable)?"ENABLED":"DISABLED");
+            ALOGD_IF (VSYNC_DEBUG, "VSYNC state changed to %s for dpy %d",
+                      (enable)?"ENABLED":"DISABLED", dpy);
             break;
         default:
             ret = -EINVAL;
@@ -245,12 +425,21 @@ static int hwc_blank(struct hwc_composer_device_1* dev, int dpy, int blank)
     int ret = 0;
     ALOGD("%s: %s display: %d", __FUNCTION__,
           blank==1 ? "Blanking":"Unblanking", dpy);
+    for(int i = 0; i < MAX_DISPLAYS; i++)
+        ctx->mPlan[i]->invalidate();
+    ctx->mDamage->invalidate();
     switch(dpy) {
         case HWC_DISPLAY_PRIMARY:
             if(blank) {
                 ctx->mOverlay->configBegin();
                 ctx->mOverlay->configDone();
-                ret = ioctl(m->framebuffer->fd, FBIOBLANK, FB_BLANK_POWERDOWN);
+                //No round may follow for a while, so parked pipes go now
+                ctx->mOverlay->expireParked(true);
+                arm_park_timer(ctx);
+                ret = qdutils::devIoctl(m->framebuffer->fd, FBIOBLANK,
+                                        (void *)FB_BLANK_POWERDOWN);
+                //Screen is off, no frame waits on the file I/O
+                ctx->mCostModel->flush();
 
                 if(ctx->dpyAttr[HWC_DISPLAY_VIRTUAL].connected == true) {
                     // Surfaceflinger does not send Blank/unblank event to hwc
@@ -265,7 +454,8 @@ static int hwc_blank(struct hwc_composer_device_1* dev, int dpy, int blank)
                     }
                 }
             } else {
-                ret = ioctl(m->framebuffer->fd, FBIOBLANK, FB_BLANK_UNBLANK);
+                ret = qdutils::devIoctl(m->framebuffer->fd, FBIOBLANK,
+                                        (void *)FB_BLANK_UNBLANK);
                 if(ctx->dpyAttr[HWC_DISPLAY_VIRTUAL].connected == true) {
                     ctx->dpyAttr[HWC_DISPLAY_VIRTUAL].isActive = !blank;
                 }
@@ -273,6 +463,8 @@ static int hwc_blank(struct hwc_composer_device_1* dev, int dpy, int blank)
             break;
         case HWC_DISPLAY_EXTERNAL:
             if(blank) {
+                ctx->mOverlay->expireParked(true);
+                arm_park_timer(ctx);
                 // External post commits the changes to display
                 // Call this on blank, so that any pipe unsets gets committed
                 if (!ctx->mExtDisplay->post()) {
@@ -331,10 +523,44 @@ static int hwc_query(struct hwc_composer_device_1* dev,
 
 }
 
+//Command mode panels keep their own frame memory, so only the ROI needs to
+//be sent. The ROI is picked up by the next fb post.
+static void set_partial_update(hwc_context_t *ctx, const hwc_rect_t& roi) {
+#ifdef PARTIAL_UPDATE
+    if(ctx->mMDP.panel != MIPI_CMD_PANEL)
+        return;
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            ctx->mFbDev->common.module);
+    m->commit.roi.x = roi.left;
+    m->commit.roi.y = roi.top;
+    m->commit.roi.w = roi.right - roi.left;
+    m->commit.roi.h = roi.bottom - roi.top;
+#endif
+}
+
+//GPU composes the FB layers between prepare and the FB target's acquire
+//fence, which calibrates the GPU cost
+static void gpu_cost_sample(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    hwc_layer_1_t *fbLayer = &list->hwLayers[list->numHwLayers - 1];
+    if(list->numHwLayers <= 1 || fbLayer->acquireFenceFd < 0)
+        return;
+    FrameLoad load;
+    memset(&load, 0, sizeof(load));
+    for(uint32_t i = 0; i < list->numHwLayers - 1; i++) {
+        if(list->hwLayers[i].compositionType == HWC_FRAMEBUFFER)
+            CostModel::addLayer(load, &list->hwLayers[i]);
+    }
+    if(load.layers)
+        ctx->mCostModel->submitted(COST_PATH_GPU, load, ctx->mPrepareEnd,
+                fbLayer->acquireFenceFd);
+}
+
 static int hwc_set_primary(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
     ATRACE_CALL();
     int ret = 0;
     const int dpy = HWC_DISPLAY_PRIMARY;
+    qdutils::IoctlStats::setDisplay(dpy);
     if (LIKELY(list) && ctx->dpyAttr[dpy].isActive) {
         uint32_t last = list->numHwLayers - 1;
         hwc_layer_1_t *fbLayer = &list->hwLayers[last];
@@ -342,8 +568,11 @@ static int hwc_set_primary(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
         bool copybitDone = false;
         if(ctx->mCopyBit[dpy])
             copybitDone = ctx->mCopyBit[dpy]->draw(ctx, list, dpy, &fd);
+        if(!copybitDone)
+            gpu_cost_sample(ctx, list);
         if(list->numHwLayers > 1)
             hwc_sync(ctx, list, dpy, fd);
+        ctx->mOverlay->frameBegin(dpy);
         if (!VideoOverlay::draw(ctx, list, dpy)) {
             ALOGE("%s: VideoOverlay::draw fail!", __FUNCTION__);
             ret = -1;
@@ -370,6 +599,14 @@ static int hwc_set_primary(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
                 }
             }
         }
+        //A failed frame leaves its pipes on the last good buffers, the FB
+        //target is posted all the same
+        if (!ctx->mOverlay->frameCommit(dpy)) {
+            ALOGE("%s: Overlay frame commit fail!", __FUNCTION__);
+            ret = -1;
+        }
+        if(list->numHwLayers > 1)
+            set_partial_update(ctx, ctx->mDamage->update(ctx, list, dpy));
         if (ctx->mFbDev->post(ctx->mFbDev, fbLayer->handle)) {
             ALOGE("%s: ctx->mFbDev->post fail!", __FUNCTION__);
             ret = -1;
@@ -386,6 +623,7 @@ static int hwc_set_external(hwc_context_t *ctx,
     ATRACE_CALL();
     int ret = 0;
     Locker::Autolock _l(ctx->mExtSetLock);
+    qdutils::IoctlStats::setDisplay(dpy);
 
     if (LIKELY(list) && ctx->dpyAttr[dpy].isActive &&
         !ctx->dpyAttr[dpy].isPause &&
@@ -400,6 +638,7 @@ static int hwc_set_external(hwc_context_t *ctx,
         if(list->numHwLayers > 1)
             hwc_sync(ctx, list, dpy, fd);
 
+        ctx->mOverlay->frameBegin(dpy);
         if (!VideoOverlay::draw(ctx, list, dpy)) {
             ALOGE("%s: VideoOverlay::draw fail!", __FUNCTION__);
             ret = -1;
@@ -420,6 +659,10 @@ static int hwc_set_external(hwc_context_t *ctx,
                 ret = -1;
             }
         }
+        if (!ctx->mOverlay->frameCommit(dpy)) {
+            ALOGE("%s: Overlay frame commit fail!", __FUNCTION__);
+            ret = -1;
+        }
         if (!ctx->mExtDisplay->post()) {
             ALOGE("%s: ctx->mExtDisplay->post fail!", __FUNCTION__);
             ret = -1;
@@ -437,6 +680,7 @@ static int hwc_set(hwc_composer_device_1 *dev,
     int ret = 0;
     hwc_context_t* ctx = (hwc_context_t*)(dev);
     Locker::Autolock _l(ctx->mBlankLock);
+    ctx->mFrameTrace->setBegin();
     for (uint32_t i = 0; i <= numDisplays; i++) {
         hwc_display_contents_1_t* list = displays[i];
         switch(i) {
@@ -455,6 +699,7 @@ static int hwc_set(hwc_composer_device_1 *dev,
                 ret = -EINVAL;
         }
     }
+    ctx->mFrameTrace->setEnd(ctx, numDisplays, displays);
     return ret;
 }
 
@@ -548,6 +793,17 @@ void hwc_dump(struct hwc_composer_device_1* dev, char *buff, int buff_len)
     ctx->mMDPComp->dump(aBuf);
     if (ctx->mCopyBit[HWC_DISPLAY_PRIMARY])
         ctx->mCopyBit[HWC_DISPLAY_PRIMARY]->dump(aBuf);
+    ctx->mFrameTrace->dump(aBuf);
+    qdutils::IoctlStats::dump(aBuf);
+    for(int dpy = 0; dpy < MAX_DISPLAYS; dpy++) {
+        ctx->mPlan[dpy]->dump(aBuf, dpy);
+        ctx->mFrameArena[dpy]->dump(aBuf, dpy);
+    }
+    ctx->mDamage->dump(aBuf, HWC_DISPLAY_PRIMARY);
+    for(int dpy = 0; dpy < MAX_DISPLAYS; dpy++)
+        ctx->mVsyncModel[dpy]->dump(aBuf, dpy);
+    ctx->mEventLoop->dump(aBuf);
+    ctx->mCostModel->dump(aBuf);
     char ovDump[2048] = {'\0'};
     ctx->mOverlay->getDump(ovDump, 2048);
     dumpsys_log(aBuf, ovDump);
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Times the composition decision paths of the primary on synthetic lists,
+// against the fake MDP backend, and reports the pipes each list ends up
+// with. Meant to catch CPU regressions of the composer thread.
+//   hwc_bench [-c <fake config>] [-n <frames>] [-s <scenario>] [-r]
+// Lists report a geometry change on each frame, so that every frame goes
+// through the decision paths; -r keeps the geometry, to time the reuse of
+// the last frame's plan instead. The path times are the FrameTrace ones.
+
+#define HWC_BENCH_DEBUG 0
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cutils/properties.h>
+#include <utils/Timers.h>
+#include <ioctl_backend.h>
+#include "hwc_utils.h"
+#include "hwc_trace.h"
+#include "hwc_fake.h"
+
+using namespace qhwc;
+
+#define BENCH_DEFAULT_FRAMES 1000
+#define BENCH_WARMUP_FRAMES 10
+
+struct Scenario {
+    const char *name;
+    int rgbLayers;  //the first is full screen and opaque
+    int yuvLayers;
+    bool scaled;    //sources 1.5x their destination
+    bool rotated;   //video turned 90 degrees
+    int skipLayers; //topmost RGB layers marked skip
+    bool secure;    //video in secure buffers
+};
+
+static const Scenario sScenarios[] = {
+    { "ui-2",         2,  0, false, false, 0, false },
+    { "ui-4",         4,  0, false, false, 0, false },
+    { "ui-8",         8,  0, false, false, 0, false },
+    { "ui-16",        16, 0, false, false, 0, false },
+    { "ui-4-scaled",  4,  0, true,  false, 0, false },
+    { "ui-4-skip",    4,  0, false, false, 1, false },
+    { "video",        1,  1, false, false, 0, false },
+    { "video-scaled", 1,  1, true,  false, 0, false },
+    { "video-rot",    1,  1, false, true,  0, false },
+    { "video-secure", 1,  1, false, false, 0, true  },
+    { "video-ui-4",   4,  1, true,  false, 0, false },
+    { "video-2",      2,  2, true,  false, 0, false },
+    { "video-skip",   3,  1, false, false, 1, false },
+    { "max",          30, 1, true,  false, 0, false },
+};
+
+static const char* const sPathName[] = {
+    "liststats", "mdpcomp", "video", "fbupdate", "copybit"
+};
+
+// Fills a layer of a synthetic list. Buffers alternate between two ids per
+// layer, as a double buffered surface would
+static void setLayer(FakeDevice& fake, hwc_layer_1_t *layer, uint32_t id,
+        int format, int bufferType, int flags, int srcW, int srcH,
+        const hwc_rect_t& dst, hwc_rect_t *rect) {
+    int bpp = (bufferType == BUFFER_TYPE_VIDEO) ? 2 : 4;
+    layer->handle = fake.getHandle(id, format, srcW, srcH, srcW * srcH * bpp,
+            bufferType, flags);
+    layer->compositionType = HWC_FRAMEBUFFER;
+    layer->hints = 0;
+    layer->flags = 0;
+    layer->transform = 0;
+    layer->blending = HWC_BLENDING_PREMULT;
+    hwc_rect_t crop = {0, 0, srcW, srcH};
+    layer->sourceCrop = crop;
+    layer->displayFrame = dst;
+    *rect = dst;
+    layer->visibleRegionScreen.numRects = 1;
+    layer->visibleRegionScreen.rects = rect;
+    layer->acquireFenceFd = -1;
+    layer->releaseFenceFd = -1;
+}
+
+static void buildList(FakeDevice& fake, const Scenario& s, uint32_t frame,
+        bool geometry, hwc_display_contents_1_t *list, hwc_rect_t *rects) {
+    hwc_context_t *ctx = fake.getContext();
+    const int xres = ctx->dpyAttr[HWC_DISPLAY_PRIMARY].xres;
+    const int yres = ctx->dpyAttr[HWC_DISPLAY_PRIMARY].yres;
+    const uint32_t buf = frame & 1;
+    int n = 0;
+
+    list->retireFenceFd = -1;
+    list->flags = geometry ? HWC_GEOMETRY_CHANGED : 0;
+
+    //Full screen opaque app, then bars and dialogs in strips over it
+    hwc_rect_t full = {0, 0, xres, yres};
+    for(int i = 0; i < s.rgbLayers; i++, n++) {
+        hwc_rect_t dst = full;
+        if(i) {
+            int h = yres / (s.rgbLayers + 1);
+            dst.top = i * h;
+            dst.bottom = dst.top + h;
+        }
+        int w = dst.right - dst.left, h = dst.bottom - dst.top;
+        if(s.scaled && i) {
+            w = w * 3 / 2;
+            h = h * 3 / 2;
+        }
+        setLayer(fake, &list->hwLayers[n], n * 2 + buf + 1,
+                HAL_PIXEL_FORMAT_RGBA_8888, BUFFER_TYPE_UI, 0, w, h, dst,
+                &rects[n]);
+        if(!i)
+            list->hwLayers[n].blending = HWC_BLENDING_NONE;
+        if(i >= s.rgbLayers - s.skipLayers)
+            list->hwLayers[n].flags |= HWC_SKIP_LAYER;
+    }
+
+    //16:9 video across the width, stacked from the middle down
+    for(int i = 0; i < s.yuvLayers; i++, n++) {
+        int h = xres * 9 / 16;
+        hwc_rect_t dst = {0, (yres - h) / 2 + i * h / 2, xres, 0};
+        dst.bottom = min(dst.top + h, yres);
+        int w = dst.right - dst.left;
+        h = dst.bottom - dst.top;
+        if(s.scaled) {
+            w = w * 3 / 2;
+            h = h * 3 / 2;
+        }
+        if(s.rotated) {
+            int t = w;
+            w = h;
+            h = t;
+        }
+        int flags = s.secure ? private_handle_t::PRIV_FLAGS_SECURE_BUFFER : 0;
+        setLayer(fake, &list->hwLayers[n], n * 2 + buf + 1,
+                HAL_PIXEL_FORMAT_YCbCr_420_SP, BUFFER_TYPE_VIDEO, flags,
+                ALIGN_TO(w, 2), ALIGN_TO(h, 2), dst, &rects[n]);
+        list->hwLayers[n].blending = HWC_BLENDING_NONE;
+        if(s.rotated)
+            list->hwLayers[n].transform = HWC_TRANSFORM_ROT_90;
+    }
+
+    //FB target, triple buffered
+    setLayer(fake, &list->hwLayers[n], 1000 + frame % 3,
+            HAL_PIXEL_FORMAT_RGBA_8888, BUFFER_TYPE_UI,
+            private_handle_t::PRIV_FLAGS_FRAMEBUFFER, xres, yres, full,
+            &rects[n]);
+    list->hwLayers[n].compositionType = HWC_FRAMEBUFFER_TARGET;
+    n++;
+    list->numHwLayers = n;
+}
+
+static void closeFences(hwc_display_contents_1_t *list) {
+    for(uint32_t i = 0; i < list->numHwLayers; i++) {
+        if(list->hwLayers[i].releaseFenceFd >= 0)
+            close(list->hwLayers[i].releaseFenceFd);
+        list->hwLayers[i].releaseFenceFd = -1;
+    }
+    if(list->retireFenceFd >= 0)
+        close(list->retireFenceFd);
+    list->retireFenceFd = -1;
+}
+
+static void run(FakeDevice& fake, const Scenario& s, uint32_t frames,
+        bool reuse) {
+    hwc_composer_device_1_t *dev = fake.getDevice();
+    hwc_context_t *ctx = fake.getContext();
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    hwc_display_contents_1_t *list = (hwc_display_contents_1_t *)calloc(1,
+            sizeof(hwc_display_contents_1_t) +
+            MAX_NUM_LAYERS * sizeof(hwc_layer_1_t));
+    hwc_rect_t rects[MAX_NUM_LAYERS];
+    hwc_display_contents_1_t *displays[MAX_DISPLAYS] = { list };
+
+    int64_t prepareNs = 0, setNs = 0;
+    uint64_t pipes = 0;
+    uint32_t strategyCount[HWC_TRACE_NUM_STRATEGIES];
+    memset(strategyCount, 0, sizeof(strategyCount));
+    for(uint32_t f = 0; f < BENCH_WARMUP_FRAMES + frames; f++) {
+        if(f == BENCH_WARMUP_FRAMES)
+            ctx->mFrameTrace->resetStats();
+        buildList(fake, s, f, !reuse || !f, list, rects);
+        nsecs_t start = systemTime();
+        dev->prepare(dev, HWC_NUM_DISPLAY_TYPES, displays);
+        nsecs_t prepared = systemTime();
+        dev->set(dev, HWC_NUM_DISPLAY_TYPES, displays);
+        nsecs_t done = systemTime();
+        closeFences(list);
+        if(f < BENCH_WARMUP_FRAMES)
+            continue;
+
+        prepareNs += prepared - start;
+        setNs += done - prepared;
+        pipes += ctx->mFrameTrace->getLastPipes(dpy);
+        uint32_t strategy = ctx->mFrameTrace->getLastStrategy(dpy);
+        for(int i = 0; i < HWC_TRACE_NUM_STRATEGIES; i++) {
+            if(strategy & (1 << i))
+                strategyCount[i]++;
+        }
+    }
+
+    printf("%-13s %6u %9lld %9lld", s.name, (unsigned)list->numHwLayers,
+            prepareNs / frames, setNs / frames);
+    for(int i = 0; i < TRACE_PATH_MAX; i++) {
+        uint32_t count;
+        int64_t totalNs;
+        ctx->mFrameTrace->getPathStats(dpy, i, count, totalNs);
+        printf(" %9lld", count ? totalNs / count : 0LL);
+    }
+    const int numPipes = fake.getBackend()->getNumPipes();
+    printf("  %2llu.%02llu/%d ", pipes / frames, pipes * 100 / frames % 100,
+            numPipes);
+    for(int i = 0; i < HWC_TRACE_NUM_STRATEGIES; i++) {
+        if(strategyCount[i])
+            printf(" %s=%u%%", FrameTrace::getStrategyName(i),
+                    strategyCount[i] * 100 / frames);
+    }
+    printf("\n");
+    free(list);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-c <fake config>] [-n <frames>] "
+            "[-s <scenario>] [-r]\nScenarios:", name);
+    for(size_t i = 0; i < sizeof(sScenarios) / sizeof(sScenarios[0]); i++)
+        fprintf(stderr, " %s", sScenarios[i].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+    const char *config = "";
+    const char *only = NULL;
+    uint32_t frames = BENCH_DEFAULT_FRAMES;
+    bool reuse = false;
+    int opt;
+    while((opt = getopt(argc, argv, "c:n:s:r")) != -1) {
+        switch(opt) {
+            case 'c':
+                config = optarg;
+                break;
+            case 'n':
+                frames = atoi(optarg);
+                break;
+            case 's':
+                only = optarg;
+                break;
+            case 'r':
+                reuse = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if(optind != argc || !frames) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    //The HAL in the tool would record the benchmark's frames
+    char property[PROPERTY_VALUE_MAX];
+    if(property_get("debug.hwc.trace", property, NULL) > 0 &&
+            atoi(property) == 1) {
+        fprintf(stderr, "Clear debug.hwc.trace before benchmarking\n");
+        return 1;
+    }
+
+    FakeDevice fake;
+    if(!fake.open(config)) {
+        fprintf(stderr, "Unable to open the composer on fake%s\n", config);
+        return 1;
+    }
+
+    printf("%u frames per scenario, ns per frame%s\n", frames,
+            reuse ? ", geometry kept" : "");
+    printf("%-13s %6s %9s %9s", "scenario", "layers", "prepare", "set");
+    for(int i = 0; i < TRACE_PATH_MAX; i++)
+        printf(" %9s", sPathName[i]);
+    printf("  pipes     strategy\n");
+    int ran = 0;
+    for(size_t i = 0; i < sizeof(sScenarios) / sizeof(sScenarios[0]); i++) {
+        if(only && strcmp(only, sScenarios[i].name))
+            continue;
+        run(fake, sScenarios[i], frames, reuse);
+        ran++;
+    }
+    if(!ran) {
+        usage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
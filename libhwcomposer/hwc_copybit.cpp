@@ -21,9 +21,11 @@
 #define DEBUG_COPYBIT 0
 #include <copybit.h>
 #include <utils/Timers.h>
+#include <cutils/properties.h>
 #include "hwc_copybit.h"
 #include "comptype.h"
 #include "gr.h"
+#include "scratch_pool.h"
 
 namespace qhwc {
 
@@ -33,6 +35,14 @@ struct range {
 };
 struct region_iterator : public copybit_region_t {
 
+    region_iterator() {
+        mRegion.numRects = 0;
+        mRegion.rects = NULL;
+        r.end = 0;
+        r.current = 0;
+        this->next = iterate;
+    }
+
     region_iterator(hwc_region_t region) {
         mRegion = region;
         r.end = region.numRects;
@@ -93,16 +103,17 @@ bool CopyBit::canUseCopybitForRGB(hwc_context_t *ctx,
 
     if (compositionType & qdutils::COMPOSITION_TYPE_DYN) {
         // DYN Composition:
-        // use copybit, if (TotalRGBRenderArea < 2 * FB Area)
-        // this is done based on perf inputs in ICS
-        // TODO: Above condition needs to be re-evaluated in JB
-        int fbWidth =  ctx->dpyAttr[dpy].xres;
-        int fbHeight =  ctx->dpyAttr[dpy].yres;
-        unsigned int fbArea = (fbWidth * fbHeight);
-        unsigned int renderArea = getRGBRenderingArea(list);
-            ALOGD_IF (DEBUG_COPYBIT, "%s:renderArea %u, fbArea %u",
-                                  __FUNCTION__, renderArea, fbArea);
-        if (renderArea <= (2 * fbArea)) {
+        // use copybit if it is predicted to compose the RGB layers no
+        // slower than GPU would
+        FrameLoad load;
+        getRGBLoad(list, load);
+        CostModel *cost = ctx->mCostModel;
+        nsecs_t copybitTime = cost->predict(getCostPath(), load);
+        nsecs_t gpuTime = cost->predict(COST_PATH_GPU, load);
+        ALOGD_IF (DEBUG_COPYBIT, "%s: layers %u copybit %lld us, gpu %lld us",
+                  __FUNCTION__, load.layers, ns2us(copybitTime),
+                  ns2us(gpuTime));
+        if (copybitTime <= gpuTime) {
             return true;
         }
     } else if ((compositionType & qdutils::COMPOSITION_TYPE_MDP)) {
@@ -115,21 +126,24 @@ bool CopyBit::canUseCopybitForRGB(hwc_context_t *ctx,
     return false;
 }
 
-unsigned int CopyBit::getRGBRenderingArea
-                                    (const hwc_display_contents_1_t *list) {
-    //Calculates total rendering area for RGB layers
-    unsigned int renderArea = 0;
-    unsigned int w=0, h=0;
+void CopyBit::getRGBLoad(const hwc_display_contents_1_t *list,
+                         FrameLoad& load) {
+    //Sums up what the RGB layers ask of the composition engine
+    memset(&load, 0, sizeof(load));
     for (unsigned int i=0; i<list->numHwLayers; i++) {
          private_handle_t *hnd = (private_handle_t *)list->hwLayers[i].handle;
-         if (hnd) {
-             if (BUFFER_TYPE_UI == hnd->bufferType) {
-                 getLayerResolution(&list->hwLayers[i], w, h);
-                 renderArea += (w*h);
-             }
+         if (hnd && BUFFER_TYPE_UI == hnd->bufferType &&
+             list->hwLayers[i].compositionType != HWC_FRAMEBUFFER_TARGET) {
+             CostModel::addLayer(load, &list->hwLayers[i]);
          }
     }
-    return renderArea;
+}
+
+int CopyBit::getCostPath() {
+    int compositionType = qdutils::QCCompositionType::
+                                    getInstance().getCompositionType();
+    return (compositionType & qdutils::COMPOSITION_TYPE_MDP) ?
+            COST_PATH_BLIT : COST_PATH_C2D;
 }
 
 bool CopyBit::prepare(hwc_context_t *ctx, hwc_display_contents_1_t *list,
@@ -174,9 +188,13 @@ bool CopyBit::prepare(hwc_context_t *ctx, hwc_display_contents_1_t *list,
                                      fbHnd->format);
         if (ret < 0) {
             return false;
-        } else {
-            mCurRenderBufferIndex = (mCurRenderBufferIndex + 1) %
-                NUM_RENDER_BUFFERS;
+        }
+        //Rather than stall the composer on the display, let GPU compose
+        if (!nextRenderBuffer()) {
+            ALOGD_IF(DEBUG_COPYBIT, "%s: no free render buffer",
+                     __FUNCTION__);
+            mBusyFallbacks++;
+            return false;
         }
     }
 
@@ -218,12 +236,13 @@ bool CopyBit::draw(hwc_context_t *ctx, hwc_display_contents_1_t *list,
         return false;
     }
 
-    //Wait for the previous frame to complete before rendering onto it
-    if(mRelFd[0] >=0) {
-        sync_wait(mRelFd[0], 1000);
-        close(mRelFd[0]);
-        mRelFd[0] = -1;
-    }
+    //The whole frame goes to copybit in one batch
+    copybit_layer_t blits[MAX_NUM_LAYERS];
+    region_iterator regions[MAX_NUM_LAYERS];
+    int numBlits = 0;
+    FrameLoad load;
+    memset(&load, 0, sizeof(load));
+
     // numAppLayers-1, as we iterate from 0th layer index with HWC_COPYBIT flag
     for (int i = 0; i <= (ctx->listStats[dpy].numAppLayers-1); i++) {
         hwc_layer_1_t *layer = &list->hwLayers[i];
@@ -242,24 +261,42 @@ bool CopyBit::draw(hwc_context_t *ctx, hwc_display_contents_1_t *list,
             close(list->hwLayers[i].acquireFenceFd);
             list->hwLayers[i].acquireFenceFd = -1;
         }
-        retVal = drawLayerUsingCopybit(ctx, &(list->hwLayers[i]),
-                                                    renderBuffer, dpy);
+        retVal = prepareLayerBlit(ctx, layer, renderBuffer, dpy,
+                                  blits[numBlits]);
         copybitLayerCount++;
         if(retVal < 0) {
-            ALOGE("%s : drawLayerUsingCopybit failed", __FUNCTION__);
+            ALOGE("%s : prepareLayerBlit failed", __FUNCTION__);
+            continue;
         }
+        regions[numBlits] = region_iterator(layer->visibleRegionScreen);
+        blits[numBlits].region = &regions[numBlits];
+        numBlits++;
+        CostModel::addLayer(load, layer);
     }
 
+    nsecs_t start = systemTime();
+    if (numBlits && submitBlits(renderBuffer, blits, numBlits) < 0)
+        ALOGE("%s: copybit stretch failed", __FUNCTION__);
+
     if (copybitLayerCount) {
         copybit_device_t *copybit = getCopyBitDevice();
         // Async mode
         copybit->flush_get_fence(copybit, fd);
+        //Calibrates the cost model once the blits are done
+        if (numBlits)
+            ctx->mCostModel->submitted(getCostPath(), load, start, *fd);
     }
+    //Scratch buffers are free again once the blits are done
+    for (int i = 0; i < mNumScratch; i++)
+        gralloc::ScratchPool::getInstance()->put(mScratch[i],
+                                                 *fd >= 0 ? dup(*fd) : -1);
+    mNumScratch = 0;
     return true;
 }
 
-int  CopyBit::drawLayerUsingCopybit(hwc_context_t *dev, hwc_layer_1_t *layer,
-                                     private_handle_t *renderBuffer, int dpy)
+int  CopyBit::prepareLayerBlit(hwc_context_t *dev, hwc_layer_1_t *layer,
+                                private_handle_t *renderBuffer, int dpy,
+                                copybit_layer_t& blit)
 {
     hwc_context_t* ctx = (hwc_context_t*)(dev);
     int err = 0;
@@ -391,7 +428,9 @@ int  CopyBit::drawLayerUsingCopybit(hwc_context_t *dev, hwc_layer_1_t *layer,
 
        int usage = GRALLOC_USAGE_PRIVATE_IOMMU_HEAP | GRALLOC_USAGE_PRIVATE_MM_HEAP;
 
-       if (0 == alloc_buffer(&tmpHnd, tmp_w, tmp_h, fbHandle->format, usage)){
+       if (mNumScratch < MAX_NUM_LAYERS &&
+           0 == gralloc::ScratchPool::getInstance()->get(&tmpHnd, tmp_w,
+                                      tmp_h, fbHandle->format, usage)){
             copybit_image_t tmp_dst;
             copybit_rect_t tmp_rect;
             tmp_dst.w = tmp_w;
@@ -416,45 +455,68 @@ int  CopyBit::drawLayerUsingCopybit(hwc_context_t *dev, hwc_layer_1_t *layer,
             if(err < 0){
                 ALOGE("%s:%d::tmp copybit stretch failed",__FUNCTION__,
                                                              __LINE__);
-                if(tmpHnd)
-                    free_buffer(tmpHnd);
+                gralloc::ScratchPool::getInstance()->put(tmpHnd, -1);
                 return err;
             }
+            //Returned to the pool with the fence of the frame
+            mScratch[mNumScratch++] = tmpHnd;
             // copy new src and src rect crop
             src = tmp_dst;
             srcRect = tmp_rect;
       } else
           ALOGE("%s: alloc failed!", __FUNCTION__);
     }
-    // Copybit region
-    hwc_region_t region = layer->visibleRegionScreen;
-    region_iterator copybitRegion(region);
-
-    copybit->set_parameter(copybit, COPYBIT_FRAMEBUFFER_WIDTH,
-                                          renderBuffer->width);
-    copybit->set_parameter(copybit, COPYBIT_FRAMEBUFFER_HEIGHT,
-                                          renderBuffer->height);
-    copybit->set_parameter(copybit, COPYBIT_TRANSFORM,
-                                              layer->transform);
+    blit.src = src;
+    blit.src_rect = srcRect;
+    blit.dst_rect = dstRect;
+    blit.transform = layer->transform;
     //TODO: once, we are able to read layer alpha, update this
-    copybit->set_parameter(copybit, COPYBIT_PLANE_ALPHA, 255);
-    copybit->set_parameter(copybit, COPYBIT_BLEND_MODE,
-                                              layer->blending);
-    copybit->set_parameter(copybit, COPYBIT_DITHER,
-                             (dst.format == HAL_PIXEL_FORMAT_RGB_565)?
-                                             COPYBIT_ENABLE : COPYBIT_DISABLE);
-    copybit->set_parameter(copybit, COPYBIT_BLIT_TO_FRAMEBUFFER,
-                                                COPYBIT_ENABLE);
-    err = copybit->stretch(copybit, &dst, &src, &dstRect, &srcRect,
-                                                   &copybitRegion);
-    copybit->set_parameter(copybit, COPYBIT_BLIT_TO_FRAMEBUFFER,
-                                               COPYBIT_DISABLE);
-
-    if(tmpHnd)
-        free_buffer(tmpHnd);
-
-    if(err < 0)
-        ALOGE("%s: copybit stretch failed",__FUNCTION__);
+    blit.alpha = 255;
+    blit.blend_mode = layer->blending;
+    blit.dither = (dst.format == HAL_PIXEL_FORMAT_RGB_565) ?
+                                        COPYBIT_ENABLE : COPYBIT_DISABLE;
+    return 0;
+}
+
+int CopyBit::submitBlits(private_handle_t *renderBuffer,
+                         const copybit_layer_t *blits, int count)
+{
+    copybit_device_t *copybit = mEngine;
+    copybit_target_t target;
+    target.image.w = ALIGN(renderBuffer->width,32);
+    target.image.h = renderBuffer->height;
+    target.image.format = renderBuffer->format;
+    target.image.base = (void *)renderBuffer->base;
+    target.image.handle = (native_handle_t *)renderBuffer;
+    target.image.horiz_padding = 0;
+    target.image.vert_padding = 0;
+    target.fb_width = renderBuffer->width;
+    target.fb_height = renderBuffer->height;
+    target.blit_to_fb = COPYBIT_ENABLE;
+
+    if (copybit->stretch_batch)
+        return copybit->stretch_batch(copybit, &target, blits, count);
+
+    //Module without batches, state and stretch per layer
+    int err = 0;
+    for (int i = 0; err >= 0 && i < count; i++) {
+        const copybit_layer_t& blit = blits[i];
+        //Each stretch resets the FB size, which rotated targets need
+        copybit->set_parameter(copybit, COPYBIT_FRAMEBUFFER_WIDTH,
+                                              target.fb_width);
+        copybit->set_parameter(copybit, COPYBIT_FRAMEBUFFER_HEIGHT,
+                                              target.fb_height);
+        copybit->set_parameter(copybit, COPYBIT_TRANSFORM, blit.transform);
+        copybit->set_parameter(copybit, COPYBIT_PLANE_ALPHA, blit.alpha);
+        copybit->set_parameter(copybit, COPYBIT_BLEND_MODE, blit.blend_mode);
+        copybit->set_parameter(copybit, COPYBIT_DITHER, blit.dither);
+        copybit->set_parameter(copybit, COPYBIT_BLIT_TO_FRAMEBUFFER,
+                                                    COPYBIT_ENABLE);
+        err = copybit->stretch(copybit, &target.image, &blit.src,
+                               &blit.dst_rect, &blit.src_rect, blit.region);
+        copybit->set_parameter(copybit, COPYBIT_BLIT_TO_FRAMEBUFFER,
+                                                   COPYBIT_DISABLE);
+    }
     return err;
 }
 
@@ -484,7 +546,7 @@ bool CopyBit::validateParams(hwc_context_t *ctx,
 int CopyBit::allocRenderBuffers(int w, int h, int f)
 {
     int ret = 0;
-    for (int i = 0; i < NUM_RENDER_BUFFERS; i++) {
+    for (int i = 0; i < mNumRenderBuffers; i++) {
         if (mRenderBuffer[i] == NULL) {
             ret = alloc_buffer(&mRenderBuffer[i],
                                w, h, f,
@@ -501,12 +563,33 @@ int CopyBit::allocRenderBuffers(int w, int h, int f)
 
 void CopyBit::freeRenderBuffers()
 {
-    for (int i = 0; i < NUM_RENDER_BUFFERS; i++) {
+    for (int i = 0; i < mNumRenderBuffers; i++) {
         if(mRenderBuffer[i]) {
             free_buffer(mRenderBuffer[i]);
             mRenderBuffer[i] = NULL;
         }
+        if(mRelFd[i] >= 0) {
+            close(mRelFd[i]);
+            mRelFd[i] = -1;
+        }
+    }
+}
+
+bool CopyBit::nextRenderBuffer()
+{
+    for (int n = 1; n <= mNumRenderBuffers; n++) {
+        int i = (mCurRenderBufferIndex + n) % mNumRenderBuffers;
+        if(mRelFd[i] >= 0) {
+            //Zero timeout only polls the fence
+            if(sync_wait(mRelFd[i], 0) < 0)
+                continue;
+            close(mRelFd[i]);
+            mRelFd[i] = -1;
+        }
+        mCurRenderBufferIndex = i;
+        return true;
     }
+    return false;
 }
 
 private_handle_t * CopyBit::getCurrentRenderBuffer() {
@@ -514,15 +597,22 @@ private_handle_t * CopyBit::getCurrentRenderBuffer() {
 }
 
 void CopyBit::setReleaseFd(int fd) {
-    if(mRelFd[0] >=0)
-        close(mRelFd[0]);
-    mRelFd[0] = mRelFd[1];
-    mRelFd[1] = dup(fd);
+    //Only the buffer rendered this frame is on screen
+    if(!mCopyBitDraw || fd < 0)
+        return;
+    int i = mCurRenderBufferIndex;
+    if(mRelFd[i] >= 0)
+        close(mRelFd[i]);
+    mRelFd[i] = dup(fd);
 }
 
 void CopyBit::dump(android::String8& buf)
 {
-    dumpsys_log(buf, "  mCopyBitDraw=%d\n", mCopyBitDraw);
+    dumpsys_log(buf, "  mCopyBitDraw=%d renderBuffers=%d busyFallbacks=%u\n",
+            mCopyBitDraw, mNumRenderBuffers, mBusyFallbacks);
+    char scratchDump[256] = {'\0'};
+    gralloc::ScratchPool::getInstance()->getDump(scratchDump, sizeof(scratchDump));
+    dumpsys_log(buf, scratchDump);
 }
 
 struct copybit_device_t* CopyBit::getCopyBitDevice() {
@@ -530,12 +620,18 @@ struct copybit_device_t* CopyBit::getCopyBitDevice() {
 }
 
 CopyBit::CopyBit():mIsModeOn(false), mCopyBitDraw(false),
-    mCurRenderBufferIndex(0){
+    mCurRenderBufferIndex(0), mNumRenderBuffers(NUM_RENDER_BUFFERS),
+    mBusyFallbacks(0), mNumScratch(0){
     hw_module_t const *module;
-    for (int i = 0; i < NUM_RENDER_BUFFERS; i++)
+    char value[PROPERTY_VALUE_MAX];
+    if(property_get("debug.hwc.copybit.buffers", value, NULL) > 0) {
+        //Two is the least that lets one be rendered while one is shown
+        mNumRenderBuffers = max(2, min(atoi(value), MAX_RENDER_BUFFERS));
+    }
+    for (int i = 0; i < MAX_RENDER_BUFFERS; i++) {
         mRenderBuffer[i] = NULL;
-    mRelFd[0] = -1;
-    mRelFd[1] = -1;
+        mRelFd[i] = -1;
+    }
     if (hw_get_module(COPYBIT_HARDWARE_MODULE_ID, &module) == 0) {
         if(copybit_open(module, &mEngine) < 0) {
             ALOGE("FATAL ERROR: copybit open failed.");
@@ -548,10 +644,6 @@ CopyBit::CopyBit():mIsModeOn(false), mCopyBitDraw(false),
 CopyBit::~CopyBit()
 {
     freeRenderBuffers();
-    if(mRelFd[0] >=0)
-        close(mRelFd[0]);
-    if(mRelFd[1] >=0)
-        close(mRelFd[1]);
     if(mEngine)
     {
         copybit_close(mEngine);
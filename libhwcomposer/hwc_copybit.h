@@ -19,9 +19,13 @@
  */
 #ifndef HWC_COPYBIT_H
 #define HWC_COPYBIT_H
+#include <copybit.h>
 #include "hwc_utils.h"
+#include "hwc_cost.h"
 
-#define NUM_RENDER_BUFFERS 2
+//Render buffers in the ring, debug.hwc.copybit.buffers overrides
+#define NUM_RENDER_BUFFERS 3
+#define MAX_RENDER_BUFFERS 6
 
 namespace qhwc {
 
@@ -50,8 +54,14 @@ private:
     // holds the copybit device
     struct copybit_device_t *mEngine;
     // Helper functions for copybit composition
-    int  drawLayerUsingCopybit(hwc_context_t *dev, hwc_layer_1_t *layer,
-                                       private_handle_t *renderBuffer, int dpy);
+    //Sets up the blit of a layer, doing the first pass of a two pass scale
+    int  prepareLayerBlit(hwc_context_t *dev, hwc_layer_1_t *layer,
+                          private_handle_t *renderBuffer, int dpy,
+                          copybit_layer_t& blit);
+    //Blits a frame's layers to the render buffer, in one batch if the
+    //copybit module supports it
+    int  submitBlits(private_handle_t *renderBuffer,
+                     const copybit_layer_t *blits, int count);
     bool canUseCopybitForYUV (hwc_context_t *ctx);
     bool canUseCopybitForRGB (hwc_context_t *ctx,
                                      hwc_display_contents_1_t *list, int dpy);
@@ -62,8 +72,11 @@ private:
     // flag that indicates whether CopyBit composition is enabled for this cycle
     bool mCopyBitDraw;
 
-    unsigned int getRGBRenderingArea
-                            (const hwc_display_contents_1_t *list);
+    //Load of the RGB layers on a composition engine
+    void getRGBLoad(const hwc_display_contents_1_t *list, FrameLoad& load);
+
+    //Cost model path of the copybit engine in use
+    static int getCostPath();
 
     void getLayerResolution(const hwc_layer_1_t* layer,
                                    unsigned int &width, unsigned int& height);
@@ -72,14 +85,26 @@ private:
 
     void freeRenderBuffers();
 
-    private_handle_t* mRenderBuffer[NUM_RENDER_BUFFERS];
+    //Makes the next render buffer that the display is done with current.
+    //Returns false without blocking if all of them are still in use
+    bool nextRenderBuffer();
+
+    private_handle_t* mRenderBuffer[MAX_RENDER_BUFFERS];
 
     // Index of the current intermediate render buffer
     int mCurRenderBufferIndex;
 
-    //These are the the release FDs of the T-2 and T-1 round
-    //We wait on the T-2 fence
-    int mRelFd[2];
+    int mNumRenderBuffers;
+
+    //Release fence of each render buffer, -1 once it is free
+    int mRelFd[MAX_RENDER_BUFFERS];
+
+    //Frames that fell back to GPU as no render buffer was free
+    uint32_t mBusyFallbacks;
+
+    //Scratch buffers of two pass scaling in this frame
+    private_handle_t* mScratch[MAX_NUM_LAYERS];
+    int mNumScratch;
 };
 
 }; //namespace qhwc
@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define HWC_COST_DEBUG 0
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sync/sync.h>
+#include "hwc_cost.h"
+
+namespace qhwc {
+
+static const char* const pathName[COST_PATH_MAX] = {
+    "gpu", "c2d", "blit"
+};
+
+//Until calibrated, copybit wins over GPU below about twice a WVGA frame,
+//as the old heuristic had it
+static const float defaultCoeff[COST_PATH_MAX][6] = {
+    //frame    layer     MB      Mpix     blend    scaled
+    {3000000, 100000,     0, 2000000,       0,       0}, //gpu
+    { 500000,  50000,     0, 5250000,       0,       0}, //c2d
+    { 500000,  50000,     0, 5250000,       0,       0}, //blit
+};
+
+//Time the fence signalled, 0 if not known
+static nsecs_t getSignalTime(int fence) {
+    struct sync_fence_info_data *info = sync_fence_info(fence);
+    if(!info)
+        return 0;
+    nsecs_t signalled = 0;
+    struct sync_pt_info *pt = NULL;
+    while((pt = sync_pt_info(info, pt)) != NULL) {
+        if(pt->status == 1 && (nsecs_t)pt->timestamp_ns > signalled)
+            signalled = pt->timestamp_ns;
+    }
+    sync_fence_info_free(info);
+    return signalled;
+}
+
+CostModel::CostModel() : mUnsaved(0), mSaveError(0) {
+    memcpy(mCoeff, defaultCoeff, sizeof(mCoeff));
+    memset(mStats, 0, sizeof(mStats));
+    for(int i = 0; i < COST_PATH_MAX; i++)
+        mPending[i].fence = -1;
+    property_get("debug.hwc.cost.profile", mPath,
+            "/data/misc/display/hwc_cost_profile");
+    if(load())
+        ALOGI("%s: Loaded cost profile %s", __FUNCTION__, mPath);
+}
+
+CostModel::~CostModel() {
+    for(int i = 0; i < COST_PATH_MAX; i++) {
+        if(mPending[i].fence >= 0)
+            close(mPending[i].fence);
+    }
+    if(mUnsaved)
+        save();
+}
+
+void CostModel::addLayer(FrameLoad& load, const hwc_layer_1_t *layer) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+    if(!hnd)
+        return;
+    const hwc_rect_t& crop = layer->sourceCrop;
+    const hwc_rect_t& dst = layer->displayFrame;
+    uint64_t srcArea = (uint64_t)max(0, crop.right - crop.left) *
+            max(0, crop.bottom - crop.top);
+    uint64_t dstArea = (uint64_t)max(0, dst.right - dst.left) *
+            max(0, dst.bottom - dst.top);
+    load.layers++;
+    load.fetchBytes += srcArea * getFormatBpp(hnd->format) / 8;
+    load.dstPixels += dstArea;
+    if(layer->blending != HWC_BLENDING_NONE)
+        load.blendPixels += dstArea;
+    if(srcArea != dstArea || (layer->transform & HWC_TRANSFORM_ROT_90))
+        load.scaledPixels += dstArea;
+}
+
+void CostModel::getTerms(const FrameLoad& load, float terms[]) {
+    terms[COST_FRAME] = 1.0f;
+    terms[COST_LAYER] = (float)load.layers;
+    terms[COST_BYTES] = load.fetchBytes / 1000000.0f;
+    terms[COST_PIXELS] = load.dstPixels / 1000000.0f;
+    terms[COST_BLEND] = load.blendPixels / 1000000.0f;
+    terms[COST_SCALE] = load.scaledPixels / 1000000.0f;
+}
+
+nsecs_t CostModel::predict(int path, const FrameLoad& load) const {
+    float terms[COST_NUM_TERMS];
+    getTerms(load, terms);
+    float cost = 0;
+    for(int i = 0; i < COST_NUM_TERMS; i++)
+        cost += mCoeff[path][i] * terms[i];
+    return (nsecs_t)cost;
+}
+
+void CostModel::submitted(int path, const FrameLoad& load, nsecs_t start,
+        int fence) {
+    //One frame per path in flight is enough to calibrate with
+    if(fence < 0 || mPending[path].fence >= 0)
+        return;
+    mPending[path].fence = dup(fence);
+    mPending[path].start = start;
+    mPending[path].load = load;
+    mPending[path].predicted = predict(path, load);
+}
+
+void CostModel::poll() {
+    for(int path = 0; path < COST_PATH_MAX; path++) {
+        Pending& p = mPending[path];
+        //Zero timeout only polls the fence
+        if(p.fence < 0 || sync_wait(p.fence, 0) < 0)
+            continue;
+        nsecs_t actual = getSignalTime(p.fence) - p.start;
+        close(p.fence);
+        p.fence = -1;
+        if(actual <= 0)
+            continue;
+
+        ALOGD_IF(HWC_COST_DEBUG, "%s: %s layers=%u predicted=%lld "
+                "actual=%lld us", __FUNCTION__, pathName[path],
+                p.load.layers, ns2us(p.predicted), ns2us(actual));
+        Stats& s = mStats[path];
+        s.samples++;
+        s.lastPredicted = p.predicted;
+        s.lastActual = actual;
+        s.totalError += (p.predicted > actual) ? p.predicted - actual :
+                actual - p.predicted;
+        s.totalActual += actual;
+        update(path, p.load, actual);
+    }
+}
+
+//Normalized LMS step towards the measured time
+void CostModel::update(int path, const FrameLoad& load, nsecs_t actual) {
+    float terms[COST_NUM_TERMS];
+    getTerms(load, terms);
+    float norm = 0;
+    for(int i = 0; i < COST_NUM_TERMS; i++)
+        norm += terms[i] * terms[i];
+    float error = (float)(actual - predict(path, load));
+    for(int i = 0; i < COST_NUM_TERMS; i++) {
+        mCoeff[path][i] += COST_LEARN_RATE * error * terms[i] / norm;
+        if(mCoeff[path][i] < 0)
+            mCoeff[path][i] = 0;
+    }
+    mUnsaved++;
+}
+
+void CostModel::flush() {
+    if(mUnsaved >= COST_SAVE_SAMPLES)
+        save();
+}
+
+bool CostModel::load() {
+    FILE *fp = fopen(mPath, "r");
+    if(!fp)
+        return false;
+    char line[256];
+    int loaded = 0;
+    while(fgets(line, sizeof(line), fp)) {
+        char name[16];
+        float c[COST_NUM_TERMS];
+        if(line[0] == '#' || sscanf(line, "%15s %f %f %f %f %f %f", name,
+                &c[0], &c[1], &c[2], &c[3], &c[4], &c[5]) != 7)
+            continue;
+        for(int path = 0; path < COST_PATH_MAX; path++) {
+            if(!strcmp(name, pathName[path])) {
+                memcpy(mCoeff[path], c, sizeof(c));
+                loaded++;
+            }
+        }
+    }
+    fclose(fp);
+    return loaded > 0;
+}
+
+void CostModel::save() {
+    mUnsaved = 0;
+    char tmp[PROPERTY_VALUE_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", mPath);
+    FILE *fp = fopen(tmp, "w");
+    if(!fp) {
+        int err = errno;
+        //Once per kind of failure, saves are retried on every blank
+        if(mSaveError != err)
+            ALOGE("%s: Unable to write %s err=%s", __FUNCTION__, tmp,
+                    strerror(err));
+        mSaveError = err;
+        return;
+    }
+    fprintf(fp, "# path frame layer MB Mpix blendMpix scaledMpix (ns)\n");
+    for(int path = 0; path < COST_PATH_MAX; path++) {
+        const float *c = mCoeff[path];
+        fprintf(fp, "%s %.0f %.0f %.0f %.0f %.0f %.0f\n", pathName[path],
+                c[0], c[1], c[2], c[3], c[4], c[5]);
+    }
+    int err = ferror(fp) ? EIO : 0;
+    if(fclose(fp) && !err)
+        err = errno;
+    //Never leave a half written profile behind
+    if(!err && rename(tmp, mPath) < 0)
+        err = errno;
+    if(err) {
+        unlink(tmp);
+        if(mSaveError != err)
+            ALOGE("%s: Unable to save %s err=%s", __FUNCTION__, mPath,
+                    strerror(err));
+    }
+    mSaveError = err;
+}
+
+void CostModel::dump(android::String8& buf) {
+    dumpsys_log(buf, "Cost model (%s):\n", mPath);
+    if(mSaveError)
+        dumpsys_log(buf, "  last save failed: %s\n", strerror(mSaveError));
+    for(int path = 0; path < COST_PATH_MAX; path++) {
+        const float *c = mCoeff[path];
+        const Stats& s = mStats[path];
+        dumpsys_log(buf, "  %s: frame=%.0f layer=%.0f MB=%.0f Mpix=%.0f "
+                "blend=%.0f scaled=%.0f ns\n", pathName[path], c[0], c[1],
+                c[2], c[3], c[4], c[5]);
+        if(!s.samples)
+            continue;
+        dumpsys_log(buf, "    samples=%u predicted=%lld us actual=%lld us "
+                "error=%llu%%\n", s.samples, ns2us(s.lastPredicted),
+                ns2us(s.lastActual), s.totalActual ?
+                s.totalError * 100 / s.totalActual : 0ULL);
+    }
+}
+
+}; //namespace qhwc
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HWC_COST_H
+#define HWC_COST_H
+
+#include <stdint.h>
+#include <cutils/properties.h>
+#include <utils/Timers.h>
+#include "hwc_utils.h"
+
+//Learning rate of the online calibration
+#define COST_LEARN_RATE 0.05f
+//Calibrated profile is saved, on blank, once this many samples are new
+#define COST_SAVE_SAMPLES 600
+
+namespace qhwc {
+
+// Composition paths that take time per frame. Overlay layers are fetched
+// at scanout and cost bandwidth, not composition time, so they are left to
+// MDPComp's own limits.
+enum {
+    COST_PATH_GPU = 0,
+    COST_PATH_C2D,
+    COST_PATH_BLIT,     //MDP blit (copybit on MDP)
+    COST_PATH_MAX,
+};
+
+// What a set of layers asks of a composition engine
+struct FrameLoad {
+    uint32_t layers;
+    uint64_t fetchBytes;    //source bytes read, by format bpp
+    uint64_t dstPixels;     //pixels written
+    uint64_t blendPixels;   //pixels blended with what is below them
+    uint64_t scaledPixels;  //pixels written from a scaled source
+};
+
+// Predicts the time each path takes to compose a set of layers, as a
+// linear function of the load. The coefficients start from a profile
+// (debug.hwc.cost.profile, built in defaults if absent), are calibrated
+// online against the time the engines actually took, read from their
+// fence signal timestamps, and saved back to the profile when the primary
+// display blanks, off the frame path.
+// Profile lines are "<path> <frame> <layer> <MB> <Mpix> <blend Mpix>
+// <scaled Mpix>", costs in ns, so it can also be produced offline.
+class CostModel {
+public:
+    CostModel();
+    ~CostModel();
+    /* Adds a layer to a load */
+    static void addLayer(FrameLoad& load, const hwc_layer_1_t *layer);
+    /* Predicted time for a path to compose the load */
+    nsecs_t predict(int path, const FrameLoad& load) const;
+    /* Records that a path started composing "load" at "start", done when
+     * "fence" signals. Does not take ownership of the fence */
+    void submitted(int path, const FrameLoad& load, nsecs_t start,
+            int fence);
+    /* Calibrates with the submissions whose fences signalled. Does not
+     * block */
+    void poll();
+    /* Saves the profile if enough samples are new. Does file I/O, call it
+     * off the frame path */
+    void flush();
+    void dump(android::String8& buf);
+
+private:
+    enum {
+        COST_FRAME = 0,
+        COST_LAYER,
+        COST_BYTES,
+        COST_PIXELS,
+        COST_BLEND,
+        COST_SCALE,
+        COST_NUM_TERMS,
+    };
+
+    struct Pending {
+        int fence;
+        nsecs_t start;
+        FrameLoad load;
+        nsecs_t predicted;
+    };
+
+    struct Stats {
+        uint32_t samples;
+        nsecs_t lastPredicted;
+        nsecs_t lastActual;
+        uint64_t totalError;
+        uint64_t totalActual;
+    };
+
+    static void getTerms(const FrameLoad& load, float terms[]);
+    void update(int path, const FrameLoad& load, nsecs_t actual);
+    bool load();
+    void save();
+
+    float mCoeff[COST_PATH_MAX][COST_NUM_TERMS];
+    Pending mPending[COST_PATH_MAX];
+    Stats mStats[COST_PATH_MAX];
+    char mPath[PROPERTY_VALUE_MAX];
+    uint32_t mUnsaved;
+    //errno of the last failed save, 0 if it went fine
+    int mSaveError;
+};
+
+}; //namespace qhwc
+
+#endif //HWC_COST_H
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define HWC_DAMAGE_DEBUG 0
+#include "hwc_damage.h"
+
+namespace qhwc {
+
+static inline bool isEmpty(const hwc_rect_t& r) {
+    return (r.right <= r.left) || (r.bottom <= r.top);
+}
+
+static inline bool isSameRect(const hwc_rect_t& a, const hwc_rect_t& b) {
+    return (a.left == b.left) && (a.top == b.top) &&
+            (a.right == b.right) && (a.bottom == b.bottom);
+}
+
+static hwc_rect_t getUnion(const hwc_rect_t& a, const hwc_rect_t& b) {
+    if(isEmpty(a))
+        return b;
+    if(isEmpty(b))
+        return a;
+    hwc_rect_t r;
+    r.left = min(a.left, b.left);
+    r.top = min(a.top, b.top);
+    r.right = max(a.right, b.right);
+    r.bottom = max(a.bottom, b.bottom);
+    return r;
+}
+
+static hwc_rect_t getIntersection(const hwc_rect_t& a, const hwc_rect_t& b) {
+    hwc_rect_t r;
+    r.left = max(a.left, b.left);
+    r.top = max(a.top, b.top);
+    r.right = min(a.right, b.right);
+    r.bottom = min(a.bottom, b.bottom);
+    if(isEmpty(r))
+        r.left = r.top = r.right = r.bottom = 0;
+    return r;
+}
+
+static inline uint64_t getArea(const hwc_rect_t& r) {
+    return isEmpty(r) ? 0 : (uint64_t)(r.right - r.left) * (r.bottom - r.top);
+}
+
+DamageTracker::DamageTracker() : mValid(false), mNumHwLayers(0), mFrames(0),
+        mPartialFrames(0), mLastFetched(0), mLastTransferred(0),
+        mTotalFetched(0), mTotalTransferred(0), mFullTransferred(0) {
+    memset(mLayers, 0, sizeof(mLayers));
+    memset(&mLastRoi, 0, sizeof(mLastRoi));
+}
+
+hwc_rect_t DamageTracker::getVisibleBounds(const hwc_layer_1_t *layer) {
+    hwc_rect_t bounds = {0, 0, 0, 0};
+    const hwc_region_t& region = layer->visibleRegionScreen;
+    for(size_t i = 0; i < region.numRects; i++)
+        bounds = getUnion(bounds, region.rects[i]);
+    return getIntersection(bounds, layer->displayFrame);
+}
+
+hwc_rect_t DamageTracker::update(hwc_context_t *ctx,
+        hwc_display_contents_1_t *list, int dpy) {
+    hwc_rect_t full = {0, 0, (int)ctx->dpyAttr[dpy].xres,
+            (int)ctx->dpyAttr[dpy].yres};
+    hwc_rect_t damage = {0, 0, 0, 0};
+    bool isFull = !mValid || (list->flags & HWC_GEOMETRY_CHANGED) ||
+            list->numHwLayers != mNumHwLayers ||
+            list->numHwLayers > MAX_NUM_LAYERS;
+
+    //The FB target changes with whatever GPU composed, so only the app
+    //layers are looked at
+    for(uint32_t i = 0; !isFull && i < list->numHwLayers - 1; i++) {
+        const hwc_layer_1_t *layer = &list->hwLayers[i];
+        const LayerState& last = mLayers[i];
+        if(layer->flags & HWC_SKIP_LAYER) {
+            //Nothing can be said about the content of skip layers
+            isFull = true;
+        } else if(!isSameRect(layer->displayFrame, last.displayFrame) ||
+                !isSameRect(layer->sourceCrop, last.sourceCrop) ||
+                layer->transform != last.transform ||
+                layer->blending != last.blending) {
+            damage = getUnion(damage, getUnion(layer->displayFrame,
+                    last.displayFrame));
+        } else if(layer->handle != last.handle) {
+            damage = getUnion(damage, getVisibleBounds(layer));
+        }
+    }
+
+    hwc_rect_t roi = full;
+    if(!isFull) {
+        damage = getIntersection(damage, full);
+        //If nothing changed on screen, play safe with a full update
+        if(!isEmpty(damage)) {
+            roi.top = damage.top & ~(DAMAGE_ROW_ALIGN - 1);
+            roi.bottom = min(full.bottom, ALIGN_TO(damage.bottom,
+                    DAMAGE_ROW_ALIGN));
+        }
+    }
+
+    ALOGD_IF(HWC_DAMAGE_DEBUG, "%s: dpy=%d roi=[%d,%d,%d,%d] full=%d",
+            __FUNCTION__, dpy, roi.left, roi.top, roi.right, roi.bottom,
+            isFull);
+
+    save(list);
+    account(ctx, list, dpy, roi);
+    return roi;
+}
+
+void DamageTracker::save(hwc_display_contents_1_t *list) {
+    mNumHwLayers = list->numHwLayers;
+    mValid = (mNumHwLayers <= MAX_NUM_LAYERS);
+    for(uint32_t i = 0; mValid && i < mNumHwLayers - 1; i++) {
+        const hwc_layer_1_t *layer = &list->hwLayers[i];
+        mLayers[i].handle = layer->handle;
+        mLayers[i].sourceCrop = layer->sourceCrop;
+        mLayers[i].displayFrame = layer->displayFrame;
+        mLayers[i].transform = layer->transform;
+        mLayers[i].blending = layer->blending;
+    }
+}
+
+void DamageTracker::account(hwc_context_t *ctx,
+        hwc_display_contents_1_t *list, int dpy, const hwc_rect_t& roi) {
+    uint64_t fetched = 0;
+    bool fbUsed = false;
+    LayerProp *layerProp = ctx->layerProp[dpy];
+
+    for(uint32_t i = 0; i < list->numHwLayers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        private_handle_t *hnd = (private_handle_t *)layer->handle;
+        uint32_t flags = layerProp && i < list->numHwLayers - 1 ?
+                layerProp[i].mFlags : 0;
+        bool onPipe = false;
+        if(layer->compositionType == HWC_FRAMEBUFFER_TARGET) {
+            onPipe = fbUsed;
+        } else if(layer->compositionType == HWC_OVERLAY &&
+                !(flags & HWC_COPYBIT)) {
+            //Cached layers are marked overlay but live in the FB
+            onPipe = (flags & HWC_MDPCOMP) || isYuvBuffer(hnd);
+        }
+        if(!onPipe) {
+            if(layer->compositionType != HWC_FRAMEBUFFER_TARGET)
+                fbUsed = true;
+            continue;
+        }
+        if(!hnd)
+            continue;
+
+        //MDP fetches the part of the source that lands in the ROI
+        uint64_t dstArea = getArea(layer->displayFrame);
+        if(!dstArea)
+            continue;
+        uint64_t area = getArea(getIntersection(layer->displayFrame, roi)) *
+                getArea(layer->sourceCrop) / dstArea;
+        fetched += area * getFormatBpp(hnd->format) / 8;
+    }
+
+    uint64_t transferred = getArea(roi) * PANEL_BYTES_PER_PIXEL;
+    mFullTransferred = (uint64_t)ctx->dpyAttr[dpy].xres *
+            ctx->dpyAttr[dpy].yres * PANEL_BYTES_PER_PIXEL;
+    mFrames++;
+    if(transferred < mFullTransferred)
+        mPartialFrames++;
+    mLastRoi = roi;
+    mLastFetched = fetched;
+    mLastTransferred = transferred;
+    mTotalFetched += fetched;
+    mTotalTransferred += transferred;
+}
+
+void DamageTracker::dump(android::String8& buf, int dpy) {
+    if(!mFrames)
+        return;
+    dumpsys_log(buf, "  Damage dpy=%d frames=%u partial=%u "
+            "roi=[%d,%d,%d,%d]\n", dpy, mFrames, mPartialFrames,
+            mLastRoi.left, mLastRoi.top, mLastRoi.right, mLastRoi.bottom);
+    dumpsys_log(buf, "    bytes/frame fetched last=%llu avg=%llu "
+            "transferred last=%llu avg=%llu full=%llu\n",
+            mLastFetched, mTotalFetched / mFrames, mLastTransferred,
+            mTotalTransferred / mFrames, mFullTransferred);
+}
+
+}; //namespace qhwc
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HWC_DAMAGE_H
+#define HWC_DAMAGE_H
+
+#include <stdint.h>
+#include "hwc_utils.h"
+
+//Panels take ROIs in whole pairs of rows
+#define DAMAGE_ROW_ALIGN 2
+//DSI panels are fed RGB888
+#define PANEL_BYTES_PER_PIXEL 3
+
+namespace qhwc {
+
+// Tracks what changed on screen between two frames of a display, from the
+// layer buffers, visible regions and geometry. Used to limit the update of
+// command mode panels to a region of interest (ROI), and to account the
+// bytes fetched by MDP and sent to the panel per frame.
+class DamageTracker {
+public:
+    DamageTracker();
+    /* Returns the ROI of this frame. The ROI spans full rows and is the
+     * whole display if the geometry changed or nothing is known about the
+     * last frame. Expects the list to have at least one app layer */
+    hwc_rect_t update(hwc_context_t *ctx, hwc_display_contents_1_t *list,
+            int dpy);
+    /* Forgets the last frame, so the next one is a full update */
+    void invalidate() { mValid = false; }
+    void dump(android::String8& buf, int dpy);
+
+private:
+    struct LayerState {
+        buffer_handle_t handle;
+        hwc_rect_t sourceCrop;
+        hwc_rect_t displayFrame;
+        uint32_t transform;
+        int32_t blending;
+    };
+
+    /* Union of the visible rects of a layer */
+    static hwc_rect_t getVisibleBounds(const hwc_layer_1_t *layer);
+    void save(hwc_display_contents_1_t *list);
+    void account(hwc_context_t *ctx, hwc_display_contents_1_t *list,
+            int dpy, const hwc_rect_t& roi);
+
+    bool mValid;
+    uint32_t mNumHwLayers;
+    LayerState mLayers[MAX_NUM_LAYERS];
+
+    //Stats
+    uint32_t mFrames;
+    uint32_t mPartialFrames;
+    hwc_rect_t mLastRoi;
+    uint64_t mLastFetched;
+    uint64_t mLastTransferred;
+    uint64_t mTotalFetched;
+    uint64_t mTotalTransferred;
+    uint64_t mFullTransferred; //bytes sent by a full frame
+};
+
+}; //namespace qhwc
+
+#endif //HWC_DAMAGE_H
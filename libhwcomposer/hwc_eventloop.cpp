@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define HWC_EVENTLOOP_DEBUG 0
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <cutils/log.h>
+#include <hardware/hwcomposer.h>
+#include <utils/ThreadDefs.h>
+#include "hwc_utils.h"
+#include "hwc_eventloop.h"
+
+namespace qhwc {
+
+#define HWC_EVENT_THREAD_NAME "hwcEventThread"
+
+EventLoop::EventLoop() : mEpollFd(-1), mRunning(false), mStartTime(0),
+        mWakeups(0), mEvents(0) {
+    pthread_mutex_init(&mLock, NULL);
+    memset(mSources, 0, sizeof(mSources));
+    for(int i = 0; i < MAX_EVENT_SOURCES; i++)
+        mSources[i].fd = -1;
+    mEpollFd = epoll_create(MAX_EVENT_SOURCES);
+    if(mEpollFd < 0) {
+        ALOGE("%s: epoll_create failed: %s", __FUNCTION__, strerror(errno));
+    }
+}
+
+EventLoop::~EventLoop() {
+    //The loop thread lives as long as the process, like the threads it
+    //replaced
+    pthread_mutex_destroy(&mLock);
+}
+
+bool EventLoop::start() {
+    if(mEpollFd < 0)
+        return false;
+    mStartTime = systemTime();
+    int ret = pthread_create(&mThread, NULL, threadLoop, (void*) this);
+    if (ret) {
+        ALOGE("%s: failed to create %s: %s", __FUNCTION__,
+                HWC_EVENT_THREAD_NAME, strerror(ret));
+        return false;
+    }
+    mRunning = true;
+    return true;
+}
+
+bool EventLoop::addFd(int fd, uint32_t events, Handler handler, void *data,
+        const char *name) {
+    if(fd < 0 || mEpollFd < 0)
+        return false;
+
+    pthread_mutex_lock(&mLock);
+    int index = -1;
+    for(int i = 0; i < MAX_EVENT_SOURCES; i++) {
+        if(mSources[i].fd < 0) {
+            index = i;
+            break;
+        }
+    }
+    if(index < 0) {
+        pthread_mutex_unlock(&mLock);
+        ALOGE("%s: No room for %s", __FUNCTION__, name);
+        return false;
+    }
+
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.u32 = index;
+    if(epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        pthread_mutex_unlock(&mLock);
+        ALOGE("%s: epoll_ctl failed for %s: %s", __FUNCTION__, name,
+                strerror(errno));
+        return false;
+    }
+    mSources[index].fd = fd;
+    mSources[index].handler = handler;
+    mSources[index].data = data;
+    mSources[index].name = name;
+    mSources[index].count = 0;
+    pthread_mutex_unlock(&mLock);
+    ALOGD_IF(HWC_EVENTLOOP_DEBUG, "%s: %s fd=%d", __FUNCTION__, name, fd);
+    return true;
+}
+
+void EventLoop::removeFd(int fd) {
+    pthread_mutex_lock(&mLock);
+    for(int i = 0; i < MAX_EVENT_SOURCES; i++) {
+        if(mSources[i].fd == fd) {
+            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL);
+            mSources[i].fd = -1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+void EventLoop::dispatch(uint32_t index, uint32_t events) {
+    if(index >= MAX_EVENT_SOURCES)
+        return;
+    pthread_mutex_lock(&mLock);
+    //Could have been removed by a handler earlier in this batch
+    if(mSources[index].fd < 0) {
+        pthread_mutex_unlock(&mLock);
+        return;
+    }
+    Handler handler = mSources[index].handler;
+    void *data = mSources[index].data;
+    mSources[index].count++;
+    pthread_mutex_unlock(&mLock);
+
+    handler(data, events);
+}
+
+void *EventLoop::threadLoop(void *param) {
+    EventLoop *self = reinterpret_cast<EventLoop *>(param);
+    char thread_name[64] = HWC_EVENT_THREAD_NAME;
+    prctl(PR_SET_NAME, (unsigned long) &thread_name, 0, 0, 0);
+    setpriority(PRIO_PROCESS, 0, HAL_PRIORITY_URGENT_DISPLAY +
+                android::PRIORITY_MORE_FAVORABLE);
+
+    struct epoll_event events[MAX_EVENT_SOURCES];
+    while(true) {
+        int count = epoll_wait(self->mEpollFd, events, MAX_EVENT_SOURCES, -1);
+        if(count < 0) {
+            if(errno == EINTR)
+                continue;
+            ALOGE("%s: epoll_wait failed: %s", __FUNCTION__, strerror(errno));
+            break;
+        }
+        self->mWakeups++;
+        self->mEvents += count;
+        for(int i = 0; i < count; i++)
+            self->dispatch(events[i].data.u32, events[i].events);
+    }
+    return NULL;
+}
+
+void EventLoop::dump(android::String8& buf) {
+    if(!mRunning)
+        return;
+    nsecs_t elapsed = systemTime() - mStartTime;
+    uint32_t secs = (uint32_t)(elapsed / 1000000000LL);
+    if(!secs)
+        secs = 1;
+    //Every event used to wake up a thread of its own
+    dumpsys_log(buf, "Event loop: wakeups=%u (%u/s) events=%u (%u/s) "
+            "wakeups saved=%u (%u/s)\n", mWakeups, mWakeups / secs, mEvents,
+            mEvents / secs, mEvents - mWakeups, (mEvents - mWakeups) / secs);
+    pthread_mutex_lock(&mLock);
+    for(int i = 0; i < MAX_EVENT_SOURCES; i++) {
+        if(mSources[i].fd >= 0) {
+            dumpsys_log(buf, "  %s fd=%d events=%u\n", mSources[i].name,
+                    mSources[i].fd, mSources[i].count);
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+}; //namespace qhwc
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HWC_EVENTLOOP_H
+#define HWC_EVENTLOOP_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/Timers.h>
+#include <utils/String8.h>
+
+#define MAX_EVENT_SOURCES 16
+
+namespace qhwc {
+
+// Single display priority thread serving all HWC event sources (uevents,
+// vsync nodes, timers) with epoll. Handlers run on the loop thread, one at
+// a time, and may add or remove sources themselves.
+class EventLoop {
+public:
+    typedef void (*Handler)(void *data, uint32_t events);
+
+    EventLoop();
+    ~EventLoop();
+    /* Starts the loop thread. Sources can be added before or after */
+    bool start();
+    /* Calls "handler" with "data" on the loop thread whenever "fd" has any
+     * of the epoll "events". "name" is used for stats */
+    bool addFd(int fd, uint32_t events, Handler handler, void *data,
+            const char *name);
+    void removeFd(int fd);
+    void dump(android::String8& buf);
+
+private:
+    struct Source {
+        int fd;
+        Handler handler;
+        void *data;
+        const char *name;
+        uint32_t count;
+    };
+
+    static void *threadLoop(void *param);
+    void dispatch(uint32_t index, uint32_t events);
+
+    int mEpollFd;
+    pthread_t mThread;
+    bool mRunning;
+    pthread_mutex_t mLock;
+    Source mSources[MAX_EVENT_SOURCES];
+
+    //Stats
+    nsecs_t mStartTime;
+    uint32_t mWakeups;
+    uint32_t mEvents;
+};
+
+}; //namespace qhwc
+
+#endif //HWC_EVENTLOOP_H
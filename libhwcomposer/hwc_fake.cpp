@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define HWC_FAKE_DEBUG 0
+#include <fcntl.h>
+#include <unistd.h>
+#include <hardware/hardware.h>
+#include <ioctl_backend.h>
+#include "hwc_fake.h"
+
+//The HAL is built into the tool, its module is at hand
+extern hwc_module_t HAL_MODULE_INFO_SYM;
+
+namespace qhwc {
+
+FakeDevice::FakeBuffer::FakeBuffer(int fd) : hnd(fd, 0, 0, 0, 0, 0, 0) {
+#ifdef QCOM_BSP
+    memset(&meta, 0, sizeof(meta));
+    hnd.base_metadata = (int)(intptr_t)&meta;
+#endif
+}
+
+FakeDevice::FakeBuffer::~FakeBuffer() {
+    if(hnd.fd >= 0)
+        ::close(hnd.fd);
+}
+
+FakeDevice::FakeDevice() : mCtx(0), mBackend(0) {
+}
+
+FakeDevice::~FakeDevice() {
+    close();
+}
+
+bool FakeDevice::open(const char *config) {
+    mBackend = qdutils::FakeIoctl::fromConfig(config ? config : "");
+    qdutils::IoctlBackend::setInstance(mBackend);
+
+    hw_device_t *dev = NULL;
+    const hw_module_t *module = &HAL_MODULE_INFO_SYM.common;
+    if(module->methods->open(module, HWC_HARDWARE_COMPOSER, &dev)) {
+        ALOGE("%s: HAL open failed", __FUNCTION__);
+        return false;
+    }
+    mCtx = (hwc_context_t *)dev;
+    if(!mCtx->mFbDev) {
+        ALOGE("%s: No fb device", __FUNCTION__);
+        close();
+        return false;
+    }
+    //Nothing is scanned out, frames end at the display commit
+    mCtx->mFbDev->post = post;
+    if(mCtx->device.blank(&mCtx->device, HWC_DISPLAY_PRIMARY, 0)) {
+        ALOGE("%s: Unblank failed", __FUNCTION__);
+        close();
+        return false;
+    }
+    ALOGD_IF(HWC_FAKE_DEBUG, "%s: opened with fake%s", __FUNCTION__,
+            config ? config : "");
+    return true;
+}
+
+void FakeDevice::close() {
+    //Closing the HAL unsets its pipes, still on the fake backend
+    if(mCtx) {
+        mCtx->device.common.close(&mCtx->device.common);
+        mCtx = NULL;
+    }
+    for(size_t i = 0; i < mBuffers.size(); i++)
+        delete mBuffers.valueAt(i);
+    mBuffers.clear();
+    if(mBackend) {
+        qdutils::IoctlBackend::setInstance(NULL);
+        delete mBackend;
+        mBackend = NULL;
+    }
+}
+
+private_handle_t *FakeDevice::getHandle(uint32_t id, int format, int width,
+        int height, int size, int bufferType, int flags) {
+    FakeBuffer *buf = NULL;
+    ssize_t index = mBuffers.indexOfKey(id);
+    if(index >= 0) {
+        buf = mBuffers.valueAt(index);
+    } else {
+        //Pipes dup the fd of the buffer they last played
+        int fd = ::open("/dev/null", O_RDONLY);
+        if(fd < 0) {
+            ALOGE("%s: open failed err=%s", __FUNCTION__, strerror(errno));
+            return NULL;
+        }
+        buf = new FakeBuffer(fd);
+        mBuffers.add(id, buf);
+    }
+    private_handle_t *hnd = &buf->hnd;
+    hnd->format = format;
+    hnd->width = width;
+    hnd->height = height;
+    hnd->size = size;
+    hnd->bufferType = bufferType;
+    hnd->flags = flags;
+    return hnd;
+}
+
+int FakeDevice::post(struct framebuffer_device_t * /*dev*/,
+        buffer_handle_t /*buf*/) {
+    return 0;
+}
+
+}; //namespace qhwc
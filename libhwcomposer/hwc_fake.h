@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef HWC_FAKE_H
+#define HWC_FAKE_H
+
+#include <stdint.h>
+#include <utils/KeyedVector.h>
+#include "hwc_utils.h"
+#ifdef QCOM_BSP
+#include "qdMetaData.h"
+#endif
+
+namespace qdutils {
+class FakeIoctl;
+};
+
+namespace qhwc {
+
+// Composer for the tools that run without a panel (trace replay, benchmark).
+// The HAL sources are built into the tool and issue their ioctls to
+// FakeIoctl, the fb post is stubbed out and layers are backed by handles
+// that carry only their geometry. Gralloc still opens the fb node, so the
+// tools run on a device, with surfaceflinger stopped.
+class FakeDevice {
+public:
+    FakeDevice();
+    ~FakeDevice();
+    /* Installs FakeIoctl, configured as the tail of a "fake" setting of
+     * debug.qdutils.ioctl (e.g. ":1080x1920:500:8"), then opens the HAL and
+     * unblanks the primary. Must be called once, before anything else */
+    bool open(const char *config);
+    void close();
+    hwc_composer_device_1_t *getDevice() { return &mCtx->device; }
+    hwc_context_t *getContext() { return mCtx; }
+    qdutils::FakeIoctl *getBackend() { return mBackend; }
+    /* Returns the handle standing for buffer "id", made on first use. The
+     * geometry is updated on each call, as ids may be reused */
+    private_handle_t *getHandle(uint32_t id, int format, int width,
+            int height, int size, int bufferType, int flags);
+
+private:
+    struct FakeBuffer {
+        FakeBuffer(int fd);
+        ~FakeBuffer();
+        private_handle_t hnd;
+#ifdef QCOM_BSP
+        MetaData_t meta;
+#endif
+    };
+
+    static int post(struct framebuffer_device_t *dev, buffer_handle_t buf);
+
+    hwc_context_t *mCtx;
+    qdutils::FakeIoctl *mBackend;
+    android::KeyedVector<uint32_t, FakeBuffer *> mBuffers;
+};
+
+}; //namespace qhwc
+
+#endif //HWC_FAKE_H
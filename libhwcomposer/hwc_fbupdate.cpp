@@ -46,21 +46,23 @@ inline void FBUpdateLowRes::reset() {
     mDest = ovutils::OV_INVALID;
 }
 
-bool FBUpdateLowRes::prepare(hwc_context_t *ctx, hwc_display_contents_1 *list)
+bool FBUpdateLowRes::prepare(hwc_context_t *ctx, hwc_display_contents_1 *list,
+        int fbZorder, int fbZorderRight)
 {
     if(!ctx->mMDP.hasOverlay) {
         ALOGD_IF(DEBUG_FBUPDATE, "%s, this hw doesnt support overlays",
                 __FUNCTION__);
        return false;
     }
-    mModeOn = configure(ctx, list);
+    mModeOn = configure(ctx, list, fbZorder);
     ALOGD_IF(DEBUG_FBUPDATE, "%s, mModeOn = %d", __FUNCTION__, mModeOn);
     return mModeOn;
 }
 
 // Configure
 bool FBUpdateLowRes::configure(hwc_context_t *ctx,
-                               hwc_display_contents_1 *list)
+                               hwc_display_contents_1 *list,
+                               int fbZorder)
 {
     bool ret = false;
     hwc_layer_1_t *layer = &list->hwLayers[list->numHwLayers - 1];
@@ -83,10 +85,20 @@ bool FBUpdateLowRes::configure(hwc_context_t *ctx,
 
         ovutils::eMdpFlags mdpFlags = ovutils::OV_MDP_FLAGS_NONE;
 
+        //In mixed mode FB sits on top of MDP composed layers and is blended
+        ovutils::eZorder zOrder = static_cast<ovutils::eZorder>(fbZorder);
+        ovutils::eIsFg isFg = ovutils::IS_FG_SET;
+        if(fbZorder) {
+            isFg = ovutils::IS_FG_OFF;
+            if(layer->blending == HWC_BLENDING_PREMULT)
+                ovutils::setMdpFlags(mdpFlags,
+                        ovutils::OV_MDP_BLEND_FG_PREMULT);
+        }
+
         ovutils::PipeArgs parg(mdpFlags,
                 info,
-                ovutils::ZORDER_0,
-                ovutils::IS_FG_SET,
+                zOrder,
+                isFg,
                 ovutils::ROT_FLAGS_NONE);
         ov.setSource(parg, dest);
 
@@ -130,7 +142,7 @@ bool FBUpdateLowRes::draw(hwc_context_t *ctx, private_handle_t *hnd)
     bool ret = true;
     overlay::Overlay& ov = *(ctx->mOverlay);
     ovutils::eDest dest = mDest;
-    if (!ov.queueBuffer(hnd->fd, hnd->offset, dest)) {
+    if (!ov.queueBuffer(hnd->fd, hnd->offset, dest, hnd)) {
         ALOGE("%s: queueBuffer failed for FBUpdate", __FUNCTION__);
         ret = false;
     }
@@ -146,7 +158,8 @@ inline void FBUpdateHighRes::reset() {
     mDestRight = ovutils::OV_INVALID;
 }
 
-bool FBUpdateHighRes::prepare(hwc_context_t *ctx, hwc_display_contents_1 *list)
+bool FBUpdateHighRes::prepare(hwc_context_t *ctx, hwc_display_contents_1 *list,
+        int fbZorder, int fbZorderRight)
 {
     if(!ctx->mMDP.hasOverlay) {
         ALOGD_IF(DEBUG_FBUPDATE, "%s, this hw doesnt support overlays",
@@ -154,13 +167,15 @@ bool FBUpdateHighRes::prepare(hwc_context_t *ctx, hwc_display_contents_1 *list)
        return false;
     }
     ALOGD_IF(DEBUG_FBUPDATE, "%s, mModeOn = %d", __FUNCTION__, mModeOn);
-    mModeOn = configure(ctx, list);
+    mModeOn = configure(ctx, list, fbZorder,
+            fbZorderRight < 0 ? fbZorder : fbZorderRight);
     return mModeOn;
 }
 
 // Configure
 bool FBUpdateHighRes::configure(hwc_context_t *ctx,
-                                hwc_display_contents_1 *list)
+                                hwc_display_contents_1 *list,
+                                int fbZorder, int fbZorderRight)
 {
     bool ret = false;
     hwc_layer_1_t *layer = &list->hwLayers[list->numHwLayers - 1];
@@ -188,20 +203,40 @@ bool FBUpdateHighRes::configure(hwc_context_t *ctx,
         mDestRight = destR;
 
         ovutils::eMdpFlags mdpFlagsL = ovutils::OV_MDP_FLAGS_NONE;
+        ovutils::eMdpFlags mdpFlagsR = ovutils::OV_MDP_FLAGS_NONE;
+        ovutils::setMdpFlags(mdpFlagsR, ovutils::OV_MDSS_MDP_RIGHT_MIXER);
+
+        //In mixed mode FB sits on top of MDP composed layers and is blended.
+        //The mixers stage their own layers, so the z-orders can differ
+        ovutils::eZorder zOrderL = static_cast<ovutils::eZorder>(fbZorder);
+        ovutils::eIsFg isFgL = ovutils::IS_FG_SET;
+        if(fbZorder) {
+            isFgL = ovutils::IS_FG_OFF;
+            if(layer->blending == HWC_BLENDING_PREMULT)
+                ovutils::setMdpFlags(mdpFlagsL,
+                        ovutils::OV_MDP_BLEND_FG_PREMULT);
+        }
+        ovutils::eZorder zOrderR =
+                static_cast<ovutils::eZorder>(fbZorderRight);
+        ovutils::eIsFg isFgR = ovutils::IS_FG_SET;
+        if(fbZorderRight) {
+            isFgR = ovutils::IS_FG_OFF;
+            if(layer->blending == HWC_BLENDING_PREMULT)
+                ovutils::setMdpFlags(mdpFlagsR,
+                        ovutils::OV_MDP_BLEND_FG_PREMULT);
+        }
 
         ovutils::PipeArgs pargL(mdpFlagsL,
                 info,
-                ovutils::ZORDER_0,
-                ovutils::IS_FG_SET,
+                zOrderL,
+                isFgL,
                 ovutils::ROT_FLAGS_NONE);
         ov.setSource(pargL, destL);
 
-        ovutils::eMdpFlags mdpFlagsR = mdpFlagsL;
-        ovutils::setMdpFlags(mdpFlagsR, ovutils::OV_MDSS_MDP_RIGHT_MIXER);
         ovutils::PipeArgs pargR(mdpFlagsR,
                 info,
-                ovutils::ZORDER_0,
-                ovutils::IS_FG_SET,
+                zOrderR,
+                isFgR,
                 ovutils::ROT_FLAGS_NONE);
         ov.setSource(pargR, destR);
 
@@ -256,12 +291,12 @@ bool FBUpdateHighRes::draw(hwc_context_t *ctx, private_handle_t *hnd)
     overlay::Overlay& ov = *(ctx->mOverlay);
     ovutils::eDest destL = mDestLeft;
     ovutils::eDest destR = mDestRight;
-    if (!ov.queueBuffer(hnd->fd, hnd->offset, destL)) {
+    if (!ov.queueBuffer(hnd->fd, hnd->offset, destL, hnd)) {
         ALOGE("%s: queue failed for left of dpy = %d",
                 __FUNCTION__, mDpy);
         ret = false;
     }
-    if (!ov.queueBuffer(hnd->fd, hnd->offset, destR)) {
+    if (!ov.queueBuffer(hnd->fd, hnd->offset, destR, hnd)) {
         ALOGE("%s: queue failed for right of dpy = %d",
                 __FUNCTION__, mDpy);
         ret = false;
@@ -33,8 +33,12 @@ class IFBUpdate {
 public:
     explicit IFBUpdate(const int& dpy) : mDpy(dpy) {}
     virtual ~IFBUpdate() {};
-    // Sets up members and prepares overlay if conditions are met
-    virtual bool prepare(hwc_context_t *ctx, hwc_display_contents_1 *list) = 0;
+    // Sets up members and prepares overlay if conditions are met.
+    // fbZorder is the z-order of the FB target, non zero in mixed mode.
+    // fbZorderRight is its z-order on the right mixer of split panels, -1
+    // for the same as fbZorder
+    virtual bool prepare(hwc_context_t *ctx, hwc_display_contents_1 *list,
+            int fbZorder, int fbZorderRight = -1) = 0;
     // Draws layer
     virtual bool draw(hwc_context_t *ctx, private_handle_t *hnd) = 0;
     //Reset values
@@ -52,12 +56,14 @@ class FBUpdateLowRes : public IFBUpdate {
 public:
     explicit FBUpdateLowRes(const int& dpy);
     virtual ~FBUpdateLowRes() {};
-    bool prepare(hwc_context_t *ctx, hwc_display_contents_1 *list);
+    bool prepare(hwc_context_t *ctx, hwc_display_contents_1 *list,
+            int fbZorder, int fbZorderRight = -1);
 
     bool draw(hwc_context_t *ctx, private_handle_t *hnd);
     void reset();
 private:
-    bool configure(hwc_context_t *ctx, hwc_display_contents_1 *list);
+    bool configure(hwc_context_t *ctx, hwc_display_contents_1 *list,
+            int fbZorder);
     ovutils::eDest mDest; //pipe to draw on
 };
 
@@ -66,11 +72,13 @@ class FBUpdateHighRes : public IFBUpdate {
 public:
     explicit FBUpdateHighRes(const int& dpy);
     virtual ~FBUpdateHighRes() {};
-    bool prepare(hwc_context_t *ctx, hwc_display_contents_1 *list);
+    bool prepare(hwc_context_t *ctx, hwc_display_contents_1 *list,
+            int fbZorder, int fbZorderRight = -1);
     bool draw(hwc_context_t *ctx, private_handle_t *hnd);
     void reset();
 private:
-    bool configure(hwc_context_t *ctx, hwc_display_contents_1 *list);
+    bool configure(hwc_context_t *ctx, hwc_display_contents_1 *list,
+            int fbZorder, int fbZorderRight);
     ovutils::eDest mDestLeft; //left pipe to draw on
     ovutils::eDest mDestRight; //right pipe to draw on
 };
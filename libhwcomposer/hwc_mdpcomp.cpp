@@ -18,9 +18,12 @@
 
 #include "hwc_mdpcomp.h"
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
 #include "external.h"
 #include "mdp_version.h"
 #include "qdMetaData.h"
+#include "ioctl_backend.h"
+#include "hwc_eventloop.h"
 
 namespace qhwc {
 
@@ -32,6 +35,8 @@ IdleInvalidator *MDPComp::idleInvalidator = NULL;
 bool MDPComp::sIdleFallBack = false;
 bool MDPComp::sDebugLogs = false;
 bool MDPComp::sEnabled = false;
+bool MDPComp::sEnableMixedMode = true;
+uint32_t MDPComp::sRotBudget = 0;
 
 MDPComp* MDPComp::getObject(const int& width) {
     if(width <= MAX_DISPLAY_DIM) {
@@ -45,7 +50,16 @@ void MDPComp::dump(android::String8& buf)
 {
     dumpsys_log(buf, "  MDP Composition: ");
     dumpsys_log(buf, "MDPCompState=%d\n", mState);
-    //XXX: Log more info
+    dumpsys_log(buf, "  MixedMode=%d layers=%d mdp=%d fb=%d fbZ=%d\n",
+            sEnableMixedMode, mCurrentFrame.count, mCurrentFrame.mdpCount,
+            mCurrentFrame.fbCount, mCurrentFrame.fbZ);
+    dumpsys_log(buf, "  Rotator pixels=%u budget=%u\n", mRotPixels,
+            sRotBudget);
+    if(idleInvalidator) {
+        char idleDump[256] = {'\0'};
+        idleInvalidator->getDump(idleDump, sizeof(idleDump));
+        dumpsys_log(buf, "%s", idleDump);
+    }
 }
 
 bool MDPComp::init(hwc_context_t *ctx) {
@@ -70,6 +84,13 @@ bool MDPComp::init(hwc_context_t *ctx) {
         sEnabled = true;
     }
 
+    sEnableMixedMode = true;
+    if((property_get("debug.mdpcomp.mixedmode", property, NULL) > 0) &&
+            (!strncmp(property, "0", PROPERTY_VALUE_MAX ) ||
+             (!strncasecmp(property,"false", PROPERTY_VALUE_MAX )))) {
+        sEnableMixedMode = false;
+    }
+
     sDebugLogs = false;
     if(property_get("debug.mdpcomp.logs", property, NULL) > 0) {
         if(atoi(property) != 0)
@@ -82,17 +103,41 @@ bool MDPComp::init(hwc_context_t *ctx) {
             idle_timeout = atoi(property);
     }
 
+    //Set to the idle time above for a fixed timeout
+    unsigned long min_idle_timeout = DEFAULT_MIN_IDLE_TIME;
+    if(property_get("debug.mdpcomp.idletime.min", property, NULL) > 0) {
+        if(atoi(property) != 0)
+            min_idle_timeout = atoi(property);
+    }
+
+    //Rotator budget of a frame at the panel refresh rate
+    unsigned long rot_mpps = DEFAULT_ROT_MPPS;
+    if(property_get("debug.mdpcomp.rot.mpps", property, NULL) > 0) {
+        if(atoi(property) > 0)
+            rot_mpps = atoi(property);
+    }
+    sRotBudget = (uint32_t)((uint64_t)rot_mpps *
+            ctx->dpyAttr[HWC_DISPLAY_PRIMARY].vsync_period / 1000);
+
     //create Idle Invalidator
     idleInvalidator = IdleInvalidator::getInstance();
 
     if(idleInvalidator == NULL) {
         ALOGE("%s: failed to instantiate idleInvalidator  object", __FUNCTION__);
     } else {
-        idleInvalidator->init(timeout_handler, ctx, idle_timeout);
+        idleInvalidator->init(timeout_handler, ctx, idle_timeout,
+                min_idle_timeout);
+        ctx->mEventLoop->addFd(idleInvalidator->getFd(), EPOLLIN, idle_event,
+                idleInvalidator, "idle timer");
     }
     return true;
 }
 
+void MDPComp::idle_event(void *data, uint32_t events) {
+    IdleInvalidator *invalidator = (IdleInvalidator *)data;
+    invalidator->handleTimeout();
+}
+
 void MDPComp::timeout_handler(void *udata) {
     struct hwc_context_t* ctx = (struct hwc_context_t*)(udata);
 
@@ -116,10 +161,15 @@ void MDPComp::setMDPCompLayerFlags(hwc_context_t *ctx,
     LayerProp *layerProp = ctx->layerProp[dpy];
 
     for(int index = 0; index < ctx->listStats[dpy].numAppLayers; index++ ) {
+        if(mCurrentFrame.isFBComposed[index])
+            continue;
         hwc_layer_1_t* layer = &(list->hwLayers[index]);
         layerProp[index].mFlags |= HWC_MDPCOMP;
         layer->compositionType = HWC_OVERLAY;
-        layer->hints |= HWC_HINT_CLEAR_FB;
+        //FB needs clearing only under layers it is blended on top of
+        if(!mCurrentFrame.fbCount ||
+                mCurrentFrame.layerZ[index] < mCurrentFrame.fbZ)
+            layer->hints |= HWC_HINT_CLEAR_FB;
     }
 }
 
@@ -169,14 +219,14 @@ bool MDPComp::setupBasePipe(hwc_context_t *ctx) {
     ovInfo.dst_rect.h = fb_height;
     ovInfo.id = MSMFB_NEW_REQUEST;
 
-    if (ioctl(fb_fd, MSMFB_OVERLAY_SET, &ovInfo) < 0) {
+    if (qdutils::devIoctl(fb_fd, MSMFB_OVERLAY_SET, &ovInfo) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_SET err=%s",
                 strerror(errno));
         return false;
     }
 
     ovData.id = ovInfo.id;
-    if (ioctl(fb_fd, MSMFB_OVERLAY_PLAY, &ovData) < 0) {
+    if (qdutils::devIoctl(fb_fd, MSMFB_OVERLAY_PLAY, &ovData) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_PLAY err=%s",
                 strerror(errno));
         return false;
@@ -188,17 +238,90 @@ void MDPComp::reset(hwc_context_t *ctx,
         hwc_display_contents_1_t* list ) {
     //Reset flags and states
     unsetMDPCompLayerFlags(ctx, list);
-    if(mCurrentFrame.pipeLayer) {
-        for(int i = 0 ; i < mCurrentFrame.count; i++ ) {
-            if(mCurrentFrame.pipeLayer[i].pipeInfo) {
-                delete mCurrentFrame.pipeLayer[i].pipeInfo;
-                mCurrentFrame.pipeLayer[i].pipeInfo = NULL;
-            }
+    //Pipe infos are in the frame arena, which may have been reset already
+    mCurrentFrame.pipeLayer = NULL;
+    mCurrentFrame.count = 0;
+    mCurrentFrame.fbCount = 0;
+    mCurrentFrame.mdpCount = 0;
+    mCurrentFrame.fbZ = -1;
+    mRotPixels = 0;
+}
+
+void MDPComp::updateLayerHistory(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    int numAppLayers = ctx->listStats[dpy].numAppLayers;
+
+    //History does not carry over a change in the layer stack
+    if((list->flags & HWC_GEOMETRY_CHANGED) ||
+            mLayerHistory.numLayers != numAppLayers) {
+        mLayerHistory.numLayers = numAppLayers;
+        for(int i = 0; i < numAppLayers; i++) {
+            mLayerHistory.hnd[i] = list->hwLayers[i].handle;
+            //Until proven static, assume the layer updates every frame
+            mLayerHistory.updates[i] = ~0U;
         }
-        free(mCurrentFrame.pipeLayer);
-        mCurrentFrame.pipeLayer = NULL;
+        return;
     }
-    mCurrentFrame.count = 0;
+
+    for(int i = 0; i < numAppLayers; i++) {
+        buffer_handle_t hnd = list->hwLayers[i].handle;
+        mLayerHistory.updates[i] <<= 1;
+        if(hnd != mLayerHistory.hnd[i]) {
+            mLayerHistory.updates[i] |= 1;
+            mLayerHistory.hnd[i] = hnd;
+        }
+    }
+}
+
+int MDPComp::getUpdateWeight(hwc_display_contents_1_t* list, int index) {
+    private_handle_t *hnd = (private_handle_t *)list->hwLayers[index].handle;
+    int weight = __builtin_popcount(mLayerHistory.updates[index]);
+    //Video stays on MDP over any UI layer
+    if(isYuvBuffer(hnd))
+        weight += 32;
+    return weight;
+}
+
+uint32_t MDPComp::getStaticMask(hwc_display_contents_1_t* list,
+        bool lookAhead) {
+    const uint32_t recentMask = (1 << MIXED_MODE_STATIC_FRAMES) - 1;
+    uint32_t staticMask = 0;
+
+    for(int i = 0; i < mLayerHistory.numLayers; i++) {
+        uint32_t updates = mLayerHistory.updates[i];
+        if(lookAhead) {
+            updates <<= 1;
+            if(list->hwLayers[i].handle != mLayerHistory.hnd[i])
+                updates |= 1;
+        }
+        if(!(updates & recentMask))
+            staticMask |= (1U << i);
+    }
+    return staticMask;
+}
+
+bool MDPComp::canReuse(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
+    if(!isEnabled())
+        return true;
+    if(!mReusable || sIdleFallBack)
+        return false;
+    if((int)list->numHwLayers - 1 != mLayerHistory.numLayers)
+        return false;
+    //Mixed mode split follows the layers going static or updating
+    if(isMixedModeEnabled() &&
+            getStaticMask(list, true) != mStaticMask) {
+        ALOGD_IF(isDebug(), "%s: static layers changed", __FUNCTION__);
+        return false;
+    }
+    return true;
+}
+
+void MDPComp::reuse(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
+    if(!isEnabled())
+        return;
+    updateLayerHistory(ctx, list);
+    mStaticMask = getStaticMask(list, false);
 }
 
 void MDPComp::setVidInfo(hwc_layer_1_t *layer,
@@ -280,7 +403,9 @@ ovutils::eDest MDPComp::getMdpPipe(hwc_context_t *ctx, ePipeType type) {
                 break;
             }
         case  MDPCOMP_OV_VG:
-            return ov.nextPipe(ovutils::OV_MDP_PIPE_VG, dpy);
+            //UI falls back to VG only if no video needs it
+            return ov.nextPipe(ovutils::OV_MDP_PIPE_VG, dpy,
+                    type != MDPCOMP_OV_VG);
         default:
             ALOGE("%s: Invalid pipe type",__FUNCTION__);
             return ovutils::OV_INVALID;
@@ -288,17 +413,11 @@ ovutils::eDest MDPComp::getMdpPipe(hwc_context_t *ctx, ePipeType type) {
     return ovutils::OV_INVALID;
 }
 
-bool MDPComp::isDoable(hwc_context_t *ctx,
-        hwc_display_contents_1_t* list) {
-    //Number of layers
+bool MDPComp::isFrameDoable(hwc_context_t *ctx) {
     const int dpy = HWC_DISPLAY_PRIMARY;
     int numAppLayers = ctx->listStats[dpy].numAppLayers;
 
-    overlay::Overlay& ov = *ctx->mOverlay;
-    int availablePipes = ov.availablePipes(dpy);
-
-    if(numAppLayers < 1 || numAppLayers > MAX_PIPES_PER_MIXER ||
-                           pipesNeeded(ctx, list) > availablePipes) {
+    if(numAppLayers < 1) {
         ALOGD_IF(isDebug(), "%s: Unsupported number of layers",__FUNCTION__);
         return false;
     }
@@ -317,42 +436,238 @@ bool MDPComp::isDoable(hwc_context_t *ctx,
     if(ctx->mSecureMode)
         return false;
 
-    //Check for skip layers
-    if(isSkipPresent(ctx, dpy)) {
-        ALOGD_IF(isDebug(), "%s: Skip layers are present",__FUNCTION__);
+    //FB composition on idle timeout
+    if(sIdleFallBack) {
+        sIdleFallBack = false;
+        ALOGD_IF(isDebug(), "%s: idle fallback",__FUNCTION__);
+        return false;
+    }
+    return true;
+}
+
+int MDPComp::getVgDemand(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    //Frame wide conditions of isFrameDoable(), the idle fallback read only
+    if(!isEnabled() || ctx->mExtDispConfiguring || isSecuring(ctx) ||
+            ctx->mSecureMode || sIdleFallBack)
+        return 0;
+    int demand = 0;
+    for(uint32_t i = 0; i < list->numHwLayers - 1; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        if(!isYuvBuffer((private_handle_t *)layer->handle) ||
+                !isLayerDoable(ctx, layer))
+            continue;
+        //One pipe per mixer the layer is staged on
+        int mixers = getLayerMixers(ctx, layer);
+        demand += ((mixers & MIXER_LEFT) ? 1 : 0) +
+                ((mixers & MIXER_RIGHT) ? 1 : 0);
+    }
+    return demand;
+}
+
+bool MDPComp::isLayerDoable(hwc_context_t *ctx, hwc_layer_1_t* layer) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+
+    if(isSkipLayer(layer)) {
+        ALOGD_IF(isDebug(), "%s: Skip layer",__FUNCTION__);
         return false;
     }
 
-    if(ctx->listStats[dpy].needsAlphaScale
-                     && ctx->mMDP.version < qdutils::MDSS_V5) {
-        ALOGD_IF(isDebug(), "%s: frame needs alpha downscaling",__FUNCTION__);
+    if(isAlphaScaled(layer) && ctx->mMDP.version < qdutils::MDSS_V5) {
+        ALOGD_IF(isDebug(), "%s: layer needs alpha downscaling",__FUNCTION__);
         return false;
     }
 
-    //FB composition on idle timeout
-    if(sIdleFallBack) {
-        sIdleFallBack = false;
-        ALOGD_IF(isDebug(), "%s: idle fallback",__FUNCTION__);
+    //Transforms involving 90 (90, 270) go through the pipe's rotator,
+    //whose throughput is checked for the frame as a whole
+    if((layer->transform & HWC_TRANSFORM_ROT_90) && !canRotate()) {
+        ALOGD_IF(isDebug(), "%s: orientation involved",__FUNCTION__);
+        return false;
+    }
+
+    if(!isYuvBuffer(hnd) && !isWidthValid(ctx,layer)) {
+        ALOGD_IF(isDebug(), "%s: Buffer is of invalid width",__FUNCTION__);
         return false;
     }
+    return true;
+}
+
+bool MDPComp::isFullFrameDoable(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    int numAppLayers = ctx->listStats[dpy].numAppLayers;
 
-    //MDP composition is not efficient if layer needs rotator.
     for(int i = 0; i < numAppLayers; ++i) {
-        // As MDP h/w supports flip operation, use MDP comp only for
-        // 180 transforms. Fail for any transform involving 90 (90, 270).
+        if(!isLayerDoable(ctx, &list->hwLayers[i]))
+            return false;
+    }
+
+    markFrame(ctx, -1, -1);
+    if(!isStagingDoable(ctx, list, mCurrentFrame)) {
+        ALOGD_IF(isDebug(), "%s: Unsupported number of layers",__FUNCTION__);
+        return false;
+    }
+
+    if(pipesNeeded(ctx, list, mCurrentFrame) >
+            ctx->mOverlay->availablePipes(dpy)) {
+        ALOGD_IF(isDebug(), "%s: Insufficient pipes",__FUNCTION__);
+        return false;
+    }
+
+    if(!isRotationDoable(ctx, list, mCurrentFrame)) {
+        ALOGD_IF(isDebug(), "%s: Rotator budget exceeded",__FUNCTION__);
+        return false;
+    }
+    return true;
+}
+
+bool MDPComp::isRotationDoable(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list, FrameInfo& frame) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    int numAppLayers = ctx->listStats[dpy].numAppLayers;
+    uint32_t rotPixels = 0;
+    bool rgbRotated = false;
+
+    for(int i = 0; i < numAppLayers; i++) {
         hwc_layer_1_t* layer = &list->hwLayers[i];
         private_handle_t *hnd = (private_handle_t *)layer->handle;
-        if((layer->transform & HWC_TRANSFORM_ROT_90)  && (!isYuvBuffer(hnd)
-                                                            || !canRotate())) {
-            ALOGD_IF(isDebug(), "%s: orientation involved",__FUNCTION__);
+        if(frame.isFBComposed[i] || !hnd ||
+                !(layer->transform & HWC_TRANSFORM_ROT_90))
+            continue;
+        //Rotator works on the whole buffer, not just the crop, for each
+        //of the layer's pipes
+        int mixers = getLayerMixers(ctx, layer);
+        int pipes = (mixers & MIXER_LEFT ? 1 : 0) +
+                (mixers & MIXER_RIGHT ? 1 : 0);
+        rotPixels += hnd->width * hnd->height * pipes;
+        if(!isYuvBuffer(hnd))
+            rgbRotated = true;
+    }
+
+    mRotPixels = rotPixels;
+    //Video has always been rotated on MDP, the budget only limits the
+    //RGB layers added on top of it
+    return !rgbRotated || rotPixels <= sRotBudget;
+}
+
+int MDPComp::getMixerZ(hwc_context_t *ctx, hwc_display_contents_1_t* list,
+        FrameInfo& frame, int index, int mixer) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    int numAppLayers = ctx->listStats[dpy].numAppLayers;
+    int z = (index < 0) ? frame.fbZ : frame.layerZ[index];
+    //FB target spans the whole panel
+    int mixerZ = (frame.fbCount && frame.fbZ < z) ? 1 : 0;
+
+    for(int i = 0; i < numAppLayers; i++) {
+        if(!frame.isFBComposed[i] && frame.layerZ[i] < z &&
+                (getLayerMixers(ctx, &list->hwLayers[i]) & mixer))
+            mixerZ++;
+    }
+    return mixerZ;
+}
+
+bool MDPComp::isStagingDoable(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list, FrameInfo& frame) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    int numAppLayers = ctx->listStats[dpy].numAppLayers;
+
+    for(int m = 0; m < numMixers(); m++) {
+        int mixer = 1 << m;
+        int stages = frame.fbCount ? 1 : 0;
+        for(int i = 0; i < numAppLayers; i++) {
+            if(!frame.isFBComposed[i] &&
+                    (getLayerMixers(ctx, &list->hwLayers[i]) & mixer))
+                stages++;
+        }
+        if(stages > MAX_PIPES_PER_MIXER)
             return false;
+    }
+    return true;
+}
+
+void MDPComp::markFrame(hwc_context_t *ctx, int fbStart, int fbEnd) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    int numAppLayers = ctx->listStats[dpy].numAppLayers;
+    FrameInfo& frame = mCurrentFrame;
+    int zOrder = 0;
+
+    frame.fbCount = 0;
+    frame.mdpCount = 0;
+    frame.fbZ = -1;
+    for(int i = 0; i < numAppLayers; i++) {
+        frame.isFBComposed[i] = (i >= fbStart && i <= fbEnd);
+        if(frame.isFBComposed[i]) {
+            //The whole batch shares the z-order of the FB target
+            frame.layerZ[i] = -1;
+            if(frame.fbCount++ == 0)
+                frame.fbZ = zOrder++;
+        } else {
+            frame.layerZ[i] = zOrder++;
+            frame.mdpCount++;
+        }
+    }
+}
+
+/*
+ * Mixed mode: layers MDP cannot handle and layers whose buffers did not
+ * change recently are left to GPU, the rest are put on MDP pipes. GPU
+ * layers form one contiguous batch so that the FB target can be staged
+ * between MDP layers without breaking z-order.
+ */
+bool MDPComp::setupMixedFrame(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    int numAppLayers = ctx->listStats[dpy].numAppLayers;
+    int availablePipes = ctx->mOverlay->availablePipes(dpy);
+    int fbStart = -1;
+    int fbEnd = -1;
+
+    for(int i = 0; i < numAppLayers; i++) {
+        if(!isLayerDoable(ctx, &list->hwLayers[i]) ||
+                (mStaticMask & (1U << i))) {
+            if(fbStart < 0)
+                fbStart = i;
+            fbEnd = i;
+        }
+    }
+
+    //Nothing is static yet, start with the least updating layer
+    if(fbStart < 0) {
+        fbStart = 0;
+        for(int i = 1; i < numAppLayers; i++) {
+            if(getUpdateWeight(list, i) < getUpdateWeight(list, fbStart))
+                fbStart = i;
         }
+        fbEnd = fbStart;
+    }
 
-        if(!isYuvBuffer(hnd) && !isWidthValid(ctx,layer)) {
-            ALOGD_IF(isDebug(), "%s: Buffer is of invalid width",__FUNCTION__);
+    //Grow the batch with the less updating neighbour until the MDP
+    //layers and the FB target fit in the available stages and pipes
+    while(true) {
+        markFrame(ctx, fbStart, fbEnd);
+        if(mCurrentFrame.mdpCount == 0) {
+            ALOGD_IF(isDebug(), "%s: No layers left for MDP", __FUNCTION__);
             return false;
         }
+        if(isStagingDoable(ctx, list, mCurrentFrame) &&
+                pipesNeeded(ctx, list, mCurrentFrame) <= availablePipes &&
+                isRotationDoable(ctx, list, mCurrentFrame))
+            break;
+
+        int below = fbStart - 1;
+        int above = fbEnd + 1;
+        if(below >= 0 && (above >= numAppLayers ||
+                getUpdateWeight(list, below) <=
+                getUpdateWeight(list, above))) {
+            fbStart = below;
+        } else {
+            fbEnd = above;
+        }
     }
+
+    ALOGD_IF(isDebug(), "%s: FB batch [%d, %d] fbZ %d, %d layers on MDP",
+            __FUNCTION__, fbStart, fbEnd, mCurrentFrame.fbZ,
+            mCurrentFrame.mdpCount);
     return true;
 }
 
@@ -363,12 +678,23 @@ bool MDPComp::setup(hwc_context_t* ctx, hwc_display_contents_1_t* list) {
         return -1;
     }
 
+    //FB target gets its pipe ahead of the layers, it needs an RGB pipe
+    if(mCurrentFrame.fbCount &&
+            !ctx->mFBUpdate[dpy]->prepare(ctx, list,
+            getMixerZ(ctx, list, mCurrentFrame, -1, MIXER_LEFT),
+            getMixerZ(ctx, list, mCurrentFrame, -1, MIXER_RIGHT))) {
+        ALOGD_IF(isDebug(), "%s: FB pipe setup failed", __FUNCTION__);
+        return false;
+    }
+
     if(!allocLayerPipes(ctx, list, mCurrentFrame)) {
         ALOGD_IF(isDebug(), "%s: Falling back to FB", __FUNCTION__);
         return false;
     }
 
     for (int index = 0 ; index < mCurrentFrame.count; index++) {
+        if(mCurrentFrame.isFBComposed[index])
+            continue;
         hwc_layer_1_t* layer = &list->hwLayers[index];
         MdpPipeInfo* cur_pipe = mCurrentFrame.pipeLayer[index].pipeInfo;
 
@@ -383,35 +709,46 @@ bool MDPComp::setup(hwc_context_t* ctx, hwc_display_contents_1_t* list) {
 
 bool MDPComp::prepare(hwc_context_t *ctx,
         hwc_display_contents_1_t* list) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
     if(!isEnabled()) {
         ALOGE_IF(isDebug(),"%s: MDP Comp. not enabled.", __FUNCTION__);
         return false;
     }
 
     overlay::Overlay& ov = *ctx->mOverlay;
-    bool isMDPCompUsed = true;
+    bool isMDPCompUsed = false;
+    mReusable = true;
 
     //reset old data
     reset(ctx, list);
+    updateLayerHistory(ctx, list);
+    mStaticMask = getStaticMask(list, false);
 
-    bool doable = isDoable(ctx, list);
-    if(doable) {
-        if(setup(ctx, list)) {
-            setMDPCompLayerFlags(ctx, list);
+    if(!isFrameDoable(ctx)) {
+        ALOGD_IF( isDebug(),"%s: MDP Comp not possible for this frame",
+                __FUNCTION__);
+        //Conditions like idle fallback or securing do not last
+        mReusable = false;
+    } else if(isFullFrameDoable(ctx, list) && setup(ctx, list)) {
+        isMDPCompUsed = true;
+    } else if(isMixedModeEnabled()) {
+        //Drop whatever the full frame attempt acquired and retry
+        reset(ctx, list);
+        ov.clear(dpy);
+        if(setupMixedFrame(ctx, list) && setup(ctx, list)) {
+            isMDPCompUsed = true;
         } else {
-            ALOGD_IF(isDebug(),"%s: MDP Comp Failed",__FUNCTION__);
-            isMDPCompUsed = false;
+            ALOGD_IF(isDebug(),"%s: Mixed mode not possible", __FUNCTION__);
         }
-    } else {
-        ALOGD_IF( isDebug(),"%s: MDP Comp not possible[%d]",__FUNCTION__,
-                doable);
-        isMDPCompUsed = false;
     }
 
     //Reset states
     if(!isMDPCompUsed) {
         //Reset current frame
         reset(ctx, list);
+        ov.clear(dpy);
+    } else {
+        setMDPCompLayerFlags(ctx, list);
     }
 
     mState = isMDPCompUsed ? MDPCOMP_ON : MDPCOMP_OFF;
@@ -557,9 +894,9 @@ int MDPCompLowRes::configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
 }
 
 int MDPCompLowRes::pipesNeeded(hwc_context_t *ctx,
-                        hwc_display_contents_1_t* list) {
-    const int dpy = HWC_DISPLAY_PRIMARY;
-    return ctx->listStats[dpy].numAppLayers;
+                        hwc_display_contents_1_t* list,
+                        FrameInfo& frame) {
+    return frame.mdpCount + (frame.fbCount ? fbPipesNeeded() : 0);
 }
 
 bool MDPCompLowRes::allocLayerPipes(hwc_context_t *ctx,
@@ -570,17 +907,23 @@ bool MDPCompLowRes::allocLayerPipes(hwc_context_t *ctx,
     int layer_count = ctx->listStats[dpy].numAppLayers;
 
     currentFrame.count = layer_count;
-    currentFrame.pipeLayer = (PipeLayerPair*)
-            malloc(sizeof(PipeLayerPair) * currentFrame.count);
+    currentFrame.pipeLayer =
+            ctx->mFrameArena[dpy]->create<PipeLayerPair>(currentFrame.count);
+    if(!currentFrame.pipeLayer)
+        return false;
 
     if(isYuvPresent(ctx, dpy)) {
         int nYuvCount = ctx->listStats[dpy].yuvCount;
 
         for(int index = 0; index < nYuvCount; index ++) {
             int nYuvIndex = ctx->listStats[dpy].yuvIndices[index];
+            if(currentFrame.isFBComposed[nYuvIndex])
+                continue;
             hwc_layer_1_t* layer = &list->hwLayers[nYuvIndex];
             PipeLayerPair& info = currentFrame.pipeLayer[nYuvIndex];
-            info.pipeInfo = new MdpPipeInfoLowRes;
+            info.pipeInfo = ctx->mFrameArena[dpy]->create<MdpPipeInfoLowRes>();
+            if(!info.pipeInfo)
+                return false;
             MdpPipeInfoLowRes& pipe_info = *(MdpPipeInfoLowRes*)info.pipeInfo;
             pipe_info.index = getMdpPipe(ctx, MDPCOMP_OV_VG);
             if(pipe_info.index == ovutils::OV_INVALID) {
@@ -588,7 +931,8 @@ bool MDPCompLowRes::allocLayerPipes(hwc_context_t *ctx,
                         __FUNCTION__);
                 return false;
             }
-            pipe_info.zOrder = nYuvIndex;
+            pipe_info.zOrder = getMixerZ(ctx, list, currentFrame, nYuvIndex,
+                    MIXER_LEFT);
         }
     }
 
@@ -596,19 +940,28 @@ bool MDPCompLowRes::allocLayerPipes(hwc_context_t *ctx,
         hwc_layer_1_t* layer = &list->hwLayers[index];
         private_handle_t *hnd = (private_handle_t *)layer->handle;
 
-        if(isYuvBuffer(hnd))
+        if(isYuvBuffer(hnd) || currentFrame.isFBComposed[index])
             continue;
 
         PipeLayerPair& info = currentFrame.pipeLayer[index];
-        info.pipeInfo = new MdpPipeInfoLowRes;
+        info.pipeInfo = ctx->mFrameArena[dpy]->create<MdpPipeInfoLowRes>();
+        if(!info.pipeInfo)
+            return false;
         MdpPipeInfoLowRes& pipe_info = *(MdpPipeInfoLowRes*)info.pipeInfo;
 
-        pipe_info.index = getMdpPipe(ctx, MDPCOMP_OV_ANY);
+        //Least capable pipe first, DMA can't scale, see Overlay::nextPipe()
+        ePipeType type = MDPCOMP_OV_ANY;
+        if(!qhwc::needsScaling(layer) && !ctx->mDMAInUse
+                             && ctx->mMDP.version >= qdutils::MDSS_V5)
+            type = MDPCOMP_OV_DMA;
+
+        pipe_info.index = getMdpPipe(ctx, type);
         if(pipe_info.index == ovutils::OV_INVALID) {
             ALOGD_IF(isDebug(), "%s: Unable to get pipe for UI", __FUNCTION__);
             return false;
         }
-        pipe_info.zOrder = index;
+        pipe_info.zOrder = getMixerZ(ctx, list, currentFrame, index,
+                MIXER_LEFT);
     }
     return true;
 }
@@ -662,7 +1015,7 @@ bool MDPCompLowRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
                     using  pipe: %d", __FUNCTION__, layer,
                     hnd, dest );
 
-            if (!ov.queueBuffer(hnd->fd, hnd->offset, dest)) {
+            if (!ov.queueBuffer(hnd->fd, hnd->offset, dest, hnd)) {
                 ALOGE("%s: queueBuffer failed for external", __FUNCTION__);
                 return false;
             }
@@ -676,49 +1029,52 @@ bool MDPCompLowRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
 //=============MDPCompHighRes===================================================
 
 int MDPCompHighRes::pipesNeeded(hwc_context_t *ctx,
-                        hwc_display_contents_1_t* list) {
+                        hwc_display_contents_1_t* list,
+                        FrameInfo& frame) {
     const int dpy = HWC_DISPLAY_PRIMARY;
     int numAppLayers = ctx->listStats[dpy].numAppLayers;
-    int pipesNeeded = 0;
-
-    int hw_w = ctx->dpyAttr[dpy].xres;
+    int pipesNeeded = frame.fbCount ? fbPipesNeeded() : 0;
 
     for(int i = 0; i < numAppLayers; ++i) {
-        hwc_layer_1_t* layer = &list->hwLayers[i];
-        hwc_rect_t dst = layer->displayFrame;
-      if(dst.left > hw_w/2) {
-          pipesNeeded++;
-      } else if(dst.right <= hw_w/2) {
-          pipesNeeded++;
-      } else {
-          pipesNeeded += 2;
-      }
+        if(frame.isFBComposed[i])
+            continue;
+        int mixers = getLayerMixers(ctx, &list->hwLayers[i]);
+        if(mixers & MIXER_LEFT)
+            pipesNeeded++;
+        if(mixers & MIXER_RIGHT)
+            pipesNeeded++;
     }
     return pipesNeeded;
 }
 
+int MDPCompHighRes::getLayerMixers(hwc_context_t *ctx,
+        hwc_layer_1_t* layer) {
+    const int dpy = HWC_DISPLAY_PRIMARY;
+    int hw_w = ctx->dpyAttr[dpy].xres;
+    hwc_rect_t dst = layer->displayFrame;
+
+    if(dst.left >= hw_w/2)
+        return MIXER_RIGHT;
+    if(dst.right <= hw_w/2)
+        return MIXER_LEFT;
+    return MIXER_LEFT | MIXER_RIGHT;
+}
+
 bool MDPCompHighRes::acquireMDPPipes(hwc_context_t *ctx, hwc_layer_1_t* layer,
                         MdpPipeInfoHighRes& pipe_info, ePipeType type) {
-     const int dpy = HWC_DISPLAY_PRIMARY;
-     int hw_w = ctx->dpyAttr[dpy].xres;
+     int mixers = getLayerMixers(ctx, layer);
 
-     hwc_rect_t dst = layer->displayFrame;
-     if(dst.left > hw_w/2) {
-         pipe_info.lIndex = ovutils::OV_INVALID;
+     pipe_info.lIndex = ovutils::OV_INVALID;
+     pipe_info.rIndex = ovutils::OV_INVALID;
+     if(mixers & MIXER_RIGHT) {
          pipe_info.rIndex = getMdpPipe(ctx, type);
          if(pipe_info.rIndex == ovutils::OV_INVALID)
              return false;
-     } else if (dst.right <= hw_w/2) {
-         pipe_info.rIndex = ovutils::OV_INVALID;
+     }
+     if(mixers & MIXER_LEFT) {
          pipe_info.lIndex = getMdpPipe(ctx, type);
          if(pipe_info.lIndex == ovutils::OV_INVALID)
              return false;
-     } else {
-         pipe_info.rIndex = getMdpPipe(ctx, type);
-         pipe_info.lIndex = getMdpPipe(ctx, type);
-         if(pipe_info.rIndex == ovutils::OV_INVALID ||
-            pipe_info.lIndex == ovutils::OV_INVALID)
-             return false;
      }
      return true;
 }
@@ -731,17 +1087,23 @@ bool MDPCompHighRes::allocLayerPipes(hwc_context_t *ctx,
     int layer_count = ctx->listStats[dpy].numAppLayers;
 
     currentFrame.count = layer_count;
-    currentFrame.pipeLayer = (PipeLayerPair*)
-            malloc(sizeof(PipeLayerPair) * currentFrame.count);
+    currentFrame.pipeLayer =
+            ctx->mFrameArena[dpy]->create<PipeLayerPair>(currentFrame.count);
+    if(!currentFrame.pipeLayer)
+        return false;
 
     if(isYuvPresent(ctx, dpy)) {
         int nYuvCount = ctx->listStats[dpy].yuvCount;
 
         for(int index = 0; index < nYuvCount; index ++) {
             int nYuvIndex = ctx->listStats[dpy].yuvIndices[index];
+            if(currentFrame.isFBComposed[nYuvIndex])
+                continue;
             hwc_layer_1_t* layer = &list->hwLayers[nYuvIndex];
             PipeLayerPair& info = currentFrame.pipeLayer[nYuvIndex];
-            info.pipeInfo = new MdpPipeInfoHighRes;
+            info.pipeInfo = ctx->mFrameArena[dpy]->create<MdpPipeInfoHighRes>();
+            if(!info.pipeInfo)
+                return false;
             MdpPipeInfoHighRes& pipe_info = *(MdpPipeInfoHighRes*)info.pipeInfo;
             if(!acquireMDPPipes(ctx, layer, pipe_info,MDPCOMP_OV_VG)) {
                 ALOGD_IF(isDebug(),"%s: Unable to get pipe for videos",
@@ -749,7 +1111,10 @@ bool MDPCompHighRes::allocLayerPipes(hwc_context_t *ctx,
                 //TODO: windback pipebook data on fail
                 return false;
             }
-            pipe_info.zOrder = nYuvIndex;
+            pipe_info.zOrder = getMixerZ(ctx, list, currentFrame, nYuvIndex,
+                    MIXER_LEFT);
+            pipe_info.zOrderR = getMixerZ(ctx, list, currentFrame, nYuvIndex,
+                    MIXER_RIGHT);
         }
     }
 
@@ -757,11 +1122,13 @@ bool MDPCompHighRes::allocLayerPipes(hwc_context_t *ctx,
         hwc_layer_1_t* layer = &list->hwLayers[index];
         private_handle_t *hnd = (private_handle_t *)layer->handle;
 
-        if(isYuvBuffer(hnd))
+        if(isYuvBuffer(hnd) || currentFrame.isFBComposed[index])
             continue;
 
         PipeLayerPair& info = currentFrame.pipeLayer[index];
-        info.pipeInfo = new MdpPipeInfoHighRes;
+        info.pipeInfo = ctx->mFrameArena[dpy]->create<MdpPipeInfoHighRes>();
+        if(!info.pipeInfo)
+            return false;
         MdpPipeInfoHighRes& pipe_info = *(MdpPipeInfoHighRes*)info.pipeInfo;
 
         ePipeType type = MDPCOMP_OV_ANY;
@@ -775,7 +1142,10 @@ bool MDPCompHighRes::allocLayerPipes(hwc_context_t *ctx,
             //TODO: windback pipebook data on fail
             return false;
         }
-        pipe_info.zOrder = index;
+        pipe_info.zOrder = getMixerZ(ctx, list, currentFrame, index,
+                MIXER_LEFT);
+        pipe_info.zOrderR = getMixerZ(ctx, list, currentFrame, index,
+                MIXER_RIGHT);
     }
     return true;
 }
@@ -812,7 +1182,9 @@ int MDPCompHighRes::configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
         ALOGD_IF(isDebug(),"%s: Destination has negative coordinates",
                 __FUNCTION__);
         hwc_rect_t scissor = {0, 0, hw_w, hw_h };
-        qhwc::calculate_crop_rects(crop, dst, scissor, 0);
+        qhwc::calculate_crop_rects(crop, dst, scissor,
+                (layer->transform & HWC_TRANSFORM_ROT_90) ?
+                layer->transform : 0);
 
         //Update calulated width and height
         crop_w = crop.right - crop.left;
@@ -832,17 +1204,10 @@ int MDPCompHighRes::configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
     ovutils::eDest l_dest = mdp_info.lIndex;
     ovutils::eDest r_dest = mdp_info.rIndex;
 
-    ovutils::eZorder zOrder = ovutils::ZORDER_0;
-
-    if(mdp_info.zOrder == 0 ) {
-        zOrder = ovutils::ZORDER_0;
-    } else if(mdp_info.zOrder == 1 ) {
-        zOrder = ovutils::ZORDER_1;
-    } else if(mdp_info.zOrder == 2 ) {
-        zOrder = ovutils::ZORDER_2;
-    } else if(mdp_info.zOrder == 3) {
-        zOrder = ovutils::ZORDER_3;
-    }
+    //Each mixer stages its own share of the layers
+    ovutils::eZorder zOrderL = static_cast<ovutils::eZorder>(mdp_info.zOrder);
+    ovutils::eZorder zOrderR =
+            static_cast<ovutils::eZorder>(mdp_info.zOrderR);
 
     // Order order order
     // setSource - just setting source
@@ -886,22 +1251,27 @@ int MDPCompHighRes::configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
     hwc_rect_t tmp_cropL, tmp_dstL;
     hwc_rect_t tmp_cropR, tmp_dstR;
 
+    //A rotated layer is rotated whole by each pipe's rotator, so the
+    //source crop of each half follows the transform
+    bool rotated = (layer->transform & HWC_TRANSFORM_ROT_90);
+    int cropOrient = rotated ? layer->transform : 0;
+
     if(l_dest != ovutils::OV_INVALID) {
         tmp_cropL = crop;
         tmp_dstL = dst;
         hwc_rect_t scissor = {0, 0, hw_w/2, hw_h };
-        qhwc::calculate_crop_rects(tmp_cropL, tmp_dstL, scissor, 0);
+        qhwc::calculate_crop_rects(tmp_cropL, tmp_dstL, scissor, cropOrient);
     }
     if(r_dest != ovutils::OV_INVALID) {
         tmp_cropR = crop;
         tmp_dstR = dst;
         hwc_rect_t scissor = {hw_w/2, 0, hw_w, hw_h };
-        qhwc::calculate_crop_rects(tmp_cropR, tmp_dstR, scissor, 0);
+        qhwc::calculate_crop_rects(tmp_cropR, tmp_dstR, scissor, cropOrient);
     }
 
     //When buffer is flipped, contents of mixer config also needs to swapped.
     //Not needed if the layer is confined to one half of the screen.
-    if(layer->transform & HWC_TRANSFORM_FLIP_V &&
+    if(!rotated && layer->transform & HWC_TRANSFORM_FLIP_V &&
        l_dest != ovutils::OV_INVALID  && r_dest != ovutils::OV_INVALID ) {
         hwc_rect_t new_cropR;
         new_cropR.left = tmp_cropL.left;
@@ -930,7 +1300,7 @@ int MDPCompHighRes::configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
     if(l_dest != ovutils::OV_INVALID) {
         ovutils::PipeArgs pargL(mdpFlagsL,
                                 info,
-                                zOrder,
+                                zOrderL,
                                 ovutils::IS_FG_OFF,
                                 ovutils::ROT_FLAGS_NONE);
 
@@ -961,7 +1331,7 @@ int MDPCompHighRes::configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
     if(r_dest != ovutils::OV_INVALID) {
         ovutils::PipeArgs pargR(mdpFlagsR,
                                 info,
-                                zOrder,
+                                zOrderR,
                                 ovutils::IS_FG_OFF,
                                 ovutils::ROT_FLAGS_NONE);
 
@@ -980,7 +1350,7 @@ int MDPCompHighRes::configure(hwc_context_t *ctx, hwc_layer_1_t *layer,
                  crop[%d,%d,%d,%d] dst[%d,%d,%d,%d] pipeIndexR: %d zorder: %d",
                  __FUNCTION__, dcropR.x, dcropR.y,dcropR.w, dcropR.h,
                  dimR.x, dimR.y, dimR.w, dimR.h,
-                 mdp_info.rIndex, mdp_info.zOrder);
+                 mdp_info.rIndex, mdp_info.zOrderR);
 
         if (!ov.commit(r_dest)) {
             ALOGE("%s: commit failed for right mixer config", __FUNCTION__);
@@ -1038,7 +1408,7 @@ bool MDPCompHighRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
                 ALOGD_IF(isDebug(),"%s: MDP Comp: Drawing layer: %p hnd: %p \
                         using  pipe: %d", __FUNCTION__, layer, hnd, indexL );
 
-                if (!ov.queueBuffer(hnd->fd, hnd->offset, destL)) {
+                if (!ov.queueBuffer(hnd->fd, hnd->offset, destL, hnd)) {
                     ALOGE("%s: queueBuffer failed for external", __FUNCTION__);
                     return false;
                 }
@@ -1058,7 +1428,7 @@ bool MDPCompHighRes::draw(hwc_context_t *ctx, hwc_display_contents_1_t* list) {
                 ALOGD_IF(isDebug(),"%s: MDP Comp: Drawing layer: %p hnd: %p \
                         using  pipe: %d", __FUNCTION__, layer, hnd, indexR );
 
-                if (!ov.queueBuffer(hnd->fd, hnd->offset, destR)) {
+                if (!ov.queueBuffer(hnd->fd, hnd->offset, destR, hnd)) {
                     ALOGE("%s: queueBuffer failed for external", __FUNCTION__);
                     return false;
                 }
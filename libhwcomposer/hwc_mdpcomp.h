@@ -26,7 +26,13 @@
 #include <overlay.h>
 
 #define DEFAULT_IDLE_TIME 2000
+/* Shortest idle time, for static screens after fast animations */
+#define DEFAULT_MIN_IDLE_TIME 100
 #define MAX_PIPES_PER_MIXER 4
+/* Frames without a buffer update before a layer is considered static */
+#define MIXED_MODE_STATIC_FRAMES 8
+/* Rotator throughput, in megapixels a second, shared by all MDP layers */
+#define DEFAULT_ROT_MPPS 240
 
 namespace qhwc {
 namespace ovutils = overlay::utils;
@@ -42,10 +48,19 @@ public:
 
     void dump(android::String8& buf);
     bool isUsed() { return (mState == MDPCOMP_ON); };
+    /* checks if the last frame's setup still holds for the list */
+    bool canReuse(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* keeps the last frame's setup for the list */
+    void reuse(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* VG pipes MDP composition will ask for the video layers of the list,
+     * before the list stats are set */
+    int getVgDemand(hwc_context_t *ctx, hwc_display_contents_1_t* list);
 
     static MDPComp* getObject(const int& width);
     /* Handler to invoke frame redraw on Idle Timer expiry */
     static void timeout_handler(void *udata);
+    /* Event loop handler of the idle timer */
+    static void idle_event(void *data, uint32_t events);
     static bool init(hwc_context_t *ctx);
 
 protected:
@@ -54,6 +69,11 @@ protected:
         MDPCOMP_OFF,
     };
 
+    enum {
+        MIXER_LEFT = 0x1,
+        MIXER_RIGHT = 0x2,
+    };
+
     enum ePipeType {
         MDPCOMP_OV_RGB = ovutils::OV_MDP_PIPE_RGB,
         MDPCOMP_OV_VG = ovutils::OV_MDP_PIPE_VG,
@@ -73,11 +93,29 @@ protected:
     struct FrameInfo {
         int count;
         struct PipeLayerPair* pipeLayer;
+        /* layers left for GPU composition into the FB target */
+        bool isFBComposed[MAX_NUM_LAYERS];
+        int fbCount;
+        int mdpCount;
+        /* z-order of the FB target and of each MDP composed layer */
+        int fbZ;
+        int layerZ[MAX_NUM_LAYERS];
     };
 
-    /* calculates pipes needed for the panel */
+    /* per layer buffer update history, used to pick mixed mode layers */
+    struct LayerHistory {
+        int numLayers;
+        buffer_handle_t hnd[MAX_NUM_LAYERS];
+        /* one bit per frame, LSB is the latest frame */
+        uint32_t updates[MAX_NUM_LAYERS];
+    };
+
+    /* calculates pipes needed for the MDP composed layers and the FB */
     virtual int pipesNeeded(hwc_context_t *ctx,
-                            hwc_display_contents_1_t* list) = 0;
+                            hwc_display_contents_1_t* list,
+                            FrameInfo& frame) = 0;
+    /* pipes consumed by the FB target in mixed mode */
+    virtual int fbPipesNeeded() { return 1; };
     /* allocates pipe from pipe book */
     virtual bool allocLayerPipes(hwc_context_t *ctx,
                 hwc_display_contents_1_t* list,FrameInfo& current_frame) = 0;
@@ -86,6 +124,23 @@ protected:
                         MdpPipeInfo* mdp_info) = 0;
     /* Is rotation supported */
     virtual bool canRotate(){ return true; };
+    /* mixers a layer is staged on, MIXER_LEFT for single mixer panels */
+    virtual int getLayerMixers(hwc_context_t *ctx, hwc_layer_1_t* layer) {
+        return MIXER_LEFT;
+    };
+    /* number of layer mixers driving the panel */
+    virtual int numMixers() { return 1; };
+    /* z-order of a MDP layer, or of the FB target for index -1, among
+     * what is staged on one of the mixers */
+    int getMixerZ(hwc_context_t *ctx, hwc_display_contents_1_t* list,
+            FrameInfo& frame, int index, int mixer);
+    /* checks each mixer has the blend stages for its share of layers */
+    bool isStagingDoable(hwc_context_t *ctx,
+            hwc_display_contents_1_t* list, FrameInfo& frame);
+    /* checks the MDP layers needing 90/270 rotation fit in the rotator
+     * budget of a frame. Rotated RGB layers are only admitted within it */
+    bool isRotationDoable(hwc_context_t *ctx,
+            hwc_display_contents_1_t* list, FrameInfo& frame);
 
 
     /* set/reset flags for MDPComp */
@@ -101,8 +156,26 @@ protected:
     void setVidInfo(hwc_layer_1_t *layer, ovutils::eMdpFlags &mdpFlags);
     /* allocate MDP pipes from overlay */
     ovutils::eDest getMdpPipe(hwc_context_t *ctx, ePipeType type);
-    /* checks for conditions where mdpcomp is not possible */
-    bool isDoable(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* checks for frame level conditions where mdpcomp is not possible */
+    bool isFrameDoable(hwc_context_t *ctx);
+    /* checks if a single layer can be composed by MDP */
+    bool isLayerDoable(hwc_context_t *ctx, hwc_layer_1_t* layer);
+    /* checks if all layers can be composed by MDP */
+    bool isFullFrameDoable(hwc_context_t *ctx,
+            hwc_display_contents_1_t* list);
+    /* picks a contiguous batch of layers for GPU and the rest for MDP */
+    bool setupMixedFrame(hwc_context_t *ctx, hwc_display_contents_1_t* list);
+    /* marks layers [fbStart, fbEnd] for GPU, -1 for full MDP */
+    void markFrame(hwc_context_t *ctx, int fbStart, int fbEnd);
+    /* records which layer buffers changed in this frame */
+    void updateLayerHistory(hwc_context_t *ctx,
+            hwc_display_contents_1_t* list);
+    /* weight of a layer for MDP placement, higher for frequently updating
+     * layers and video */
+    int getUpdateWeight(hwc_display_contents_1_t* list, int index);
+    /* mask of layers with no recent buffer update, counting the list's
+     * handles as the next frame if lookAhead is set */
+    uint32_t getStaticMask(hwc_display_contents_1_t* list, bool lookAhead);
     /* sets up MDP comp for current frame */
     bool setup(hwc_context_t* ctx, hwc_display_contents_1_t* list);
     /* set up Border fill as Base pipe */
@@ -111,16 +184,27 @@ protected:
     static bool isDebug() { return sDebugLogs ? true : false; };
     /* Is feature enabled */
     static bool isEnabled() { return sEnabled; };
+    /* Is mixed mode enabled */
+    static bool isMixedModeEnabled() { return sEnableMixedMode; };
     /* checks for mdp comp width limitation */
     bool isWidthValid(hwc_context_t *ctx, hwc_layer_1_t *layer);
 
     eState mState;
+    /* false if the last frame was decided by transient conditions */
+    bool mReusable;
+    uint32_t mStaticMask;
+    /* pixels the rotator processes for the current frame */
+    uint32_t mRotPixels;
 
     static bool sEnabled;
+    static bool sEnableMixedMode;
     static bool sDebugLogs;
     static bool sIdleFallBack;
     static IdleInvalidator *idleInvalidator;
+    /* pixels the rotator can process within a frame */
+    static uint32_t sRotBudget;
     struct FrameInfo mCurrentFrame;
+    struct LayerHistory mLayerHistory;
 };
 
 class MDPCompLowRes : public MDPComp {
@@ -144,7 +228,8 @@ private:
             FrameInfo& current_frame);
 
     virtual int pipesNeeded(hwc_context_t *ctx,
-                        hwc_display_contents_1_t* list);
+                        hwc_display_contents_1_t* list,
+                        FrameInfo& frame);
 };
 
 class MDPCompHighRes : public MDPComp {
@@ -155,6 +240,8 @@ private:
     struct MdpPipeInfoHighRes : public MdpPipeInfo {
         ovutils::eDest lIndex;
         ovutils::eDest rIndex;
+        /* zOrder is the left mixer's */
+        int zOrderR;
         virtual ~MdpPipeInfoHighRes() {};
     };
 
@@ -170,8 +257,12 @@ private:
             hwc_display_contents_1_t* list,
             FrameInfo& current_frame);
 
-    virtual int pipesNeeded(hwc_context_t *ctx, hwc_display_contents_1_t* list);
-    virtual bool canRotate(){ return false; };
+    virtual int pipesNeeded(hwc_context_t *ctx, hwc_display_contents_1_t* list,
+                        FrameInfo& frame);
+    virtual int fbPipesNeeded() { return 2; };
+    /* a layer takes a pipe on each half of the panel it covers */
+    virtual int getLayerMixers(hwc_context_t *ctx, hwc_layer_1_t* layer);
+    virtual int numMixers() { return 2; };
 };
 }; //namespace
 #endif
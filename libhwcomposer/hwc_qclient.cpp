@@ -30,6 +30,8 @@
 #include <hwc_qclient.h>
 #include <IQService.h>
 #include <hwc_utils.h>
+#include <display_config.h>
+#include <ioctl_stats.h>
 
 #define QCLIENT_DEBUG 0
 
@@ -65,6 +67,12 @@ status_t QClient::notifyCallback(uint32_t msg, uint32_t value) {
         case IQService::SCREEN_REFRESH:
             return screenRefresh();
             break;
+        case IQService::INVALIDATE_CONFIG:
+            invalidateConfig();
+            break;
+        case IQService::RESET_IOCTL_STATS:
+            qdutils::IoctlStats::reset();
+            break;
         default:
             return NO_ERROR;
     }
@@ -97,6 +105,13 @@ void QClient::MPDeathNotifier::died() {
         mHwcContext->proc->invalidate(mHwcContext->proc);
 }
 
+void QClient::invalidateConfig() {
+    qdutils::DisplayConfig::getInstance().reload();
+    //Redraw so that the new values take effect
+    if(mHwcContext->proc)
+        mHwcContext->proc->invalidate(mHwcContext->proc);
+}
+
 android::status_t QClient::screenRefresh() {
     status_t result = NO_INIT;
 #ifdef QCOM_BSP
@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define HWC_TRACE_DEBUG 0
+#include <fcntl.h>
+#include <unistd.h>
+#include <cutils/properties.h>
+#include <utils/Timers.h>
+#include <overlay.h>
+#include <mdpWrapper.h>
+#include "hwc_trace.h"
+#include "hwc_worker.h"
+
+namespace qhwc {
+
+namespace mdpwrap = overlay::mdp_wrapper;
+
+static const char* const strategyName[] = {
+    "GPU", "MDPCOMP", "VIDEO", "COPYBIT", "CACHE"
+};
+
+static const char* const pathName[] = {
+    "liststats", "mdpcomp", "video", "fbupdate", "copybit"
+};
+
+FrameTrace::FrameTrace() : mRecording(false), mFd(-1), mWriter(0), mFill(0),
+        mUsed(0), mWriteLen(0), mWriteLast(false), mWriteError(0),
+        mDropped(0), mFrame(0), mMaxFrames(HWC_TRACE_DEFAULT_FRAMES),
+        mStart(0), mIoctlStart(0), mLastPipes(0) {
+    pthread_mutex_init(&mLock, NULL);
+    mBuf[0] = mBuf[1] = NULL;
+    memset(mStats, 0, sizeof(mStats));
+    memset(mLastDpyPipes, 0, sizeof(mLastDpyPipes));
+    memset(mLastStrategy, 0, sizeof(mLastStrategy));
+    memset(mStrategyCount, 0, sizeof(mStrategyCount));
+    memset(mStrategyPipes, 0, sizeof(mStrategyPipes));
+    memset(mPathStats, 0, sizeof(mPathStats));
+
+    char property[PROPERTY_VALUE_MAX];
+    if(property_get("debug.hwc.trace", property, NULL) > 0 &&
+            atoi(property) == 1) {
+        char path[PROPERTY_VALUE_MAX];
+        property_get("debug.hwc.trace.path", path,
+                "/data/misc/display/hwc_trace.bin");
+        if(property_get("debug.hwc.trace.frames", property, NULL) > 0)
+            mMaxFrames = atoi(property);
+        mFd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(mFd < 0) {
+            ALOGE("%s: Unable to open %s err=%s", __FUNCTION__, path,
+                    strerror(errno));
+            return;
+        }
+        mWriter = new Worker("hwcTraceWriter", false);
+        if(!mWriter->isRunning()) {
+            ALOGE("%s: No writer thread, not recording", __FUNCTION__);
+            delete mWriter;
+            mWriter = NULL;
+            close(mFd);
+            mFd = -1;
+            return;
+        }
+        mBuf[0] = new char[HWC_TRACE_BUF_SIZE];
+        mBuf[1] = new char[HWC_TRACE_BUF_SIZE];
+        mRecording = true;
+        ALOGI("%s: Recording %d frames to %s", __FUNCTION__,
+                mMaxFrames, path);
+    }
+}
+
+FrameTrace::~FrameTrace() {
+    if(mRecording)
+        stop();
+    delete mWriter;
+    delete [] mBuf[0];
+    delete [] mBuf[1];
+    pthread_mutex_destroy(&mLock);
+}
+
+void FrameTrace::prepareBegin() {
+    mStart = systemTime();
+    mIoctlStart = mdpwrap::getIoctlCount();
+}
+
+void FrameTrace::prepareEnd(hwc_context_t *ctx, size_t numDisplays,
+        hwc_display_contents_1_t** displays) {
+    end(ctx, TRACE_PHASE_PREPARE, numDisplays, displays);
+}
+
+void FrameTrace::setBegin() {
+    mStart = systemTime();
+    mIoctlStart = mdpwrap::getIoctlCount();
+}
+
+void FrameTrace::setEnd(hwc_context_t *ctx, size_t numDisplays,
+        hwc_display_contents_1_t** displays) {
+    end(ctx, TRACE_PHASE_SET, numDisplays, displays);
+}
+
+void FrameTrace::end(hwc_context_t *ctx, int phase, size_t numDisplays,
+        hwc_display_contents_1_t** displays) {
+    int64_t latency = systemTime() - mStart;
+    uint32_t ioctls = mdpwrap::getIoctlCount() - mIoctlStart;
+    pthread_mutex_lock(&mLock);
+    PhaseStats& stats = mStats[phase];
+    stats.count++;
+    stats.lastNs = latency;
+    stats.totalNs += latency;
+    if(latency > stats.maxNs)
+        stats.maxNs = latency;
+    stats.lastIoctls = ioctls;
+    stats.totalIoctls += ioctls;
+
+    //The strategy is final only once prepare is done
+    if(phase == TRACE_PHASE_PREPARE) {
+        mLastPipes = ctx->mOverlay->usedPipes();
+        for(uint32_t i = 0; i < numDisplays && i < MAX_DISPLAYS; i++) {
+            mLastDpyPipes[i] = ctx->mOverlay->usedPipes(i);
+            mLastStrategy[i] = getStrategy(ctx, displays[i], i);
+            for(int j = 0; j < HWC_TRACE_NUM_STRATEGIES; j++) {
+                if(mLastStrategy[i] & (1 << j)) {
+                    mStrategyCount[i][j]++;
+                    mStrategyPipes[i][j] += mLastDpyPipes[i];
+                }
+            }
+        }
+    }
+
+    if(mRecording) {
+        for(uint32_t i = 0; i < numDisplays && i < MAX_DISPLAYS; i++) {
+            if(displays[i])
+                record(phase, i, latency, ioctls, mLastDpyPipes[i],
+                        mLastStrategy[i], displays[i]);
+        }
+    }
+
+    if(phase == TRACE_PHASE_SET)
+        mFrame++;
+    //Waits once, at the end, for the writer to drain
+    if(mRecording && mFrame >= mMaxFrames) {
+        stop();
+        ALOGI("%s: Trace complete, %d frames, %u records dropped",
+                __FUNCTION__, mFrame, mDropped);
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+bool FrameTrace::flush(bool last) {
+    if(mWriter->isBusy())
+        return false;
+    //Completes the previous post, done by now
+    mWriter->wait();
+    if(mWriteError) {
+        ALOGE("%s: write failed err=%s, stopping trace", __FUNCTION__,
+                strerror(mWriteError));
+        mRecording = false;
+        return false;
+    }
+    mWriteLen = mUsed;
+    mWriteLast = last;
+    mFill ^= 1;
+    mUsed = 0;
+    mWriter->post(writeJob, this);
+    return true;
+}
+
+void FrameTrace::stop() {
+    mWriter->wait();
+    flush(true);
+    mWriter->wait();
+    mRecording = false;
+}
+
+void FrameTrace::writeJob(void *data) {
+    FrameTrace *self = (FrameTrace *)data;
+    const char *buf = self->mBuf[self->mFill ^ 1];
+    size_t done = 0;
+    while(done < self->mWriteLen) {
+        ssize_t ret = write(self->mFd, buf + done, self->mWriteLen - done);
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0) {
+            self->mWriteError = (ret < 0) ? errno : EIO;
+            break;
+        }
+        done += ret;
+    }
+    if(self->mWriteError || self->mWriteLast) {
+        close(self->mFd);
+        self->mFd = -1;
+    }
+}
+
+int64_t FrameTrace::pathDone(int dpy, int path, int64_t start) {
+    int64_t now = systemTime();
+    if(dpy < 0 || dpy >= MAX_DISPLAYS)
+        return now;
+    pthread_mutex_lock(&mLock);
+    PathStats& stats = mPathStats[dpy][path];
+    int64_t ns = now - start;
+    stats.count++;
+    stats.lastNs = ns;
+    stats.totalNs += ns;
+    if(ns > stats.maxNs)
+        stats.maxNs = ns;
+    pthread_mutex_unlock(&mLock);
+    return now;
+}
+
+uint32_t FrameTrace::getLastStrategy(int dpy) {
+    if(dpy < 0 || dpy >= MAX_DISPLAYS)
+        return 0;
+    pthread_mutex_lock(&mLock);
+    uint32_t strategy = mLastStrategy[dpy];
+    pthread_mutex_unlock(&mLock);
+    return strategy;
+}
+
+uint32_t FrameTrace::getLastPipes(int dpy) {
+    if(dpy < 0 || dpy >= MAX_DISPLAYS)
+        return 0;
+    pthread_mutex_lock(&mLock);
+    uint32_t pipes = mLastDpyPipes[dpy];
+    pthread_mutex_unlock(&mLock);
+    return pipes;
+}
+
+void FrameTrace::getPathStats(int dpy, int path, uint32_t& count,
+        int64_t& totalNs) {
+    count = 0;
+    totalNs = 0;
+    if(dpy < 0 || dpy >= MAX_DISPLAYS || path < 0 || path >= TRACE_PATH_MAX)
+        return;
+    pthread_mutex_lock(&mLock);
+    count = mPathStats[dpy][path].count;
+    totalNs = mPathStats[dpy][path].totalNs;
+    pthread_mutex_unlock(&mLock);
+}
+
+void FrameTrace::resetStats() {
+    pthread_mutex_lock(&mLock);
+    memset(mStats, 0, sizeof(mStats));
+    memset(mStrategyCount, 0, sizeof(mStrategyCount));
+    memset(mStrategyPipes, 0, sizeof(mStrategyPipes));
+    memset(mPathStats, 0, sizeof(mPathStats));
+    pthread_mutex_unlock(&mLock);
+}
+
+const char *FrameTrace::getStrategyName(int index) {
+    if(index < 0 || index >= HWC_TRACE_NUM_STRATEGIES)
+        return "?";
+    return strategyName[index];
+}
+
+uint32_t FrameTrace::getStrategy(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list, int dpy) {
+    uint32_t strategy = 0;
+    if(!list || list->numHwLayers <= 1)
+        return strategy;
+
+    LayerProp *layerProp = ctx->layerProp[dpy];
+    int numAppLayers = ctx->listStats[dpy].numAppLayers;
+    for(int i = 0; i < numAppLayers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        uint32_t flags = layerProp ? layerProp[i].mFlags : 0;
+        if(flags & HWC_MDPCOMP) {
+            strategy |= TRACE_STRATEGY_MDPCOMP;
+        } else if(flags & HWC_COPYBIT) {
+            strategy |= TRACE_STRATEGY_COPYBIT;
+        } else if(layer->compositionType == HWC_OVERLAY) {
+            if(isYuvBuffer((private_handle_t *)layer->handle))
+                strategy |= TRACE_STRATEGY_VIDEO;
+            else
+                strategy |= TRACE_STRATEGY_CACHE;
+        } else {
+            strategy |= TRACE_STRATEGY_GPU;
+        }
+    }
+    return strategy;
+}
+
+void FrameTrace::record(int phase, int dpy, int64_t latency, uint32_t ioctls,
+        uint32_t pipes, uint32_t strategy, hwc_display_contents_1_t* list) {
+    //A failed write stops the trace midway through a frame
+    if(!mRecording)
+        return;
+    uint32_t numHwLayers = min(list->numHwLayers, (size_t)MAX_NUM_LAYERS);
+    size_t len = sizeof(TraceRecord) + numHwLayers * sizeof(TraceLayer);
+    if(mUsed + len > HWC_TRACE_BUF_SIZE && !flush(false)) {
+        if(mRecording)
+            mDropped++;
+        return;
+    }
+    char *buf = mBuf[mFill] + mUsed;
+
+    //Copied in, as records after an odd number of layers are not 8 byte
+    //aligned
+    TraceRecord rec;
+    memset(&rec, 0, sizeof(TraceRecord));
+    rec.magic = HWC_TRACE_MAGIC;
+    rec.version = HWC_TRACE_VERSION;
+    rec.phase = phase;
+    rec.frame = mFrame;
+    rec.dpy = dpy;
+    rec.timestamp = mStart;
+    rec.latency = latency;
+    rec.listFlags = list->flags;
+    rec.numHwLayers = numHwLayers;
+    rec.strategy = strategy;
+    rec.ioctls = ioctls;
+    rec.pipes = pipes;
+    memcpy(buf, &rec, sizeof(TraceRecord));
+
+    TraceLayer *tl = (TraceLayer *)(buf + sizeof(TraceRecord));
+    for(uint32_t i = 0; i < numHwLayers; i++, tl++) {
+        const hwc_layer_1_t *layer = &list->hwLayers[i];
+        const private_handle_t *hnd = (const private_handle_t *)layer->handle;
+        memset(tl, 0, sizeof(TraceLayer));
+        tl->handleId = (uint32_t)(uintptr_t)layer->handle;
+        if(hnd) {
+            tl->format = hnd->format;
+            tl->width = hnd->width;
+            tl->height = hnd->height;
+            tl->size = hnd->size;
+            tl->bufferType = hnd->bufferType;
+            tl->handleFlags = hnd->flags;
+        }
+        tl->sourceCrop = layer->sourceCrop;
+        tl->displayFrame = layer->displayFrame;
+        tl->compositionType = layer->compositionType;
+        tl->hints = layer->hints;
+        tl->flags = layer->flags;
+        tl->transform = layer->transform;
+        tl->blending = layer->blending;
+        tl->numVisibleRects = layer->visibleRegionScreen.numRects;
+        tl->acquireFence = (layer->acquireFenceFd >= 0) ? 1 : 0;
+    }
+
+    mUsed += len;
+}
+
+void FrameTrace::dump(android::String8& buf) {
+    static const char* const phaseName[] = { "prepare", "set" };
+    pthread_mutex_lock(&mLock);
+    //Gets the file up to date for whoever pulls it next
+    if(mRecording)
+        flush(false);
+    dumpsys_log(buf, "Frame stats (%s, frame=%u, dropped=%u):\n",
+            mRecording ? "recording" : "not recording", mFrame, mDropped);
+    for(int i = 0; i < TRACE_PHASE_MAX; i++) {
+        const PhaseStats& stats = mStats[i];
+        if(!stats.count)
+            continue;
+        dumpsys_log(buf, "  %-8s last=%lldus avg=%lldus max=%lldus "
+                "ioctls last=%u avg=%u\n", phaseName[i],
+                ns2us(stats.lastNs), ns2us(stats.totalNs / stats.count),
+                ns2us(stats.maxNs), stats.lastIoctls,
+                stats.totalIoctls / stats.count);
+    }
+    dumpsys_log(buf, "  pipes used=%u\n", mLastPipes);
+    for(int i = 0; i < MAX_DISPLAYS; i++) {
+        dumpsys_log(buf, "  dpy=%d strategy:", i);
+        for(int j = 0; j < HWC_TRACE_NUM_STRATEGIES; j++) {
+            dumpsys_log(buf, " %s%s=%u", strategyName[j],
+                    (mLastStrategy[i] & (1 << j)) ? "*" : "",
+                    mStrategyCount[i][j]);
+        }
+        dumpsys_log(buf, "\n");
+        dumpsys_log(buf, "    avg pipes:");
+        for(int j = 0; j < HWC_TRACE_NUM_STRATEGIES; j++) {
+            const uint32_t count = mStrategyCount[i][j];
+            dumpsys_log(buf, " %s=%u.%02u", strategyName[j],
+                    count ? mStrategyPipes[i][j] / count : 0,
+                    count ? mStrategyPipes[i][j] * 100 / count % 100 : 0);
+        }
+        dumpsys_log(buf, "\n");
+        for(int j = 0; j < TRACE_PATH_MAX; j++) {
+            const PathStats& stats = mPathStats[i][j];
+            if(!stats.count)
+                continue;
+            dumpsys_log(buf, "    %-9s last=%lldns avg=%lldns max=%lldns "
+                    "calls=%u\n", pathName[j], stats.lastNs,
+                    stats.totalNs / stats.count, stats.maxNs, stats.count);
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+}; //namespace qhwc
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HWC_TRACE_H
+#define HWC_TRACE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "hwc_utils.h"
+
+#define HWC_TRACE_MAGIC 0x54435748 //"HWCT"
+#define HWC_TRACE_VERSION 1
+#define HWC_TRACE_DEFAULT_FRAMES 1800
+#define HWC_TRACE_NUM_STRATEGIES 5
+//Records are staged in two buffers of this size, one filling while the
+//other is written out
+#define HWC_TRACE_BUF_SIZE (64 * 1024)
+
+namespace qhwc {
+
+class Worker;
+
+// Composition strategy picked for a display, recorded as a bitmask since
+// a frame can mix e.g. video overlay with copybit
+enum {
+    TRACE_STRATEGY_GPU      = 0x00000001,
+    TRACE_STRATEGY_MDPCOMP  = 0x00000002,
+    TRACE_STRATEGY_VIDEO    = 0x00000004,
+    TRACE_STRATEGY_COPYBIT  = 0x00000008,
+    TRACE_STRATEGY_CACHE    = 0x00000010,
+};
+
+// Decision paths of prepare, timed per display
+enum {
+    TRACE_PATH_LISTSTATS = 0,
+    TRACE_PATH_MDPCOMP,
+    TRACE_PATH_VIDEO,
+    TRACE_PATH_FBUPDATE,
+    TRACE_PATH_COPYBIT,
+    TRACE_PATH_MAX,
+};
+
+enum {
+    TRACE_PHASE_PREPARE = 0,
+    TRACE_PHASE_SET,
+    TRACE_PHASE_MAX,
+};
+
+// On-disk layout. One record per display per phase, followed by
+// numHwLayers TraceLayer entries. All fields are host endian.
+struct TraceRecord {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t phase;
+    uint32_t frame;
+    uint32_t dpy;
+    int64_t timestamp;  //nanos, CLOCK_MONOTONIC
+    int64_t latency;    //nanos spent in prepare/set for all displays
+    uint32_t listFlags;
+    uint32_t numHwLayers;
+    uint32_t strategy;
+    uint32_t ioctls;    //overlay ioctls issued during this phase
+    uint32_t pipes;     //pipes committed in the current round
+    uint32_t reserved;
+};
+
+struct TraceLayer {
+    uint32_t handleId;  //identity of the buffer, not a dereferenceable value
+    int32_t format;
+    int32_t width;
+    int32_t height;
+    uint32_t size;
+    uint32_t bufferType;
+    uint32_t handleFlags;
+    hwc_rect_t sourceCrop;
+    hwc_rect_t displayFrame;
+    uint32_t compositionType;
+    uint32_t hints;
+    uint32_t flags;
+    uint32_t transform;
+    uint32_t blending;
+    uint32_t numVisibleRects;
+    int32_t acquireFence; //1 if a fence was attached, 0 otherwise
+};
+
+// Records the lists that reach prepare/set in a binary trace (enabled with
+// debug.hwc.trace) and keeps per frame statistics for dumpsys. Records are
+// buffered in memory and written out by a background thread; if it falls
+// behind, records are dropped rather than stalling the composer.
+class FrameTrace {
+public:
+    FrameTrace();
+    ~FrameTrace();
+    void prepareBegin();
+    void prepareEnd(hwc_context_t *ctx, size_t numDisplays,
+            hwc_display_contents_1_t** displays);
+    void setBegin();
+    void setEnd(hwc_context_t *ctx, size_t numDisplays,
+            hwc_display_contents_1_t** displays);
+    /* Accounts the time since "start" to a decision path of a display and
+     * returns the current time, to start the next path with. Displays
+     * prepared in parallel have stats of their own */
+    int64_t pathDone(int dpy, int path, int64_t start);
+    void dump(android::String8& buf);
+    /* Outcome of the last prepare of a display, for the replay tool */
+    uint32_t getLastStrategy(int dpy);
+    uint32_t getLastPipes(int dpy);
+    /* Name of bit "index" of a strategy mask */
+    static const char *getStrategyName(int index);
+    /* Calls to a decision path of a display and the time they took, for
+     * the benchmark */
+    void getPathStats(int dpy, int path, uint32_t& count, int64_t& totalNs);
+    /* Starts the stats over, leaving a recording as it is */
+    void resetStats();
+
+private:
+    struct PhaseStats {
+        uint32_t count;
+        int64_t lastNs;
+        int64_t maxNs;
+        int64_t totalNs;
+        uint32_t lastIoctls;
+        uint32_t totalIoctls;
+    };
+
+    struct PathStats {
+        uint32_t count;
+        int64_t lastNs;
+        int64_t maxNs;
+        int64_t totalNs;
+    };
+
+    void end(hwc_context_t *ctx, int phase, size_t numDisplays,
+            hwc_display_contents_1_t** displays);
+    uint32_t getStrategy(hwc_context_t *ctx,
+            hwc_display_contents_1_t* list, int dpy);
+    void record(int phase, int dpy, int64_t latency, uint32_t ioctls,
+            uint32_t pipes, uint32_t strategy,
+            hwc_display_contents_1_t* list);
+    /* Hands the filled buffer to the writer. Returns false, without
+     * blocking, if the writer is still busy with the other one */
+    bool flush(bool last);
+    void stop();
+    static void writeJob(void *data);
+
+    //Guards the stats against dump, and pathDone of parallel displays
+    pthread_mutex_t mLock;
+    bool mRecording;
+    int mFd; //Owned by the writer while recording
+    Worker *mWriter;
+    char *mBuf[2];
+    int mFill;        //Buffer being filled
+    size_t mUsed;
+    size_t mWriteLen; //Bytes of the other buffer the writer is to write
+    bool mWriteLast;  //Writer closes mFd once done
+    int mWriteError;  //errno of a failed write, set by the writer
+    uint32_t mDropped;
+    uint32_t mFrame;
+    uint32_t mMaxFrames;
+    int64_t mStart;
+    int32_t mIoctlStart;
+    PhaseStats mStats[TRACE_PHASE_MAX];
+    uint32_t mLastPipes;
+    uint32_t mLastDpyPipes[MAX_DISPLAYS];
+    uint32_t mLastStrategy[MAX_DISPLAYS];
+    uint32_t mStrategyCount[MAX_DISPLAYS][HWC_TRACE_NUM_STRATEGIES];
+    //Pipes in use summed over the frames of each strategy
+    uint32_t mStrategyPipes[MAX_DISPLAYS][HWC_TRACE_NUM_STRATEGIES];
+    PathStats mPathStats[MAX_DISPLAYS][TRACE_PATH_MAX];
+};
+
+}; //namespace qhwc
+
+#endif //HWC_TRACE_H
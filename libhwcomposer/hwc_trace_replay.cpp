@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Replays a frame trace (see FrameTrace) through the composer's prepare and
+// set, against the fake MDP backend, and reports per frame what the HAL
+// does now next to what was recorded.
+//   hwc_trace_replay [-c <fake config>] [-n <frames>] [-d] <trace>
+// The fake config is the tail of a "fake" debug.qdutils.ioctl setting, e.g.
+// ":1080x1920:500:8", and should match the device the trace came from.
+
+#define HWC_REPLAY_DEBUG 0
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cutils/properties.h>
+#include <utils/Timers.h>
+#include <ioctl_backend.h>
+#include <mdpWrapper.h>
+#include "hwc_utils.h"
+#include "hwc_trace.h"
+#include "hwc_fake.h"
+
+using namespace qhwc;
+namespace mdpwrap = overlay::mdp_wrapper;
+
+// The records of one frame; the lists are rebuilt from those of prepare
+struct TraceFrame {
+    uint32_t frame;
+    bool present[MAX_DISPLAYS];
+    TraceRecord prepare[MAX_DISPLAYS];
+    TraceLayer layers[MAX_DISPLAYS][MAX_NUM_LAYERS];
+    bool hasSet;
+    TraceRecord set;
+};
+
+class TraceReader {
+public:
+    TraceReader() : mFp(0), mHaveNext(false), mOffset(0) {}
+    ~TraceReader() { if(mFp) fclose(mFp); }
+    bool open(const char *path);
+    /* Returns false at the end of the trace, or on a damaged record */
+    bool readFrame(TraceFrame& frame);
+
+private:
+    bool readRecord();
+
+    FILE *mFp;
+    //The first record of the next frame, read ahead
+    bool mHaveNext;
+    TraceRecord mNext;
+    TraceLayer mNextLayers[MAX_NUM_LAYERS];
+    long mOffset;
+};
+
+bool TraceReader::open(const char *path) {
+    mFp = fopen(path, "rb");
+    if(!mFp) {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool TraceReader::readRecord() {
+    if(fread(&mNext, sizeof(TraceRecord), 1, mFp) != 1)
+        return false;
+    if(mNext.magic != HWC_TRACE_MAGIC || mNext.version != HWC_TRACE_VERSION
+            || mNext.numHwLayers > MAX_NUM_LAYERS
+            || mNext.phase >= TRACE_PHASE_MAX) {
+        fprintf(stderr, "Bad record at offset %ld, stopping\n", mOffset);
+        return false;
+    }
+    if(fread(mNextLayers, sizeof(TraceLayer), mNext.numHwLayers, mFp) !=
+            mNext.numHwLayers) {
+        fprintf(stderr, "Truncated record at offset %ld\n", mOffset);
+        return false;
+    }
+    mOffset += sizeof(TraceRecord) + mNext.numHwLayers * sizeof(TraceLayer);
+    return true;
+}
+
+bool TraceReader::readFrame(TraceFrame& frame) {
+    if(!mHaveNext && !readRecord())
+        return false;
+    memset(frame.present, 0, sizeof(frame.present));
+    frame.hasSet = false;
+    frame.frame = mNext.frame;
+    do {
+        if(mNext.frame != frame.frame) {
+            mHaveNext = true;
+            return true;
+        }
+        if(mNext.dpy >= MAX_DISPLAYS)
+            continue;
+        if(mNext.phase == TRACE_PHASE_PREPARE) {
+            frame.present[mNext.dpy] = true;
+            frame.prepare[mNext.dpy] = mNext;
+            memcpy(frame.layers[mNext.dpy], mNextLayers,
+                    mNext.numHwLayers * sizeof(TraceLayer));
+        } else if(!frame.hasSet) {
+            //Set latency is over all displays, any record of it will do
+            frame.hasSet = true;
+            frame.set = mNext;
+        }
+    } while(readRecord());
+    mHaveNext = false;
+    return true;
+}
+
+// Builds the list as surfaceflinger hands it to prepare: layers left to
+// the framebuffer, save the FB target, and no fences
+static hwc_display_contents_1_t *buildList(FakeDevice& fake,
+        const TraceRecord& rec, const TraceLayer *tl, hwc_rect_t *rects) {
+    hwc_display_contents_1_t *list = (hwc_display_contents_1_t *)calloc(1,
+            sizeof(hwc_display_contents_1_t) +
+            rec.numHwLayers * sizeof(hwc_layer_1_t));
+    if(!list)
+        return NULL;
+    list->retireFenceFd = -1;
+    list->flags = rec.listFlags;
+    list->numHwLayers = rec.numHwLayers;
+    for(uint32_t i = 0; i < rec.numHwLayers; i++, tl++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        if(tl->handleId)
+            layer->handle = fake.getHandle(tl->handleId, tl->format,
+                    tl->width, tl->height, tl->size, tl->bufferType,
+                    tl->handleFlags);
+        layer->compositionType =
+                (tl->compositionType == HWC_FRAMEBUFFER_TARGET) ?
+                HWC_FRAMEBUFFER_TARGET : HWC_FRAMEBUFFER;
+        layer->flags = tl->flags;
+        layer->transform = tl->transform;
+        layer->blending = tl->blending;
+        layer->sourceCrop = tl->sourceCrop;
+        layer->displayFrame = tl->displayFrame;
+        //Only the rect count is recorded, the frame stands in for them
+        rects[i] = tl->displayFrame;
+        layer->visibleRegionScreen.numRects = tl->numVisibleRects ? 1 : 0;
+        layer->visibleRegionScreen.rects = &rects[i];
+        layer->acquireFenceFd = -1;
+        layer->releaseFenceFd = -1;
+    }
+    return list;
+}
+
+static void closeFences(hwc_display_contents_1_t *list) {
+    for(uint32_t i = 0; i < list->numHwLayers; i++) {
+        if(list->hwLayers[i].releaseFenceFd >= 0)
+            close(list->hwLayers[i].releaseFenceFd);
+    }
+    if(list->retireFenceFd >= 0)
+        close(list->retireFenceFd);
+}
+
+static const char *strategyString(uint32_t strategy, char *buf, size_t len) {
+    buf[0] = '\0';
+    for(int i = 0; i < HWC_TRACE_NUM_STRATEGIES; i++) {
+        if(!(strategy & (1 << i)))
+            continue;
+        if(buf[0])
+            strlcat(buf, "|", len);
+        strlcat(buf, FrameTrace::getStrategyName(i), len);
+    }
+    if(!buf[0])
+        strlcpy(buf, "-", len);
+    return buf;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-c <fake config>] [-n <frames>] [-d] "
+            "<trace>\n", name);
+}
+
+int main(int argc, char **argv) {
+    const char *config = "";
+    uint32_t maxFrames = 0;
+    bool dump = false;
+    int opt;
+    while((opt = getopt(argc, argv, "c:n:d")) != -1) {
+        switch(opt) {
+            case 'c':
+                config = optarg;
+                break;
+            case 'n':
+                maxFrames = atoi(optarg);
+                break;
+            case 'd':
+                dump = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if(optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    //The HAL in the tool would start a trace of its own, over this one
+    char property[PROPERTY_VALUE_MAX];
+    if(property_get("debug.hwc.trace", property, NULL) > 0 &&
+            atoi(property) == 1) {
+        fprintf(stderr, "Clear debug.hwc.trace before replaying\n");
+        return 1;
+    }
+
+    TraceReader reader;
+    if(!reader.open(argv[optind]))
+        return 1;
+    FakeDevice fake;
+    if(!fake.open(config)) {
+        fprintf(stderr, "Unable to open the composer on fake%s\n", config);
+        return 1;
+    }
+    hwc_composer_device_1_t *dev = fake.getDevice();
+    hwc_context_t *ctx = fake.getContext();
+    qdutils::FakeIoctl *backend = fake.getBackend();
+
+    TraceFrame *frame = new TraceFrame;
+    uint32_t frames = 0, mismatches = 0;
+    int64_t prepareTotal = 0, prepareMax = 0, setTotal = 0, setMax = 0;
+    int64_t recPrepareTotal = 0, recSetTotal = 0;
+    printf("frame  prepare(rec)us  set(rec)us  ioctls(rec) plays commits "
+            "pipes  dpy:strategy/pipes(rec)\n");
+    while((!maxFrames || frames < maxFrames) && reader.readFrame(*frame)) {
+        if(!frame->present[HWC_DISPLAY_PRIMARY])
+            continue; //prepare records dropped at recording
+
+        hwc_display_contents_1_t *displays[MAX_DISPLAYS];
+        hwc_rect_t rects[MAX_DISPLAYS][MAX_NUM_LAYERS];
+        for(int i = 0; i < MAX_DISPLAYS; i++) {
+            displays[i] = frame->present[i] ? buildList(fake,
+                    frame->prepare[i], frame->layers[i], rects[i]) : NULL;
+        }
+
+        uint32_t plays = backend->getPlays();
+        uint32_t commits = backend->getCommits();
+        int32_t ioctls = mdpwrap::getIoctlCount();
+        nsecs_t start = systemTime();
+        dev->prepare(dev, HWC_NUM_DISPLAY_TYPES, displays);
+        nsecs_t prepared = systemTime();
+        dev->set(dev, HWC_NUM_DISPLAY_TYPES, displays);
+        nsecs_t done = systemTime();
+        ioctls = mdpwrap::getIoctlCount() - ioctls;
+
+        int64_t prepareNs = prepared - start, setNs = done - prepared;
+        const TraceRecord& rec = frame->prepare[HWC_DISPLAY_PRIMARY];
+        int64_t recSetNs = frame->hasSet ? frame->set.latency : 0;
+        uint32_t recIoctls = rec.ioctls +
+                (frame->hasSet ? frame->set.ioctls : 0);
+        printf("%5u  %5lld(%5lld)  %5lld(%5lld)  %4d(%4u)  %5u %7u %5d ",
+                frame->frame, ns2us(prepareNs), ns2us(rec.latency),
+                ns2us(setNs), ns2us(recSetNs), ioctls, recIoctls,
+                backend->getPlays() - plays, backend->getCommits() - commits,
+                backend->getPipesSet());
+        for(int i = 0; i < MAX_DISPLAYS; i++) {
+            if(!displays[i])
+                continue;
+            char now[64], then[64];
+            uint32_t strategy = ctx->mFrameTrace->getLastStrategy(i);
+            if(strategy != frame->prepare[i].strategy)
+                mismatches++;
+            printf(" %d:%s/%u(%s/%u)", i,
+                    strategyString(strategy, now, sizeof(now)),
+                    ctx->mFrameTrace->getLastPipes(i),
+                    strategyString(frame->prepare[i].strategy, then,
+                    sizeof(then)), frame->prepare[i].pipes);
+            closeFences(displays[i]);
+            free(displays[i]);
+        }
+        printf("\n");
+
+        frames++;
+        prepareTotal += prepareNs;
+        setTotal += setNs;
+        recPrepareTotal += rec.latency;
+        recSetTotal += recSetNs;
+        if(prepareNs > prepareMax)
+            prepareMax = prepareNs;
+        if(setNs > setMax)
+            setMax = setNs;
+    }
+
+    if(frames) {
+        printf("\n%u frames: prepare avg=%lldus (rec %lldus) max=%lldus, "
+                "set avg=%lldus (rec %lldus) max=%lldus\n", frames,
+                ns2us(prepareTotal / frames), ns2us(recPrepareTotal / frames),
+                ns2us(prepareMax), ns2us(setTotal / frames),
+                ns2us(recSetTotal / frames), ns2us(setMax));
+        printf("strategy mismatches=%u, sync overruns=%u\n", mismatches,
+                backend->getSyncOverruns());
+    }
+    if(dump) {
+        char buf[8192];
+        buf[0] = '\0';
+        dev->dump(dev, buf, sizeof(buf));
+        printf("\n%s", buf);
+    }
+    delete frame;
+    return frames ? 0 : 1;
+}
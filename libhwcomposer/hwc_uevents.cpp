@@ -21,19 +21,19 @@
 #define UEVENT_DEBUG 0
 #include <hardware_legacy/uevent.h>
 #include <utils/Log.h>
-#include <sys/resource.h>
-#include <sys/prctl.h>
+#include <sys/epoll.h>
 #include <string.h>
 #include <stdlib.h>
 #include "hwc_utils.h"
 #include "hwc_fbupdate.h"
 #include "hwc_copybit.h"
 #include "comptype.h"
+#include "display_config.h"
 #include "external.h"
+#include "hwc_eventloop.h"
 
 namespace qhwc {
 
-#define HWC_UEVENT_THREAD_NAME "hwcUeventThread"
 
 /* External Display states */
 enum {
@@ -72,10 +72,7 @@ static void handle_uevent(hwc_context_t* ctx, const char* udata, int len)
     }
     int connected = -1; // initial value - will be set to  1/0 based on hotplug
     int extDpyNum = HWC_DISPLAY_EXTERNAL;
-    char property[PROPERTY_VALUE_MAX];
-    if((property_get("persist.sys.wfd.virtual", property, NULL) > 0) &&
-            (!strncmp(property, "1", PROPERTY_VALUE_MAX ) ||
-             (!strncasecmp(property,"true", PROPERTY_VALUE_MAX )))) {
+    if(qdutils::DisplayConfig::getInstance().wfdVirtual) {
         // This means we are using Google API to trigger WFD Display
         extDpyNum = HWC_DISPLAY_VIRTUAL;
 
@@ -110,6 +107,7 @@ static void handle_uevent(hwc_context_t* ctx, const char* udata, int len)
         case EXTERNAL_OFFLINE:
             {   // disconnect event
                 ctx->mExtDisplay->processUEventOffline(udata);
+                ctx->mPlan[dpy]->invalidate();
                 if(ctx->mFBUpdate[dpy]) {
                     Locker::Autolock _l(ctx->mExtSetLock);
                     delete ctx->mFBUpdate[dpy];
@@ -132,6 +130,7 @@ static void handle_uevent(hwc_context_t* ctx, const char* udata, int len)
             {   // connect case
                 ctx->mExtDispConfiguring = true;
                 ctx->mExtDisplay->processUEventOnline(udata);
+                ctx->mPlan[dpy]->invalidate();
                 ctx->mFBUpdate[dpy] =
                         IFBUpdate::getObject(ctx->dpyAttr[dpy].xres, dpy);
                 ctx->dpyAttr[dpy].isPause = false;
@@ -166,35 +165,25 @@ static void handle_uevent(hwc_context_t* ctx, const char* udata, int len)
     }
 }
 
-static void *uevent_loop(void *param)
+static void uevent_event(void *data, uint32_t events)
 {
-    int len = 0;
     static char udata[PAGE_SIZE];
-    hwc_context_t * ctx = reinterpret_cast<hwc_context_t *>(param);
-    char thread_name[64] = HWC_UEVENT_THREAD_NAME;
-    prctl(PR_SET_NAME, (unsigned long) &thread_name, 0, 0, 0);
-    setpriority(PRIO_PROCESS, 0, HAL_PRIORITY_URGENT_DISPLAY);
-    uevent_init();
-
-    while(1) {
-        len = uevent_next_event(udata, sizeof(udata) - 2);
+    hwc_context_t * ctx = reinterpret_cast<hwc_context_t *>(data);
+    //The socket is readable, so this does not block
+    int len = uevent_next_event(udata, sizeof(udata) - 2);
+    if(len > 0)
         handle_uevent(ctx, udata, len);
-    }
-
-    return NULL;
 }
 
-void init_uevent_thread(hwc_context_t* ctx)
+void init_uevent(hwc_context_t* ctx)
 {
-    pthread_t uevent_thread;
-    int ret;
-
-    ALOGI("Initializing UEVENT Thread");
-    ret = pthread_create(&uevent_thread, NULL, uevent_loop, (void*) ctx);
-    if (ret) {
-        ALOGE("%s: failed to create %s: %s", __FUNCTION__,
-            HWC_UEVENT_THREAD_NAME, strerror(ret));
+    ALOGI("Initializing UEVENT");
+    if(!uevent_init()) {
+        ALOGE("%s: uevent_init failed", __FUNCTION__);
+        return;
     }
+    ctx->mEventLoop->addFd(uevent_get_fd(), EPOLLIN, uevent_event, ctx,
+                           "uevent");
 }
 
 }; //namespace
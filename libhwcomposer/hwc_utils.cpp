@@ -34,6 +34,14 @@
 #include "hwc_qclient.h"
 #include "QService.h"
 #include "comptype.h"
+#include "display_config.h"
+#include "ioctl_backend.h"
+#include "hwc_trace.h"
+#include "hwc_worker.h"
+#include "hwc_damage.h"
+#include "hwc_vsync.h"
+#include "hwc_eventloop.h"
+#include "hwc_cost.h"
 
 using namespace qClient;
 using namespace qService;
@@ -64,6 +72,9 @@ static void openFramebufferDevice(hwc_context_t *ctx)
 
 void initContext(hwc_context_t *ctx)
 {
+    //Pluggable displays have no fb open until they are connected
+    for(int dpy = HWC_DISPLAY_PRIMARY + 1; dpy < MAX_DISPLAYS; dpy++)
+        ctx->dpyAttr[dpy].fd = -1;
     openFramebufferDevice(ctx);
     overlay::Overlay::initOverlay();
     ctx->mOverlay = overlay::Overlay::getInstance();
@@ -92,13 +103,44 @@ void initContext(hwc_context_t *ctx)
     ctx->mExtDisplay = new ExternalDisplay(ctx);
     for (uint32_t i = 0; i < MAX_DISPLAYS; i++)
         ctx->mLayerCache[i] = new LayerCache();
+    for (uint32_t i = 0; i < MAX_DISPLAYS; i++)
+        ctx->mPlan[i] = new CompositionPlan();
+    for (uint32_t i = 0; i < MAX_DISPLAYS; i++)
+        ctx->mFrameArena[i] = new FrameArena();
+    //Sources are added by MDPComp, uevent and vsync init, and served once
+    //the procs are registered
+    ctx->mEventLoop = new EventLoop();
     ctx->mMDPComp = MDPComp::getObject(ctx->dpyAttr[HWC_DISPLAY_PRIMARY].xres);
     MDPComp::init(ctx);
+    ctx->mFrameTrace = new FrameTrace();
+    ctx->mDamage = new DamageTracker();
+    ctx->mCostModel = new CostModel();
+
+    if(property_get("debug.hwc.serial_prepare", value, NULL) > 0 &&
+            atoi(value) == 1) {
+        ctx->mPrepareWorker = NULL;
+    } else {
+        ctx->mPrepareWorker = new Worker("hwcPrepare");
+        if(!ctx->mPrepareWorker->isRunning()) {
+            delete ctx->mPrepareWorker;
+            ctx->mPrepareWorker = NULL;
+        }
+    }
 
     pthread_mutex_init(&(ctx->vstate.lock), NULL);
-    pthread_cond_init(&(ctx->vstate.cond), NULL);
-    ctx->vstate.enable = false;
     ctx->vstate.fakevsync = false;
+    for (uint32_t i = 0; i < MAX_DISPLAYS; i++) {
+        ctx->vstate.enable[i] = false;
+        ctx->mVsyncModel[i] = new VsyncModel(ctx->dpyAttr[i].vsync_period);
+    }
+    if(pipe(ctx->vstate.wakefd) < 0) {
+        ALOGE("%s: vsync wake pipe failed: %s", __FUNCTION__,
+                strerror(errno));
+        ctx->vstate.wakefd[0] = ctx->vstate.wakefd[1] = -1;
+    } else {
+        fcntl(ctx->vstate.wakefd[0], F_SETFL, O_NONBLOCK);
+        fcntl(ctx->vstate.wakefd[1], F_SETFL, O_NONBLOCK);
+    }
     ctx->mExtDispConfiguring = false;
 
     //Right now hwc starts the service but anybody could do it, or it could be
@@ -146,13 +188,66 @@ void closeContext(hwc_context_t *ctx)
         }
     }
 
+    for(int i = 0; i < MAX_DISPLAYS; i++) {
+        if(ctx->mPlan[i]) {
+            delete ctx->mPlan[i];
+            ctx->mPlan[i] = NULL;
+        }
+    }
+
     if(ctx->mMDPComp) {
         delete ctx->mMDPComp;
         ctx->mMDPComp = NULL;
     }
 
+    for(int i = 0; i < MAX_DISPLAYS; i++) {
+        ctx->layerProp[i] = NULL;
+        if(ctx->mFrameArena[i]) {
+            delete ctx->mFrameArena[i];
+            ctx->mFrameArena[i] = NULL;
+        }
+    }
+
+    if(ctx->mFrameTrace) {
+        delete ctx->mFrameTrace;
+        ctx->mFrameTrace = NULL;
+    }
+
+    if(ctx->mPrepareWorker) {
+        delete ctx->mPrepareWorker;
+        ctx->mPrepareWorker = NULL;
+    }
+
+    if(ctx->mDamage) {
+        delete ctx->mDamage;
+        ctx->mDamage = NULL;
+    }
+
+    if(ctx->mCostModel) {
+        delete ctx->mCostModel;
+        ctx->mCostModel = NULL;
+    }
+
+    for(int i = 0; i < MAX_DISPLAYS; i++) {
+        if(ctx->mVsyncModel[i]) {
+            delete ctx->mVsyncModel[i];
+            ctx->mVsyncModel[i] = NULL;
+        }
+    }
+
+    if(ctx->mEventLoop) {
+        delete ctx->mEventLoop;
+        ctx->mEventLoop = NULL;
+    }
+
+    for(int i = 0; i < 2; i++) {
+        if(ctx->vstate.wakefd[i] >= 0) {
+            close(ctx->vstate.wakefd[i]);
+            ctx->vstate.wakefd[i] = -1;
+        }
+    }
+
     pthread_mutex_destroy(&(ctx->vstate.lock));
-    pthread_cond_destroy(&(ctx->vstate.cond));
 }
 
 
@@ -185,13 +280,11 @@ void getActionSafePosition(hwc_context_t *ctx, int dpy, uint32_t& x,
     float asY = 0;
     float asW = fbWidth;
     float asH= fbHeight;
-    char value[PROPERTY_VALUE_MAX];
 
     // Apply action safe parameters
-    property_get("hw.actionsafe.width", value, "0");
-    int asWidthRatio = atoi(value);
-    property_get("hw.actionsafe.height", value, "0");
-    int asHeightRatio = atoi(value);
+    qdutils::DisplayConfig& config = qdutils::DisplayConfig::getInstance();
+    int asWidthRatio = config.actionSafeWidth;
+    int asHeightRatio = config.actionSafeHeight;
     // based on the action safe ratio, get the Action safe rectangle
     asW = fbWidth * (1.0f -  asWidthRatio / 100.0f);
     asH = fbHeight * (1.0f -  asHeightRatio / 100.0f);
@@ -247,7 +340,10 @@ void setListStats(hwc_context_t *ctx,
     ctx->listStats[dpy].skipCount = 0;
     ctx->listStats[dpy].needsAlphaScale = false;
     ctx->listStats[dpy].yuvCount = 0;
-    ctx->mDMAInUse = false;
+    //Only MDP comp on primary looks at it, and displays may be prepared
+    //in parallel
+    if(dpy == HWC_DISPLAY_PRIMARY)
+        ctx->mDMAInUse = false;
 
     for (size_t i = 0; i < list->numHwLayers; i++) {
         hwc_layer_1_t const* layer = &list->hwLayers[i];
@@ -266,7 +362,8 @@ void setListStats(hwc_context_t *ctx,
             ctx->listStats[dpy].yuvIndices[yuvCount] = i;
             yuvCount++;
 
-            if((layer->transform & HWC_TRANSFORM_ROT_90) && !ctx->mDMAInUse)
+            if((layer->transform & HWC_TRANSFORM_ROT_90) &&
+                    dpy == HWC_DISPLAY_PRIMARY && !ctx->mDMAInUse)
                 ctx->mDMAInUse = true;
         }
 
@@ -420,11 +517,8 @@ int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
     data.flags = MDP_BUF_SYNC_FLAG_WAIT;
     data.acq_fen_fd = acquireFd;
     data.rel_fen_fd = &releaseFd;
-    char property[PROPERTY_VALUE_MAX];
-    if(property_get("debug.egl.swapinterval", property, "1") > 0) {
-        if(atoi(property) == 0)
-            swapzero = true;
-    }
+    if(qdutils::DisplayConfig::getInstance().swapInterval == 0)
+        swapzero = true;
 
     //Accumulate acquireFenceFds
     for(uint32_t i = 0; i < list->numHwLayers; i++) {
@@ -454,7 +548,7 @@ int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
     //Waits for acquire fences, returns a release fence
     if(LIKELY(!swapzero)) {
         uint64_t start = systemTime();
-        ret = ioctl(fbFd, MSMFB_BUFFER_SYNC, &data);
+        ret = qdutils::devIoctl(fbFd, MSMFB_BUFFER_SYNC, &data);
         ALOGD_IF(HWC_UTILS_DEBUG, "%s: time taken for MSMFB_BUFFER_SYNC IOCTL = %d",
                             __FUNCTION__, (size_t) ns2ms(systemTime() - start));
     }
@@ -482,6 +576,7 @@ int hwc_sync(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy,
 
     if (ctx->mCopyBit[dpy])
         ctx->mCopyBit[dpy]->setReleaseFd(releaseFd);
+    ctx->mOverlay->setReleaseFence(dpy, releaseFd);
     if(UNLIKELY(swapzero)){
         list->retireFenceFd = -1;
         close(releaseFd);
@@ -559,4 +654,151 @@ void LayerCache::markCachedLayersAsOverlay(hwc_display_contents_1_t* list) {
 
 }
 
+void* FrameArena::alloc(size_t size) {
+    size = ALIGN_TO(size, sizeof(uint64_t));
+    mAllocs++;
+    if(mUsed + size <= sizeof(mBuf)) {
+        void *ptr = (char *)mBuf + mUsed;
+        mUsed += size;
+        mPeak = max(mPeak, mUsed);
+        return ptr;
+    }
+
+    //Out of space, use the heap till the next reset
+    Chunk *chunk = (Chunk *)malloc(sizeof(Chunk) + size);
+    if(!chunk) {
+        ALOGE("%s: Failed to allocate %d bytes", __FUNCTION__, (int)size);
+        return NULL;
+    }
+    chunk->next = mOverflow;
+    mOverflow = chunk;
+    mHeapAllocs++;
+    ALOGD_IF(HWC_UTILS_DEBUG, "%s: arena full, %d bytes from heap",
+            __FUNCTION__, (int)size);
+    return chunk + 1;
+}
+
+void FrameArena::reset() {
+    while(mOverflow) {
+        Chunk *next = mOverflow->next;
+        free(mOverflow);
+        mOverflow = next;
+    }
+    mUsed = 0;
+    mAllocs = 0;
+}
+
+void FrameArena::dump(android::String8& buf, int dpy) {
+    dumpsys_log(buf, "  Arena dpy=%d used=%d peak=%d/%d allocs=%u "
+            "heapAllocs=%u\n", dpy, (int)mUsed, (int)mPeak, (int)sizeof(mBuf),
+            mAllocs, mHeapAllocs);
+}
+
+void CompositionPlan::getLayerKey(const hwc_layer_1_t* layer, LayerKey& key) {
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+    memset(&key, 0, sizeof(LayerKey));
+    if(hnd) {
+        key.format = hnd->format;
+        key.width = hnd->width;
+        key.height = hnd->height;
+        key.bufferType = hnd->bufferType;
+        key.secure = isSecureBuffer(hnd);
+    }
+    key.sourceCrop = layer->sourceCrop;
+    key.displayFrame = layer->displayFrame;
+    key.transform = layer->transform;
+    key.blending = layer->blending;
+    key.flags = layer->flags;
+}
+
+bool CompositionPlan::match(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list, int dpy) {
+    mMatched = false;
+    if(!mValid)
+        return false;
+
+    //A plan that does not match is stale for good
+    mMatched = isSame(ctx, list, dpy);
+    mValid = mMatched;
+    if(mMatched)
+        mHits++;
+    else
+        mMisses++;
+    return mMatched;
+}
+
+bool CompositionPlan::isSame(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list, int dpy) {
+    if(!list || (list->flags & HWC_GEOMETRY_CHANGED) ||
+            list->numHwLayers != mNumHwLayers)
+        return false;
+    if(!ctx->dpyAttr[dpy].isActive || ctx->dpyAttr[dpy].isPause ||
+            (dpy != HWC_DISPLAY_PRIMARY && !ctx->dpyAttr[dpy].connected))
+        return false;
+    if(ctx->mSecuring != mSecuring || ctx->mSecureMode != mSecureMode ||
+            ctx->mExtDispConfiguring != mExtDispConfiguring)
+        return false;
+    //e.g. action safe changes the external layer positions
+    if(qdutils::DisplayConfig::getInstance().generation != mConfigGeneration)
+        return false;
+    //Pipes could have been torn down in between, e.g. on blank
+    if(ctx->mOverlay->usedPipes(dpy) != mPipes)
+        return false;
+    if(!list->hwLayers[mNumHwLayers - 1].handle)
+        return false;
+
+    for(uint32_t i = 0; i < mNumHwLayers; i++) {
+        LayerKey key;
+        getLayerKey(&list->hwLayers[i], key);
+        if(memcmp(&key, &mKeys[i], sizeof(LayerKey)))
+            return false;
+    }
+
+    if(dpy == HWC_DISPLAY_PRIMARY && !ctx->mMDPComp->canReuse(ctx, list))
+        return false;
+    return true;
+}
+
+void CompositionPlan::restore(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list, int dpy) {
+    ctx->listStats[dpy] = mListStats;
+    for(uint32_t i = 0; i < mNumHwLayers; i++) {
+        list->hwLayers[i].compositionType = mCompositionType[i];
+        list->hwLayers[i].hints = mHints[i];
+    }
+    for(int i = 0; i < mListStats.numAppLayers; i++) {
+        ctx->layerProp[dpy][i].mFlags = mLayerFlags[i];
+    }
+    ctx->mOverlay->reusePipes(dpy);
+    if(dpy == HWC_DISPLAY_PRIMARY)
+        ctx->mMDPComp->reuse(ctx, list);
+    ALOGD_IF(HWC_UTILS_DEBUG, "%s: dpy %d reusing plan, %d pipes",
+            __FUNCTION__, dpy, mPipes);
+}
+
+void CompositionPlan::save(hwc_context_t *ctx,
+        hwc_display_contents_1_t* list, int dpy) {
+    mNumHwLayers = list->numHwLayers;
+    for(uint32_t i = 0; i < mNumHwLayers; i++) {
+        getLayerKey(&list->hwLayers[i], mKeys[i]);
+        mCompositionType[i] = list->hwLayers[i].compositionType;
+        mHints[i] = list->hwLayers[i].hints;
+    }
+    mListStats = ctx->listStats[dpy];
+    for(int i = 0; i < mListStats.numAppLayers; i++) {
+        mLayerFlags[i] = ctx->layerProp[dpy][i].mFlags;
+    }
+    mSecuring = ctx->mSecuring;
+    mSecureMode = ctx->mSecureMode;
+    mExtDispConfiguring = ctx->mExtDispConfiguring;
+    mConfigGeneration = qdutils::DisplayConfig::getInstance().generation;
+    mPipes = ctx->mOverlay->usedPipes(dpy);
+    mValid = true;
+}
+
+void CompositionPlan::dump(android::String8& buf, int dpy) {
+    dumpsys_log(buf, "  Plan dpy=%d valid=%d hits=%u misses=%u\n", dpy,
+            mValid, mHits, mMisses);
+}
+
 };//namespace
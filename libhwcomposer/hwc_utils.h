@@ -23,10 +23,12 @@
 
 #define HWC_REMOVE_DEPRECATED_VERSIONS 1
 #include <fcntl.h>
+#include <new>
 #include <hardware/hwcomposer.h>
 #include <gr.h>
 #include <gralloc_priv.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
 
 #define ALIGN_TO(x, align)     (((x) + ((align)-1)) & ~((align)-1))
 #define LIKELY( exp )       (__builtin_expect( (exp) != 0, true  ))
@@ -35,6 +37,7 @@
 #define MAX_NUM_DISPLAYS 4 //Yes, this is ambitious
 #define MAX_NUM_LAYERS 32
 #define MAX_DISPLAY_DIM 2048
+#define FRAME_ARENA_SIZE 8192
 
 // For support of virtual displays
 #define HWC_DISPLAY_VIRTUAL     (HWC_DISPLAY_EXTERNAL+1)
@@ -55,6 +58,12 @@ class ExternalDisplay;
 class IFBUpdate;
 class MDPComp;
 class CopyBit;
+class FrameTrace;
+class Worker;
+class DamageTracker;
+class VsyncModel;
+class EventLoop;
+class CostModel;
 
 
 struct MDPInfo {
@@ -121,6 +130,92 @@ class LayerCache {
 
 };
 
+// Bump allocator for per frame objects of a display. Everything allocated
+// stays valid until the display is prepared from scratch again, at which
+// point the whole arena is reset at once. Falls back to the heap when full.
+// Destructors are not run, so only use it for objects that own nothing.
+class FrameArena {
+    public:
+    FrameArena() : mUsed(0), mPeak(0), mOverflow(NULL), mAllocs(0),
+            mHeapAllocs(0) {}
+    ~FrameArena() { reset(); }
+    //Returns 8 byte aligned memory, NULL on failure
+    void* alloc(size_t size);
+    //Allocates count value initialized objects of type T
+    template <class T> T* create(size_t count = 1) {
+        T* obj = (T*)alloc(count * sizeof(T));
+        for(size_t i = 0; obj && i < count; i++)
+            new (&obj[i]) T();
+        return obj;
+    }
+    void reset();
+    void dump(android::String8& buf, int dpy);
+    private:
+    union Chunk {
+        Chunk *next;
+        uint64_t align;
+    };
+    uint64_t mBuf[FRAME_ARENA_SIZE / sizeof(uint64_t)];
+    size_t mUsed;
+    size_t mPeak;
+    //Heap chunks used once mBuf is full, freed on reset
+    Chunk *mOverflow;
+    //Allocations since the last reset
+    uint32_t mAllocs;
+    //Total heap allocations, stays put in the steady state
+    uint32_t mHeapAllocs;
+};
+
+// Composition set up for a display by the last prepare. While the geometry
+// and layers stay the same, the next frames reuse it as is and only the
+// buffer handles change, skipping the decision and overlay config pipeline.
+class CompositionPlan {
+    public:
+    CompositionPlan() : mValid(false), mMatched(false), mNumHwLayers(0),
+            mHits(0), mMisses(0) {}
+    //Checks if the plan applies to the list, drops the plan if not
+    bool match(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy);
+    //True if the last match() succeeded
+    bool isMatched() { return mMatched; }
+    //Sets the list up as per the plan, needs a successful match()
+    void restore(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy);
+    //Records the setup prepare did for the list
+    void save(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy);
+    void invalidate() { mValid = false; mMatched = false; }
+    void dump(android::String8& buf, int dpy);
+    private:
+    //Layer attributes the setup depends on, except the buffer itself
+    struct LayerKey {
+        int format;
+        int width;
+        int height;
+        int bufferType;
+        uint32_t secure;
+        hwc_rect_t sourceCrop;
+        hwc_rect_t displayFrame;
+        uint32_t transform;
+        int32_t blending;
+        uint32_t flags;
+    };
+    static void getLayerKey(const hwc_layer_1_t* layer, LayerKey& key);
+    bool isSame(hwc_context_t *ctx, hwc_display_contents_1_t* list, int dpy);
+    bool mValid;
+    bool mMatched;
+    uint32_t mNumHwLayers;
+    LayerKey mKeys[MAX_NUM_LAYERS];
+    int32_t mCompositionType[MAX_NUM_LAYERS];
+    uint32_t mHints[MAX_NUM_LAYERS];
+    uint32_t mLayerFlags[MAX_NUM_LAYERS];
+    ListStats mListStats;
+    bool mSecuring;
+    bool mSecureMode;
+    bool mExtDispConfiguring;
+    uint32_t mConfigGeneration;
+    int mPipes;
+    uint32_t mHits;
+    uint32_t mMisses;
+};
+
 
 
 
@@ -140,6 +235,7 @@ bool isSecuring(hwc_context_t* ctx);
 bool isSecureModePolicy(int mdpVersion);
 bool isExternalActive(hwc_context_t* ctx);
 bool needsScaling(hwc_layer_1_t const* layer);
+bool isAlphaScaled(hwc_layer_1_t const* layer);
 int hwc_vsync_control(hwc_context_t* ctx, int dpy, int enable);
 
 //Helper function to dump logs
@@ -166,6 +262,23 @@ static inline bool isYuvBuffer(const private_handle_t* hnd) {
     return (hnd && (hnd->bufferType == BUFFER_TYPE_VIDEO));
 }
 
+//Bits per pixel fetched for a buffer format
+static inline int getFormatBpp(int format) {
+    switch(format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return 32;
+        case HAL_PIXEL_FORMAT_RGB_888:
+            return 24;
+        case HAL_PIXEL_FORMAT_RGB_565:
+            return 16;
+        default:
+            //YUV 4:2:0
+            return 12;
+    }
+}
+
 // Returns true if the buffer is secure
 static inline bool isSecureBuffer(const private_handle_t* hnd) {
     return (hnd && (private_handle_t::PRIV_FLAGS_SECURE_BUFFER & hnd->flags));
@@ -193,10 +306,10 @@ static inline bool isExtCC(const private_handle_t* hnd) {
 template<typename T> inline T max(T a, T b) { return (a > b) ? a : b; }
 template<typename T> inline T min(T a, T b) { return (a < b) ? a : b; }
 
-// Initialize uevent thread
-void init_uevent_thread(hwc_context_t* ctx);
-// Initialize vsync thread
-void init_vsync_thread(hwc_context_t* ctx);
+// Register uevents with the event loop
+void init_uevent(hwc_context_t* ctx);
+// Register vsync sources with the event loop
+void init_vsync(hwc_context_t* ctx);
 
 inline void getLayerResolution(const hwc_layer_1_t* layer,
                                int& width, int& height)
@@ -226,9 +339,10 @@ inline void swap(T& a, T& b) {
 
 struct vsync_state {
     pthread_mutex_t lock;
-    pthread_cond_t  cond;
-    bool enable;
+    bool enable[MAX_DISPLAYS];
     bool fakevsync;
+    //Written to wake up the event loop on enable changes
+    int wakefd[2];
 };
 
 // -----------------------------------------------------------------------------
@@ -254,7 +368,10 @@ struct hwc_context_t {
     qhwc::DisplayAttributes dpyAttr[MAX_DISPLAYS];
     qhwc::ListStats listStats[MAX_DISPLAYS];
     qhwc::LayerCache *mLayerCache[MAX_DISPLAYS];
+    qhwc::CompositionPlan *mPlan[MAX_DISPLAYS];
     qhwc::LayerProp *layerProp[MAX_DISPLAYS];
+    //Per frame allocations of each display, layerProp lives here
+    qhwc::FrameArena *mFrameArena[MAX_DISPLAYS];
     qhwc::MDPComp *mMDPComp;
 
     //Securing in progress indicator
@@ -269,8 +386,22 @@ struct hwc_context_t {
     mutable Locker mExtSetLock;
     //Vsync
     struct vsync_state vstate;
+    //Vsync timing, predicts vsync when hardware does not report it
+    qhwc::VsyncModel *mVsyncModel[MAX_DISPLAYS];
     //DMA used for rotator
     bool mDMAInUse;
+    //Frame trace recorder and per frame stats
+    qhwc::FrameTrace *mFrameTrace;
+    //Prepares non primary displays in parallel with primary, NULL if serial
+    qhwc::Worker *mPrepareWorker;
+    //Damage of primary frames, for partial update of command mode panels
+    qhwc::DamageTracker *mDamage;
+    //Serves uevents, vsync and the idle timer from one thread
+    qhwc::EventLoop *mEventLoop;
+    //Time each composition path takes, picks copybit or GPU
+    qhwc::CostModel *mCostModel;
+    //End of the last primary prepare, GPU composition starts after it
+    nsecs_t mPrepareEnd;
 };
 
 static inline bool isSkipPresent (hwc_context_t *ctx, int dpy) {
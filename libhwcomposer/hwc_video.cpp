@@ -43,6 +43,41 @@ bool VideoOverlay::prepare(hwc_context_t *ctx, hwc_display_contents_1_t *list,
     int yuvIndex =  ctx->listStats[dpy].yuvIndices[0];
     sIsModeOn[dpy] = false;
 
+    if(yuvIndex == -1 || ctx->listStats[dpy].yuvCount != 1) {
+        return false;
+    }
+
+    //index guaranteed to be not -1 at this point
+    hwc_layer_1_t *layer = &list->hwLayers[yuvIndex];
+    if(!isDoable(ctx, dpy, layer))
+        return false;
+
+    if(configure(ctx, dpy, layer)) {
+        markFlags(layer);
+        sIsModeOn[dpy] = true;
+    }
+
+    return sIsModeOn[dpy];
+}
+
+int VideoOverlay::getVgDemand(hwc_context_t *ctx,
+        hwc_display_contents_1_t *list, int dpy) {
+    //Only a lone video layer takes this path, as in prepare()
+    hwc_layer_1_t *yuvLayer = NULL;
+    for(uint32_t i = 0; i < list->numHwLayers - 1; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        if(isSkipLayer(layer) ||
+                !isYuvBuffer((private_handle_t *)layer->handle))
+            continue;
+        if(yuvLayer)
+            return 0;
+        yuvLayer = layer;
+    }
+    return (yuvLayer && isDoable(ctx, dpy, yuvLayer)) ? 1 : 0;
+}
+
+bool VideoOverlay::isDoable(hwc_context_t *ctx, int dpy,
+        hwc_layer_1_t *layer) {
     int hw_w = ctx->dpyAttr[dpy].xres;
 
     if(hw_w > MAX_DISPLAY_DIM) {
@@ -63,12 +98,6 @@ bool VideoOverlay::prepare(hwc_context_t *ctx, hwc_display_contents_1_t *list,
        return false;
     }
 
-    if(yuvIndex == -1 || ctx->listStats[dpy].yuvCount != 1) {
-        return false;
-    }
-
-    //index guaranteed to be not -1 at this point
-    hwc_layer_1_t *layer = &list->hwLayers[yuvIndex];
     if (isSecureModePolicy(ctx->mMDP.version)) {
         private_handle_t *hnd = (private_handle_t *)layer->handle;
         if(ctx->mSecureMode) {
@@ -85,12 +114,7 @@ bool VideoOverlay::prepare(hwc_context_t *ctx, hwc_display_contents_1_t *list,
             }
         }
     }
-    if(configure(ctx, dpy, layer)) {
-        markFlags(layer);
-        sIsModeOn[dpy] = true;
-    }
-
-    return sIsModeOn[dpy];
+    return true;
 }
 
 void VideoOverlay::markFlags(hwc_layer_1_t *layer) {
@@ -217,7 +241,7 @@ bool VideoOverlay::draw(hwc_context_t *ctx, hwc_display_contents_1_t *list,
     overlay::Overlay& ov = *(ctx->mOverlay);
 
     if (!ov.queueBuffer(hnd->fd, hnd->offset,
-                sDest[dpy])) {
+                sDest[dpy], hnd)) {
         ALOGE("%s: queueBuffer failed for dpy=%d", __FUNCTION__, dpy);
         ret = false;
     }
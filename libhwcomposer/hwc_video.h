@@ -36,8 +36,14 @@ public:
     static bool draw(hwc_context_t *ctx, hwc_display_contents_1_t *list,
             int dpy);
     //resets values
-    static void reset();
+    static void reset(int dpy);
+    //VG pipes the video path will ask for, before the list stats are set
+    static int getVgDemand(hwc_context_t *ctx,
+            hwc_display_contents_1_t *list, int dpy);
 private:
+    //Checks if the display can take "yuvLayer" on the video path
+    static bool isDoable(hwc_context_t *ctx, int dpy,
+            hwc_layer_1_t *yuvLayer);
     //Configures overlay for video prim and ext
     static bool configure(hwc_context_t *ctx, int dpy,
             hwc_layer_1_t *yuvlayer);
@@ -49,11 +55,9 @@ private:
     static ovutils::eDest sDest[MAX_DISPLAYS];
 };
 
-inline void VideoOverlay::reset() {
-    for(uint32_t i = 0; i < MAX_DISPLAYS; i++) {
-        sIsModeOn[i] = false;
-        sDest[i] = ovutils::OV_INVALID;
-    }
+inline void VideoOverlay::reset(int dpy) {
+    sIsModeOn[dpy] = false;
+    sDest[dpy] = ovutils::OV_INVALID;
 }
 }; //namespace qhwc
 
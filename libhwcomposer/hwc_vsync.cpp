@@ -23,21 +23,31 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <linux/msm_mdp.h>
-#include <sys/resource.h>
-#include <sys/prctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include "hwc_utils.h"
+#include "hwc_vsync.h"
+#include "hwc_eventloop.h"
 #include "string.h"
 #include "external.h"
+#include "ioctl_backend.h"
 
 namespace qhwc {
 
-#define HWC_VSYNC_THREAD_NAME "hwcVsyncThread"
+//Period correction per vsync is error / (vsyncs since last sample * gain)
+#define VSYNC_PERIOD_GAIN 16
+//Phase correction per sample is error / gain
+#define VSYNC_PHASE_GAIN 4
+#define VSYNC_DEFAULT_PERIOD (1000000000LL / 60)
+//Hardware vsync is given up on after this many periods without one
+#define VSYNC_TIMEOUT_PERIODS 2
 
 int hwc_vsync_control(hwc_context_t* ctx, int dpy, int enable)
 {
     int ret = 0;
-    if(!ctx->vstate.fakevsync &&
-       ioctl(ctx->dpyAttr[dpy].fd, MSMFB_OVERLAY_VSYNC_CTRL,
+    //Pluggable displays without an open fb get predicted vsync
+    if(!ctx->vstate.fakevsync && ctx->dpyAttr[dpy].fd >= 0 &&
+       qdutils::devIoctl(ctx->dpyAttr[dpy].fd, MSMFB_OVERLAY_VSYNC_CTRL,
              &enable) < 0) {
         ALOGE("%s: vsync control failed. Dpy=%d, enable=%d : %s",
               __FUNCTION__, dpy, enable, strerror(errno));
@@ -46,117 +56,356 @@ int hwc_vsync_control(hwc_context_t* ctx, int dpy, int enable)
     return ret;
 }
 
-static void *vsync_loop(void *param)
-{
-    const char* vsync_timestamp_fb0 = "/sys/class/graphics/fb0/vsync_event";
-    const char* vsync_timestamp_fb1 = "/sys/class/graphics/fb1/vsync_event";
-    int dpy = HWC_DISPLAY_PRIMARY;
+VsyncModel::VsyncModel(nsecs_t period) : mNominal(period), mPeriod(period),
+        mRef(0), mLocked(false), mHwCount(0), mPredictedCount(0), mRelocks(0),
+        mLastPhaseError(0), mLastDelivered(0), mLastJitter(0), mMaxJitter(0),
+        mTotalJitter(0), mJitterCount(0), mMaxLatency(0), mTotalLatency(0) {
+    //Pluggable displays report their period only once connected
+    if(mNominal <= 0)
+        mNominal = mPeriod = VSYNC_DEFAULT_PERIOD;
+}
 
-    hwc_context_t * ctx = reinterpret_cast<hwc_context_t *>(param);
+void VsyncModel::setNominal(nsecs_t period) {
+    if(period <= 0 || period == mNominal)
+        return;
+    mNominal = mPeriod = period;
+    mLocked = false;
+    mRef = 0;
+}
 
-    char thread_name[64] = HWC_VSYNC_THREAD_NAME;
-    prctl(PR_SET_NAME, (unsigned long) &thread_name, 0, 0, 0);
-    setpriority(PRIO_PROCESS, 0, HAL_PRIORITY_URGENT_DISPLAY +
-                android::PRIORITY_MORE_FAVORABLE);
+void VsyncModel::lock(nsecs_t timestamp) {
+    mRef = timestamp;
+    mLocked = true;
+}
 
-    const int MAX_DATA = 64;
-    const int MAX_RETRY_COUNT = 100;
-    static char vdata[MAX_DATA];
+void VsyncModel::addSample(nsecs_t timestamp) {
+    mHwCount++;
+    if(!mLocked) {
+        lock(timestamp);
+        return;
+    }
+    if(timestamp <= mRef) {
+        //Time went back, e.g. the panel was reset
+        mRelocks++;
+        lock(timestamp);
+        return;
+    }
 
-    uint64_t cur_timestamp=0;
-    ssize_t len = -1;
-    int fd_timestamp = -1;
-    int ret = 0;
-    bool fb1_vsync = false;
-    bool logvsync = false;
+    nsecs_t elapsed = timestamp - mRef;
+    int64_t n = (elapsed + mPeriod / 2) / mPeriod;
+    if(n < 1)
+        return; //Same vsync reported twice
+    nsecs_t expected = mRef + n * mPeriod;
+    nsecs_t err = timestamp - expected;
+    mLastPhaseError = err;
+    if(err > mPeriod / 4 || err < -mPeriod / 4) {
+        //Too far off to be drift, start over from this one
+        mRelocks++;
+        lock(timestamp);
+        return;
+    }
 
-    char property[PROPERTY_VALUE_MAX];
-    if(property_get("debug.hwc.fakevsync", property, NULL) > 0) {
-        if(atoi(property) == 1)
-            ctx->vstate.fakevsync = true;
+    mPeriod += err / (n * VSYNC_PERIOD_GAIN);
+    if(mPeriod < mNominal - mNominal / 10 ||
+            mPeriod > mNominal + mNominal / 10)
+        mPeriod = mNominal;
+    mRef = expected + err / VSYNC_PHASE_GAIN;
+}
+
+nsecs_t VsyncModel::predict(nsecs_t now) const {
+    //Without any sample the vsyncs are a grid with the nominal period
+    if(now < mRef)
+        return mRef;
+    int64_t n = (now - mRef) / mPeriod + 1;
+    return mRef + n * mPeriod;
+}
+
+bool VsyncModel::isDelivered(nsecs_t timestamp) const {
+    nsecs_t diff = timestamp - mLastDelivered;
+    return mLastDelivered && diff < mPeriod / 2 && diff > -mPeriod / 2;
+}
+
+void VsyncModel::delivered(nsecs_t timestamp, bool predicted) {
+    if(predicted)
+        mPredictedCount++;
+
+    nsecs_t latency = systemTime() - timestamp;
+    if(latency > 0) {
+        mTotalLatency += latency;
+        if(latency > mMaxLatency)
+            mMaxLatency = latency;
     }
 
-    if(property_get("debug.hwc.logvsync", property, 0) > 0) {
-        if(atoi(property) == 1)
-            logvsync = true;
+    //Deviation of the interval from a whole number of periods
+    if(mLastDelivered && timestamp > mLastDelivered) {
+        nsecs_t interval = timestamp - mLastDelivered;
+        int64_t n = (interval + mPeriod / 2) / mPeriod;
+        if(n < 1)
+            n = 1;
+        nsecs_t jitter = interval - n * mPeriod;
+        if(jitter < 0)
+            jitter = -jitter;
+        mLastJitter = jitter;
+        mTotalJitter += jitter;
+        mJitterCount++;
+        if(jitter > mMaxJitter)
+            mMaxJitter = jitter;
+    }
+    mLastDelivered = timestamp;
+}
+
+void VsyncModel::dump(android::String8& buf, int dpy) {
+    uint32_t count = mHwCount + mPredictedCount;
+    dumpsys_log(buf, "  Vsync dpy=%d period=%lldns nominal=%lldns hw=%u "
+            "predicted=%u relocks=%u phase error=%lldus\n", dpy, mPeriod,
+            mNominal, mHwCount, mPredictedCount, mRelocks,
+            ns2us(mLastPhaseError));
+    if(!count || !mJitterCount)
+        return;
+    dumpsys_log(buf, "    jitter last=%lldus avg=%lldus max=%lldus "
+            "latency avg=%lldus max=%lldus\n", ns2us(mLastJitter),
+            ns2us(mTotalJitter / mJitterCount), ns2us(mMaxJitter),
+            ns2us(mTotalLatency / count), ns2us(mMaxLatency));
+}
+
+//Returns 0 on success, -EAGAIN if there is nothing to read right now and
+//-1 if the node is unusable
+static int read_timestamp(int fd, nsecs_t *timestamp)
+{
+    const int MAX_DATA = 64;
+    char vdata[MAX_DATA + 1];
+    ssize_t len = pread(fd, vdata, MAX_DATA, 0);
+    if (len < 0) {
+        if (errno == EAGAIN || errno == EINTR || errno == EBUSY)
+            return -EAGAIN;
+        ALOGE ("FATAL:%s:not able to read vsync timestamp, %s",
+               __FUNCTION__, strerror(errno));
+        return -1;
     }
+    vdata[len] = '\0';
 
     /* Currently read vsync timestamp from drivers
        e.g. VSYNC=41800875994
        */
-    fd_timestamp = open(vsync_timestamp_fb0, O_RDONLY);
-    if (fd_timestamp < 0) {
-        ALOGE ("FATAL:%s:not able to open file:%s, %s",  __FUNCTION__,
-               (fb1_vsync) ? vsync_timestamp_fb1 : vsync_timestamp_fb0,
+    if (strncmp(vdata, "VSYNC=", strlen("VSYNC="))) {
+        ALOGE ("FATAL: %s: vsync timestamp not in correct format: [%s]",
+               __FUNCTION__, vdata);
+        return -1;
+    }
+    *timestamp = strtoull(vdata + strlen("VSYNC="), NULL, 0);
+    return 0;
+}
+
+//Vsync of one display, from its vsync_event node or the model
+struct VsyncSource {
+    hwc_context_t *ctx;
+    int dpy;
+    int fd;             //vsync_event node, -1 when only predicted
+    bool enabled;
+    bool predicting;    //hardware vsync timed out or is not available
+    nsecs_t deadline;   //hardware timeout, or the next predicted vsync
+};
+
+static VsyncSource sSources[MAX_DISPLAYS];
+//Fires at the earliest deadline of all sources
+static int sTimerFd = -1;
+static bool sLogVsync = false;
+
+static void rearm_timer()
+{
+    nsecs_t next = 0;
+    for (int dpy = 0; dpy < MAX_DISPLAYS; dpy++) {
+        if (sSources[dpy].enabled &&
+            (!next || sSources[dpy].deadline < next))
+            next = sSources[dpy].deadline;
+    }
+    //A zero value disarms the timer
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = next / 1000000000LL;
+    spec.it_value.tv_nsec = next % 1000000000LL;
+    if (timerfd_settime(sTimerFd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        ALOGE ("%s: timerfd_settime failed, %s", __FUNCTION__,
                strerror(errno));
-        ctx->vstate.fakevsync = true;
     }
+}
 
-    do {
-        pthread_mutex_lock(&ctx->vstate.lock);
-        while (ctx->vstate.enable == false) {
-            pthread_cond_wait(&ctx->vstate.cond, &ctx->vstate.lock);
+static void deliver(VsyncSource& src, nsecs_t timestamp, bool predicted)
+{
+    hwc_context_t *ctx = src.ctx;
+    VsyncModel *model = ctx->mVsyncModel[src.dpy];
+    if (model->isDelivered(timestamp))
+        return;
+    // send timestamp to HAL
+    ALOGD_IF (sLogVsync, "%s: timestamp %llu sent to HWC for dpy %d%s",
+              __FUNCTION__, timestamp, src.dpy,
+              predicted ? " (predicted)" : "");
+    ctx->proc->vsync(ctx->proc, src.dpy, timestamp);
+    model->delivered(timestamp, predicted);
+}
+
+static void close_node(VsyncSource& src)
+{
+    if (src.fd >= 0) {
+        src.ctx->mEventLoop->removeFd(src.fd);
+        close(src.fd);
+        src.fd = -1;
+    }
+}
+
+static void vsync_event(void *data, uint32_t events)
+{
+    VsyncSource& src = *reinterpret_cast<VsyncSource *>(data);
+    VsyncModel *model = src.ctx->mVsyncModel[src.dpy];
+    nsecs_t timestamp;
+    int ret = read_timestamp(src.fd, &timestamp);
+    if (ret == 0) {
+        model->addSample(timestamp);
+        src.predicting = false;
+        src.deadline = systemTime() +
+                VSYNC_TIMEOUT_PERIODS * model->getPeriod();
+        deliver(src, timestamp, false);
+    } else if (ret != -EAGAIN) {
+        ALOGE("%s: switching dpy %d to software vsync", __FUNCTION__,
+              src.dpy);
+        close_node(src);
+        src.predicting = true;
+        src.deadline = model->predict(systemTime());
+    }
+    rearm_timer();
+}
+
+static void open_source(VsyncSource& src)
+{
+    hwc_context_t *ctx = src.ctx;
+    int dpy = src.dpy;
+    VsyncModel *model = ctx->mVsyncModel[dpy];
+    model->setNominal(ctx->dpyAttr[dpy].vsync_period);
+    src.enabled = true;
+    src.predicting = true;
+    src.fd = -1;
+
+    int fbNum = 0;
+    if (dpy != HWC_DISPLAY_PRIMARY &&
+        (!ctx->dpyAttr[dpy].connected ||
+         ctx->mExtDisplay->getExtFbNum(fbNum) < 0))
+        fbNum = -1;
+    if (!ctx->vstate.fakevsync && fbNum >= 0) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/class/graphics/fb%d/vsync_event",
+                 fbNum);
+        src.fd = open(path, O_RDONLY);
+        if (src.fd < 0) {
+            ALOGE ("%s:not able to open file:%s, %s, dpy %d vsync is "
+                   "predicted", __FUNCTION__, path, strerror(errno), dpy);
         }
-        pthread_mutex_unlock(&ctx->vstate.lock);
-
-        if (!ctx->vstate.fakevsync) {
-            for(int i = 0; i < MAX_RETRY_COUNT; i++) {
-                len = pread(fd_timestamp, vdata, MAX_DATA, 0);
-                if(len < 0 && (errno == EAGAIN ||
-                               errno == EINTR  ||
-                               errno == EBUSY)) {
-                    ALOGW("%s: vsync read: %s, retry (%d/%d).",
-                          __FUNCTION__, strerror(errno), i, MAX_RETRY_COUNT);
-                    continue;
-                } else {
-                    break;
-                }
-            }
-
-            if (len < 0) {
-                ALOGE ("FATAL:%s:not able to read file:%s, %s", __FUNCTION__,
-                       vsync_timestamp_fb0, strerror(errno));
-                close (fd_timestamp);
-                ctx->vstate.fakevsync = true;
-            }
-
-            // extract timestamp
-            const char *str = vdata;
-            if (!strncmp(str, "VSYNC=", strlen("VSYNC="))) {
-                cur_timestamp = strtoull(str + strlen("VSYNC="), NULL, 0);
-            } else {
-                ALOGE ("FATAL: %s: vsync timestamp not in correct format: [%s]",
-                       __FUNCTION__,
-                       str);
-                ctx->vstate.fakevsync = true;
-            }
-
-        } else {
-            usleep(16000);
-            cur_timestamp = systemTime();
+    }
+
+    if (src.fd >= 0) {
+        //The driver notifies the node on every vsync. Read it once so that
+        //epoll only wakes up on new ones.
+        nsecs_t timestamp;
+        read_timestamp(src.fd, &timestamp);
+        if (!ctx->mEventLoop->addFd(src.fd, EPOLLPRI | EPOLLERR, vsync_event,
+                                    &src, "vsync")) {
+            close(src.fd);
+            src.fd = -1;
         }
-        // send timestamp to HAL
-        ALOGD_IF (logvsync, "%s: timestamp %llu sent to HWC for %s",
-                  __FUNCTION__, cur_timestamp, "fb0");
-        ctx->proc->vsync(ctx->proc, dpy, cur_timestamp);
+    }
+
+    nsecs_t now = systemTime();
+    if (src.fd >= 0) {
+        src.predicting = false;
+        src.deadline = now + VSYNC_TIMEOUT_PERIODS * model->getPeriod();
+    } else {
+        src.deadline = model->predict(now);
+    }
+}
+
+static void close_source(VsyncSource& src)
+{
+    close_node(src);
+    src.enabled = false;
+}
+
+//Enable state changed in hwc_eventControl
+static void wake_event(void *data, uint32_t events)
+{
+    hwc_context_t *ctx = reinterpret_cast<hwc_context_t *>(data);
+    char buf[16];
+    while (read(ctx->vstate.wakefd[0], buf, sizeof(buf)) > 0);
 
-    } while (true);
-    if(fd_timestamp >= 0)
-        close (fd_timestamp);
+    bool enable[MAX_DISPLAYS];
+    pthread_mutex_lock(&ctx->vstate.lock);
+    memcpy(enable, ctx->vstate.enable, sizeof(enable));
+    pthread_mutex_unlock(&ctx->vstate.lock);
 
-    return NULL;
+    for (int dpy = 0; dpy < MAX_DISPLAYS; dpy++) {
+        if (enable[dpy] && !sSources[dpy].enabled)
+            open_source(sSources[dpy]);
+        else if (!enable[dpy] && sSources[dpy].enabled)
+            close_source(sSources[dpy]);
+    }
+    rearm_timer();
+}
+
+//Hardware timeouts and predicted vsyncs
+static void timer_event(void *data, uint32_t events)
+{
+    uint64_t expirations;
+    if (read(sTimerFd, &expirations, sizeof(expirations)) < 0)
+        return;
+
+    nsecs_t now = systemTime();
+    for (int dpy = 0; dpy < MAX_DISPLAYS; dpy++) {
+        VsyncSource& src = sSources[dpy];
+        if (!src.enabled || src.deadline > now)
+            continue;
+        VsyncModel *model = src.ctx->mVsyncModel[dpy];
+        if (!src.predicting) {
+            ALOGD_IF(sLogVsync, "%s: hw vsync timed out for dpy %d",
+                     __FUNCTION__, dpy);
+            src.predicting = true;
+            src.deadline = model->predict(now);
+            continue;
+        }
+        deliver(src, src.deadline, true);
+        src.deadline = model->predict(src.deadline);
+    }
+    rearm_timer();
 }
 
-void init_vsync_thread(hwc_context_t* ctx)
+void init_vsync(hwc_context_t* ctx)
 {
-    int ret;
-    pthread_t vsync_thread;
-    ALOGI("Initializing VSYNC Thread");
-    ret = pthread_create(&vsync_thread, NULL, vsync_loop, (void*) ctx);
-    if (ret) {
-        ALOGE("%s: failed to create %s: %s", __FUNCTION__,
-              HWC_VSYNC_THREAD_NAME, strerror(ret));
+    ALOGI("Initializing VSYNC");
+    char property[PROPERTY_VALUE_MAX];
+    if(property_get("debug.hwc.fakevsync", property, NULL) > 0) {
+        if(atoi(property) == 1)
+            ctx->vstate.fakevsync = true;
+    }
+
+    if(property_get("debug.hwc.logvsync", property, 0) > 0) {
+        if(atoi(property) == 1)
+            sLogVsync = true;
+    }
+
+    for (int dpy = 0; dpy < MAX_DISPLAYS; dpy++) {
+        memset(&sSources[dpy], 0, sizeof(sSources[dpy]));
+        sSources[dpy].ctx = ctx;
+        sSources[dpy].dpy = dpy;
+        sSources[dpy].fd = -1;
+    }
+
+    sTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (sTimerFd < 0) {
+        ALOGE ("FATAL:%s: timerfd_create failed, %s", __FUNCTION__,
+               strerror(errno));
+        return;
     }
+    ctx->mEventLoop->addFd(sTimerFd, EPOLLIN, timer_event, NULL,
+                           "vsync timer");
+    ctx->mEventLoop->addFd(ctx->vstate.wakefd[0], EPOLLIN, wake_event, ctx,
+                           "vsync control");
 }
 
 }; //namespace
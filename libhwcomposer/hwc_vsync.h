@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HWC_VSYNC_H
+#define HWC_VSYNC_H
+
+#include <stdint.h>
+#include <utils/Timers.h>
+#include <utils/String8.h>
+
+namespace qhwc {
+
+// Software model of a display's vsync. Hardware timestamps lock its phase
+// and period, PLL style, and it predicts the following vsyncs for when the
+// hardware ones are late, off or not available at all. Also keeps the
+// stats of the vsyncs delivered to SurfaceFlinger.
+class VsyncModel {
+public:
+    explicit VsyncModel(nsecs_t period);
+    /* Sets the period reported by the display, e.g. on an HDMI mode
+     * change. Drops the lock if it differs from the current one */
+    void setNominal(nsecs_t period);
+    /* Feeds a hardware vsync timestamp */
+    void addSample(nsecs_t timestamp);
+    /* Returns the first vsync expected after "now" */
+    nsecs_t predict(nsecs_t now) const;
+    /* Returns true if a vsync within half a period of "timestamp" was
+     * already sent, e.g. a late hardware vsync after a predicted one */
+    bool isDelivered(nsecs_t timestamp) const;
+    /* Records a timestamp sent to SurfaceFlinger */
+    void delivered(nsecs_t timestamp, bool predicted);
+    nsecs_t getPeriod() const { return mPeriod; }
+    void dump(android::String8& buf, int dpy);
+
+private:
+    void lock(nsecs_t timestamp);
+
+    nsecs_t mNominal;   //period reported by the panel
+    nsecs_t mPeriod;    //tracked period
+    nsecs_t mRef;       //tracked time of a past vsync
+    bool mLocked;
+
+    //Stats
+    uint32_t mHwCount;
+    uint32_t mPredictedCount;
+    uint32_t mRelocks;
+    nsecs_t mLastPhaseError;
+    nsecs_t mLastDelivered;
+    nsecs_t mLastJitter;
+    nsecs_t mMaxJitter;
+    nsecs_t mTotalJitter;
+    uint32_t mJitterCount;
+    nsecs_t mMaxLatency;
+    nsecs_t mTotalLatency;
+};
+
+}; //namespace qhwc
+
+#endif //HWC_VSYNC_H
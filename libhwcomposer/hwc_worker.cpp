@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define HWC_WORKER_DEBUG 0
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <cutils/log.h>
+#include <hardware/hwcomposer.h>
+#include <utils/ThreadDefs.h>
+#include "hwc_worker.h"
+
+namespace qhwc {
+
+Worker::Worker(const char *name, bool urgent) : mJob(0), mData(0),
+        mPending(false), mExit(false), mRunning(false), mUrgent(urgent) {
+    strlcpy(mName, name, sizeof(mName));
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mCond, NULL);
+
+    int ret = pthread_create(&mThread, NULL, threadLoop, (void*) this);
+    if (ret) {
+        ALOGE("%s: failed to create %s: %s", __FUNCTION__, mName,
+                strerror(ret));
+    } else {
+        mRunning = true;
+    }
+}
+
+Worker::~Worker() {
+    if(mRunning) {
+        pthread_mutex_lock(&mLock);
+        mExit = true;
+        pthread_cond_broadcast(&mCond);
+        pthread_mutex_unlock(&mLock);
+        pthread_join(mThread, NULL);
+    }
+    pthread_mutex_destroy(&mLock);
+    pthread_cond_destroy(&mCond);
+}
+
+void Worker::post(Job job, void *data) {
+    pthread_mutex_lock(&mLock);
+    mJob = job;
+    mData = data;
+    mPending = true;
+    pthread_cond_broadcast(&mCond);
+    pthread_mutex_unlock(&mLock);
+}
+
+void Worker::wait() {
+    pthread_mutex_lock(&mLock);
+    while(mPending)
+        pthread_cond_wait(&mCond, &mLock);
+    pthread_mutex_unlock(&mLock);
+}
+
+bool Worker::isBusy() {
+    pthread_mutex_lock(&mLock);
+    bool busy = mPending;
+    pthread_mutex_unlock(&mLock);
+    return busy;
+}
+
+void *Worker::threadLoop(void *param) {
+    Worker *self = reinterpret_cast<Worker *>(param);
+    prctl(PR_SET_NAME, (unsigned long) self->mName, 0, 0, 0);
+    if(self->mUrgent)
+        setpriority(PRIO_PROCESS, 0, HAL_PRIORITY_URGENT_DISPLAY +
+                    android::PRIORITY_MORE_FAVORABLE);
+
+    pthread_mutex_lock(&self->mLock);
+    while(true) {
+        while(!self->mPending && !self->mExit)
+            pthread_cond_wait(&self->mCond, &self->mLock);
+        if(self->mExit)
+            break;
+
+        pthread_mutex_unlock(&self->mLock);
+        self->mJob(self->mData);
+        pthread_mutex_lock(&self->mLock);
+
+        ALOGD_IF(HWC_WORKER_DEBUG, "%s: job done", self->mName);
+        self->mPending = false;
+        pthread_cond_broadcast(&self->mCond);
+    }
+    pthread_mutex_unlock(&self->mLock);
+    return NULL;
+}
+
+}; //namespace qhwc
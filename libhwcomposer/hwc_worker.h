@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Not a Contribution, Apache license notifications and license are retained
+ * for attribution purposes only.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HWC_WORKER_H
+#define HWC_WORKER_H
+
+#include <pthread.h>
+
+namespace qhwc {
+
+// Runs a job on a dedicated display priority thread, so that the caller can
+// do other work meanwhile. One job is in flight at a time.
+class Worker {
+public:
+    typedef void (*Job)(void *data);
+
+    /* Background work that must not compete with the composer passes
+     * urgent as false, to keep the default priority */
+    explicit Worker(const char *name, bool urgent = true);
+    ~Worker();
+    /* Returns false if the thread could not be started */
+    bool isRunning() const { return mRunning; }
+    /* Hands over a job to the thread. Must be followed by wait() */
+    void post(Job job, void *data);
+    /* Blocks till the posted job is complete */
+    void wait();
+    /* True while a posted job has not completed. Does not block */
+    bool isBusy();
+
+private:
+    static void *threadLoop(void *param);
+
+    pthread_t mThread;
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;
+    Job mJob;
+    void *mData;
+    bool mPending;
+    bool mExit;
+    bool mRunning;
+    bool mUrgent;
+    char mName[16];
+};
+
+}; //namespace qhwc
+
+#endif //HWC_WORKER_H
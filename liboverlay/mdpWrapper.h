@@ -39,12 +39,19 @@
 #include <linux/msm_rotator.h>
 #include <sys/ioctl.h>
 #include <utils/Log.h>
+#include <cutils/atomic.h>
 #include <errno.h>
 #include "overlayUtils.h"
+#include "ioctl_backend.h"
 
 namespace overlay{
 
 namespace mdp_wrapper{
+/* Number of ioctls issued through this wrapper. Sampled by the HWC
+ * to report per frame ioctl counts */
+extern volatile int32_t sIoctlCount;
+int32_t getIoctlCount();
+
 /* FBIOGET_FSCREENINFO */
 bool getFScreenInfo(int fd, fb_fix_screeninfo& finfo);
 
@@ -98,8 +105,14 @@ void dump(const char* const s, const fb_var_screeninfo& vinfo);
 
 //---------------Inlines -------------------------------------
 
+inline int32_t getIoctlCount() {
+    return android_atomic_acquire_load(&sIoctlCount);
+}
+
+
 inline bool getFScreenInfo(int fd, fb_fix_screeninfo& finfo) {
-    if (ioctl(fd, FBIOGET_FSCREENINFO, &finfo) < 0) {
+    android_atomic_inc(&sIoctlCount);
+    if (qdutils::devIoctl(fd, FBIOGET_FSCREENINFO, &finfo) < 0) {
         ALOGE("Failed to call ioctl FBIOGET_FSCREENINFO err=%s",
                 strerror(errno));
         return false;
@@ -108,7 +121,8 @@ inline bool getFScreenInfo(int fd, fb_fix_screeninfo& finfo) {
 }
 
 inline bool getVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
-    if (ioctl(fd, FBIOGET_VSCREENINFO, &vinfo) < 0) {
+    android_atomic_inc(&sIoctlCount);
+    if (qdutils::devIoctl(fd, FBIOGET_VSCREENINFO, &vinfo) < 0) {
         ALOGE("Failed to call ioctl FBIOGET_VSCREENINFO err=%s",
                 strerror(errno));
         return false;
@@ -117,7 +131,8 @@ inline bool getVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
 }
 
 inline bool setVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
-    if (ioctl(fd, FBIOPUT_VSCREENINFO, &vinfo) < 0) {
+    android_atomic_inc(&sIoctlCount);
+    if (qdutils::devIoctl(fd, FBIOPUT_VSCREENINFO, &vinfo) < 0) {
         ALOGE("Failed to call ioctl FBIOPUT_VSCREENINFO err=%s",
                 strerror(errno));
         return false;
@@ -126,7 +141,8 @@ inline bool setVScreenInfo(int fd, fb_var_screeninfo& vinfo) {
 }
 
 inline bool startRotator(int fd, msm_rotator_img_info& rot) {
-    if (ioctl(fd, MSM_ROTATOR_IOCTL_START, &rot) < 0){
+    android_atomic_inc(&sIoctlCount);
+    if (qdutils::devIoctl(fd, MSM_ROTATOR_IOCTL_START, &rot) < 0){
         ALOGE("Failed to call ioctl MSM_ROTATOR_IOCTL_START err=%s",
                 strerror(errno));
         return false;
@@ -135,7 +151,8 @@ inline bool startRotator(int fd, msm_rotator_img_info& rot) {
 }
 
 inline bool rotate(int fd, msm_rotator_data_info& rot) {
-    if (ioctl(fd, MSM_ROTATOR_IOCTL_ROTATE, &rot) < 0) {
+    android_atomic_inc(&sIoctlCount);
+    if (qdutils::devIoctl(fd, MSM_ROTATOR_IOCTL_ROTATE, &rot) < 0) {
         ALOGE("Failed to call ioctl MSM_ROTATOR_IOCTL_ROTATE err=%s",
                 strerror(errno));
         return false;
@@ -144,7 +161,8 @@ inline bool rotate(int fd, msm_rotator_data_info& rot) {
 }
 
 inline bool setOverlay(int fd, mdp_overlay& ov) {
-    if (ioctl(fd, MSMFB_OVERLAY_SET, &ov) < 0) {
+    android_atomic_inc(&sIoctlCount);
+    if (qdutils::devIoctl(fd, MSMFB_OVERLAY_SET, &ov) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_SET err=%s",
                 strerror(errno));
         return false;
@@ -153,7 +171,8 @@ inline bool setOverlay(int fd, mdp_overlay& ov) {
 }
 
 inline bool endRotator(int fd, uint32_t sessionId) {
-    if (ioctl(fd, MSM_ROTATOR_IOCTL_FINISH, &sessionId) < 0) {
+    android_atomic_inc(&sIoctlCount);
+    if (qdutils::devIoctl(fd, MSM_ROTATOR_IOCTL_FINISH, &sessionId) < 0) {
         ALOGE("Failed to call ioctl MSM_ROTATOR_IOCTL_FINISH err=%s",
                 strerror(errno));
         return false;
@@ -162,7 +181,8 @@ inline bool endRotator(int fd, uint32_t sessionId) {
 }
 
 inline bool unsetOverlay(int fd, int ovId) {
-    if (ioctl(fd, MSMFB_OVERLAY_UNSET, &ovId) < 0) {
+    android_atomic_inc(&sIoctlCount);
+    if (qdutils::devIoctl(fd, MSMFB_OVERLAY_UNSET, &ovId) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_UNSET err=%s",
                 strerror(errno));
         return false;
@@ -171,7 +191,8 @@ inline bool unsetOverlay(int fd, int ovId) {
 }
 
 inline bool getOverlay(int fd, mdp_overlay& ov) {
-    if (ioctl(fd, MSMFB_OVERLAY_GET, &ov) < 0) {
+    android_atomic_inc(&sIoctlCount);
+    if (qdutils::devIoctl(fd, MSMFB_OVERLAY_GET, &ov) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_GET err=%s",
                 strerror(errno));
         return false;
@@ -180,7 +201,8 @@ inline bool getOverlay(int fd, mdp_overlay& ov) {
 }
 
 inline bool play(int fd, msmfb_overlay_data& od) {
-    if (ioctl(fd, MSMFB_OVERLAY_PLAY, &od) < 0) {
+    android_atomic_inc(&sIoctlCount);
+    if (qdutils::devIoctl(fd, MSMFB_OVERLAY_PLAY, &od) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_PLAY err=%s",
                 strerror(errno));
         return false;
@@ -189,7 +211,8 @@ inline bool play(int fd, msmfb_overlay_data& od) {
 }
 
 inline bool set3D(int fd, msmfb_overlay_3d& ov) {
-    if (ioctl(fd, MSMFB_OVERLAY_3D, &ov) < 0) {
+    android_atomic_inc(&sIoctlCount);
+    if (qdutils::devIoctl(fd, MSMFB_OVERLAY_3D, &ov) < 0) {
         ALOGE("Failed to call ioctl MSMFB_OVERLAY_3D err=%s",
                 strerror(errno));
         return false;
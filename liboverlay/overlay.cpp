@@ -27,11 +27,16 @@
 * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <unistd.h>
 #include "overlay.h"
 #include "pipes/overlayGenPipe.h"
 #include "mdp_version.h"
 
 #define PIPE_DEBUG 0
+/* Default rounds, and ms, an unused pipe is parked before being
+ * destroyed */
+#define PIPE_GRACE_ROUNDS 30
+#define PIPE_GRACE_MS 500
 
 namespace overlay {
 using namespace utils;
@@ -53,7 +58,23 @@ Overlay::Overlay() {
         mPipeBook[i].init();
     }
 
+    mGraceRounds = PIPE_GRACE_ROUNDS;
+    if (property_get("debug.overlay.pipe.grace", property, NULL) > 0) {
+        mGraceRounds = atoi(property);
+    }
+    int graceMs = PIPE_GRACE_MS;
+    if (property_get("debug.overlay.pipe.grace.ms", property, NULL) > 0) {
+        graceMs = atoi(property);
+    }
+    mGraceTime = ms2ns(graceMs);
+    mParks = mRevives = mReclaims = mExpiries = 0;
+    mFrameMask = mFrameFailMask = 0;
+    mFramesCommitted = mFramesRejected = mFramesRolledBack = 0;
+
     mDumpStr[0] = '\0';
+    mPendingMask = 0;
+    memset(mDemand, 0, sizeof(mDemand));
+    mDemandMask = 0;
 }
 
 Overlay::~Overlay() {
@@ -69,48 +90,265 @@ void Overlay::configBegin() {
         PipeBook::resetAllocation(i);
     }
     mDumpStr[0] = '\0';
+    mPendingMask = 0;
+    memset(mDemand, 0, sizeof(mDemand));
+    mDemandMask = 0;
 }
 
-void Overlay::configDone() {
-    if(PipeBook::pipeUsageUnchanged()) return;
+void Overlay::setDemand(eMdpPipeType type, int dpy, int count) {
+    if(type < OV_MDP_PIPE_ANY && dpy >= 0 && dpy < MAX_DEMAND_DISPLAYS)
+        mDemand[type][dpy] = count;
+}
+
+int Overlay::pendingDemand(eMdpPipeType type, int dpy) {
+    if(!mDemand[type][dpy])
+        return 0;
+    int served = 0;
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(getPipeType((eDest)i) == type && mPipeBook[i].mDisplay == dpy &&
+                PipeBook::isAllocated(i) && (mDemandMask & (1 << i)))
+            served++;
+    }
+    int pending = mDemand[type][dpy] - served;
+    return (pending > 0) ? pending : 0;
+}
 
+bool Overlay::isFreeFor(int index, int dpy) {
+    if(PipeBook::isAllocated(index))
+        return false;
+    int owner = mPipeBook[index].mDisplay;
+    return owner == dpy || owner == PipeBook::DPY_UNUSED ||
+            (mPipeBook[index].valid() && mPipeBook[index].mIdleRounds);
+}
+
+bool Overlay::isSpare(int index) {
+    eMdpPipeType type = getPipeType((eDest)index);
+    int pendingMask = 0;
+    int pending = 0;
+    //Each display needs enough of the pipes it could get, pipes in use by
+    //other displays don't count
+    for(int dpy = 0; dpy < MAX_DEMAND_DISPLAYS; dpy++) {
+        int need = pendingDemand(type, dpy);
+        if(!need)
+            continue;
+        int free = 0;
+        for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+            if(i != index && getPipeType((eDest)i) == type &&
+                    isFreeFor(i, dpy))
+                free++;
+        }
+        if(free < need)
+            return false;
+        pendingMask |= (1 << dpy);
+        pending += need;
+    }
+    if(!pending)
+        return true;
+    //And all of them together, where they compete for the same pipes
+    int pool = 0;
     for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
-        if(PipeBook::isNotUsed(i)) {
-            //Forces UNSET on pipes, flushes rotator memory and session, closes
-            //fds
-            if(mPipeBook[i].valid()) {
-                char str[32];
-                sprintf(str, "Unset pipe=%s dpy=%d; ", getDestStr((eDest)i),
-                        mPipeBook[i].mDisplay);
-                strncat(mDumpStr, str, strlen(str));
+        if(i == index || getPipeType((eDest)i) != type)
+            continue;
+        for(int dpy = 0; dpy < MAX_DEMAND_DISPLAYS; dpy++) {
+            if((pendingMask & (1 << dpy)) && isFreeFor(i, dpy)) {
+                pool++;
+                break;
             }
-            mPipeBook[i].destroy();
         }
     }
+    return pool >= pending;
+}
+
+void Overlay::reserveBegin(int dpyMask) {
+    android::Mutex::Autolock lock(mLock);
+    mPendingMask = dpyMask;
+}
+
+void Overlay::reserveDone(int dpy) {
+    android::Mutex::Autolock lock(mLock);
+    if(mPendingMask & (1 << dpy)) {
+        mPendingMask &= ~(1 << dpy);
+        mReserveCond.broadcast();
+    }
+}
+
+void Overlay::waitForTurn(int dpy) {
+    //Higher numbered displays get the unowned pipes first, like in the
+    //serial order of prepare
+    const int32_t ahead = ~((1 << (dpy + 1)) - 1);
+    while(mPendingMask & ahead)
+        mReserveCond.wait(mLock);
+}
+
+void Overlay::configDone() {
+    bool parked = false;
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(!mPipeBook[i].valid())
+            continue;
+        if(mPipeBook[i].mIdleRounds)
+            parked = true;
+        //Rotator output is reused only for a source queued last round.
+        //Pipes off the rotator dropped theirs when committed
+        if(mPipeBook[i].mPipe->isRotUsed())
+            mPipeBook[i].mPipe->roundDone();
+    }
+    //Parked pipes age every round
+    if(PipeBook::pipeUsageUnchanged() && !parked) return;
+
+    nsecs_t now = systemTime();
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(PipeBook::isUsed(i)) {
+            mPipeBook[i].mIdleRounds = 0;
+            continue;
+        }
+        if(mPipeBook[i].valid() && mPipeBook[i].mIdleRounds) {
+            //Parked, till it runs out of rounds or time
+            if(mPipeBook[i].mIdleRounds++ < mGraceRounds &&
+                    now - mPipeBook[i].mParkTime < mGraceTime)
+                continue;
+        } else if(mPipeBook[i].valid() && mGraceRounds && mGraceTime) {
+            //Off the screen, but ready to come back in a commit
+            mPipeBook[i].mPipe->park();
+            //Comes back with another layer, if at all
+            mPipeBook[i].setLast(-1, 0, NULL);
+            mPipeBook[i].mIdleRounds = 1;
+            mPipeBook[i].mParkTime = now;
+            mParks++;
+            char str[32];
+            sprintf(str, "Park pipe=%s dpy=%d; ", getDestStr((eDest)i),
+                    mPipeBook[i].mDisplay);
+            strncat(mDumpStr, str, strlen(str));
+            continue;
+        }
+        //Forces UNSET on pipes, flushes rotator memory and session, closes
+        //fds
+        if(mPipeBook[i].valid()) {
+            char str[32];
+            sprintf(str, "Unset pipe=%s dpy=%d; ", getDestStr((eDest)i),
+                    mPipeBook[i].mDisplay);
+            strncat(mDumpStr, str, strlen(str));
+            if(mPipeBook[i].mIdleRounds)
+                mExpiries++;
+        }
+        mPipeBook[i].destroy();
+    }
     dump();
     PipeBook::save();
 }
 
-eDest Overlay::nextPipe(eMdpPipeType type, int dpy) {
-    eDest dest = OV_INVALID;
+void Overlay::expireParked(bool all) {
+    nsecs_t now = systemTime();
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(!mPipeBook[i].valid() || !mPipeBook[i].mIdleRounds)
+            continue;
+        if(!all && now - mPipeBook[i].mParkTime < mGraceTime)
+            continue;
+        ALOGD_IF(PIPE_DEBUG, "Expire pipe=%s dpy=%d",
+                getDestStr((eDest)i), mPipeBook[i].mDisplay);
+        mPipeBook[i].destroy();
+        mExpiries++;
+    }
+}
 
+nsecs_t Overlay::getParkDeadline() {
+    nsecs_t deadline = 0;
     for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
-        //Match requested pipe type
-        if(type == OV_MDP_PIPE_ANY || type == getPipeType((eDest)i)) {
-            //If the pipe is not allocated to any display or used by the
-            //requesting display already in previous round.
-            if((mPipeBook[i].mDisplay == PipeBook::DPY_UNUSED ||
-                    mPipeBook[i].mDisplay == dpy) &&
-                    PipeBook::isNotAllocated(i)) {
-                dest = (eDest)i;
-                PipeBook::setAllocation(i);
-                break;
+        if(!mPipeBook[i].valid() || !mPipeBook[i].mIdleRounds)
+            continue;
+        nsecs_t t = mPipeBook[i].mParkTime + mGraceTime;
+        if(!deadline || t < deadline)
+            deadline = t;
+    }
+    return deadline;
+}
+
+int Overlay::availablePipes(int dpy) {
+    int avail = 0;
+    android::Mutex::Autolock lock(mLock);
+    //Unowned pipes count only once the displays ahead are done
+    waitForTurn(dpy);
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(isAvailable(i, dpy, true))
+            avail++;
+    }
+    return avail;
+}
+
+int Overlay::usedPipes(int dpy) {
+    int used = 0;
+    android::Mutex::Autolock lock(mLock);
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mPipeBook[i].mDisplay == dpy && PipeBook::isUsed(i))
+            used++;
+    }
+    return used;
+}
+
+bool Overlay::isAvailable(int index, int dpy, bool reclaim) {
+    if(PipeBook::isAllocated(index))
+        return false;
+    if(mPipeBook[index].mDisplay == dpy)
+        return true;
+    //A display ahead may still claim an unowned pipe
+    waitForTurn(dpy);
+    if(PipeBook::isAllocated(index))
+        return false;
+    if(mPipeBook[index].mDisplay == PipeBook::DPY_UNUSED)
+        return true;
+    //Any display can take over a pipe parked by another one, its owner
+    //didn't use it last round
+    return reclaim && mPipeBook[index].valid() && mPipeBook[index].mIdleRounds;
+}
+
+eDest Overlay::nextPipe(eMdpPipeType type, int dpy, bool fallback) {
+    eDest dest = OV_INVALID;
+    android::Mutex::Autolock lock(mLock);
+
+    //Requests try the least capable type they can use first: DMA, which
+    //can't scale, then RGB, then VG, the only one for video. The types a
+    //request accepts are then a suffix of that order, so taking the least
+    //capable free pipe gives a maximal assignment in any request order.
+    //Video must still win the VG pipes over UI that could go to GPU, so a
+    //fallback only gets a pipe the displays' video demand can spare.
+    bool kept = false;
+
+    //Pipes parked by other displays are reclaimed only if nothing else is
+    //left, they may come back to their owner
+    for(int pass = 0; pass < 2 && dest == OV_INVALID; pass++) {
+        for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+            //Match requested pipe type
+            if(type == OV_MDP_PIPE_ANY || type == getPipeType((eDest)i)) {
+                //If the pipe is not allocated to any display, used by the
+                //requesting display already in previous round or parked by
+                //another display.
+                if(isAvailable(i, dpy, pass == 1)) {
+                    if(fallback && !isSpare(i)) {
+                        kept = true;
+                        continue;
+                    }
+                    dest = (eDest)i;
+                    PipeBook::setAllocation(i);
+                    break;
+                }
             }
         }
     }
 
     if(dest != OV_INVALID) {
         int index = (int)dest;
+        if(!fallback && type < OV_MDP_PIPE_ANY)
+            android_atomic_or((1 << index), &mDemandMask);
+        else
+            android_atomic_and(~(1 << index), &mDemandMask);
+        if(mPipeBook[index].valid() && mPipeBook[index].mDisplay != dpy) {
+            //Parked by another display, which gives it up. Its session is
+            //unset and closed before this display opens its own.
+            mPipeBook[index].destroy();
+            mReclaims++;
+        } else if(mPipeBook[index].valid() && mPipeBook[index].mIdleRounds) {
+            mPipeBook[index].mPipe->invalidateRotCache();
+            mRevives++;
+        }
         //If the pipe is not registered with any display OR if the pipe is
         //requested again by the same display using it, then go ahead.
         mPipeBook[index].mDisplay = dpy;
@@ -121,13 +359,37 @@ eDest Overlay::nextPipe(eMdpPipeType type, int dpy) {
             strncat(mDumpStr, str, strlen(str));
         }
     } else {
-        ALOGD_IF(PIPE_DEBUG, "Pipe unavailable type=%d display=%d",
-                (int)type, dpy);
+        ALOGD_IF(PIPE_DEBUG, "Pipe %s type=%d display=%d",
+                kept ? "kept for demand" : "unavailable", (int)type, dpy);
     }
 
     return dest;
 }
 
+void Overlay::clear(int dpy) {
+    android::Mutex::Autolock lock(mLock);
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mPipeBook[i].mDisplay == dpy) {
+            PipeBook::resetUse(i);
+            PipeBook::resetAllocation(i);
+        }
+    }
+}
+
+int Overlay::reusePipes(int dpy) {
+    int reused = 0;
+    android::Mutex::Autolock lock(mLock);
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mPipeBook[i].mDisplay == dpy && mPipeBook[i].valid() &&
+                PipeBook::wasUsed(i)) {
+            PipeBook::setUse(i);
+            PipeBook::setAllocation(i);
+            reused++;
+        }
+    }
+    return reused;
+}
+
 bool Overlay::commit(utils::eDest dest) {
     bool ret = false;
     int index = (int)dest;
@@ -138,6 +400,7 @@ bool Overlay::commit(utils::eDest dest) {
         PipeBook::setUse((int)dest);
     } else {
         PipeBook::resetUse((int)dest);
+        android::Mutex::Autolock lock(mLock);
         int dpy = mPipeBook[index].mDisplay;
         for(int i = 0; i < PipeBook::NUM_PIPES; i++)
             if (mPipeBook[i].mDisplay == dpy)
@@ -147,17 +410,100 @@ bool Overlay::commit(utils::eDest dest) {
 }
 
 bool Overlay::queueBuffer(int fd, uint32_t offset,
-        utils::eDest dest) {
+        utils::eDest dest, const void *bufId) {
     int index = (int)dest;
     bool ret = false;
     validate(index);
+    int dpyBit = 1 << mPipeBook[index].mDisplay;
     //Queue only if commit() has succeeded (and the bit set)
-    if(PipeBook::isUsed((int)dest)) {
-        ret = mPipeBook[index].mPipe->queueBuffer(fd, offset);
+    if(PipeBook::isUsed((int)dest) && fd >= 0) {
+        if(mFrameMask & dpyBit) {
+            //Played with the rest of the frame
+            mPipeBook[index].mFrameFd = fd;
+            mPipeBook[index].mFrameOffset = offset;
+            mPipeBook[index].mFrameBufId = bufId;
+            return true;
+        }
+        ret = mPipeBook[index].mPipe->queueBuffer(fd, offset, bufId);
+        if(ret)
+            mPipeBook[index].setLast(fd, offset, bufId);
+    } else if(mFrameMask & dpyBit) {
+        android_atomic_or(dpyBit, &mFrameFailMask);
     }
     return ret;
 }
 
+void Overlay::frameBegin(int dpy) {
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mPipeBook[i].mDisplay == dpy)
+            mPipeBook[i].mFrameFd = -1;
+    }
+    android_atomic_and(~(1 << dpy), &mFrameFailMask);
+    android_atomic_or((1 << dpy), &mFrameMask);
+}
+
+bool Overlay::frameCommit(int dpy) {
+    android_atomic_and(~(1 << dpy), &mFrameMask);
+
+    //Validate the whole frame before any of it goes to MDP
+    bool valid = !(mFrameFailMask & (1 << dpy));
+    for(int i = 0; valid && i < PipeBook::NUM_PIPES; i++) {
+        if(mPipeBook[i].mDisplay == dpy && mPipeBook[i].mFrameFd >= 0 &&
+                (!mPipeBook[i].valid() || !mPipeBook[i].mPipe->isOpen() ||
+                PipeBook::isNotUsed(i)))
+            valid = false;
+    }
+    if(!valid) {
+        ALOGE("%s: frame of dpy=%d rejected, nothing played", __FUNCTION__,
+                dpy);
+        mFramesRejected++;
+        return false;
+    }
+
+    int played = 0;
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mPipeBook[i].mDisplay != dpy || mPipeBook[i].mFrameFd < 0)
+            continue;
+        if(!mPipeBook[i].mPipe->queueBuffer(mPipeBook[i].mFrameFd,
+                mPipeBook[i].mFrameOffset, mPipeBook[i].mFrameBufId)) {
+            ALOGE("%s: play failed pipe=%s dpy=%d, rolling back %d pipes",
+                    __FUNCTION__, getDestStr((eDest)i), dpy, played);
+            frameRollback(dpy, i);
+            mFramesRolledBack++;
+            return false;
+        }
+        played++;
+    }
+
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(mPipeBook[i].mDisplay == dpy && mPipeBook[i].mFrameFd >= 0)
+            mPipeBook[i].setLast(mPipeBook[i].mFrameFd,
+                    mPipeBook[i].mFrameOffset, mPipeBook[i].mFrameBufId);
+    }
+    mFramesCommitted++;
+    return true;
+}
+
+void Overlay::frameRollback(int dpy, int failed) {
+    //The rotator may have taken the source of the failed pipe, which never
+    //made it to the panel
+    mPipeBook[failed].mPipe->invalidateRotCache();
+    //The panel still shows the last frame, whose buffers are held till the
+    //next commit, so they can be played again from the dups kept of them
+    for(int i = 0; i < failed; i++) {
+        if(mPipeBook[i].mDisplay != dpy || mPipeBook[i].mFrameFd < 0)
+            continue;
+        if(mPipeBook[i].mLastFd < 0 || !mPipeBook[i].mPipe->queueBuffer(
+                mPipeBook[i].mLastFd, mPipeBook[i].mLastOffset,
+                mPipeBook[i].mLastBufId)) {
+            //Nothing good to go back to, keep the pipe off the display
+            mPipeBook[i].mPipe->park();
+            mPipeBook[i].setLast(-1, 0, NULL);
+            PipeBook::resetUse(i);
+        }
+    }
+}
+
 void Overlay::setCrop(const utils::Dim& d,
         utils::eDest dest) {
     int index = (int)dest;
@@ -211,6 +557,10 @@ Overlay* Overlay::getInstance() {
     return sInstance;
 }
 
+void Overlay::setReleaseFence(int dpy, int fd) {
+    RotMemPool::getInstance()->setReleaseFence(dpy, fd);
+}
+
 void Overlay::initOverlay() {
     if(utils::initOverlay() == -1) {
         ALOGE("%s failed", __FUNCTION__);
@@ -231,19 +581,34 @@ void Overlay::getDump(char *buf, size_t len) {
         if(mPipeBook[i].valid()) {
             mPipeBook[i].mPipe->getDump(buf, len);
             char str[64] = {'\0'};
-            snprintf(str, 64, "Attached to dpy=%d\n\n", mPipeBook[i].mDisplay);
+            snprintf(str, 64, "Attached to dpy=%d%s\n\n",
+                    mPipeBook[i].mDisplay,
+                    mPipeBook[i].mIdleRounds ? " (parked)" : "");
             strncat(buf, str, strlen(str));
             totalPipes++;
         }
     }
-    char str_pipes[64] = {'\0'};
-    snprintf(str_pipes, 64, "Pipes used=%d\n\n", totalPipes);
+    char str_pipes[128] = {'\0'};
+    snprintf(str_pipes, 128, "Pipes used=%d grace=%d parked=%u revived=%u "
+            "reclaimed=%u expired=%u\n", totalPipes, mGraceRounds, mParks,
+            mRevives, mReclaims, mExpiries);
+    char str_frames[128] = {'\0'};
+    snprintf(str_frames, 128, "Frames committed=%u rejected=%u "
+            "rolled back=%u\n\n", mFramesCommitted, mFramesRejected,
+            mFramesRolledBack);
     strncat(buf, str_pipes, strlen(str_pipes));
+    strncat(buf, str_frames, strlen(str_frames));
+    RotMemPool::getInstance()->getDump(buf, len);
 }
 
 void Overlay::PipeBook::init() {
     mPipe = NULL;
     mDisplay = DPY_UNUSED;
+    mIdleRounds = 0;
+    mParkTime = 0;
+    mFrameFd = mLastFd = mLastSrcFd = -1;
+    mFrameOffset = mLastOffset = 0;
+    mFrameBufId = mLastBufId = NULL;
 }
 
 void Overlay::PipeBook::destroy() {
@@ -252,13 +617,35 @@ void Overlay::PipeBook::destroy() {
         mPipe = NULL;
     }
     mDisplay = DPY_UNUSED;
+    mIdleRounds = 0;
+    mParkTime = 0;
+    mFrameFd = -1;
+    mFrameOffset = 0;
+    mFrameBufId = NULL;
+    setLast(-1, 0, NULL);
+}
+
+void Overlay::PipeBook::setLast(int fd, uint32_t offset,
+        const void *bufId) {
+    //Still, paused or repeated buffers cost no dup every frame. The fd
+    //alone may have been reused for another buffer since
+    if(fd >= 0 && fd == mLastSrcFd && offset == mLastOffset && bufId &&
+            bufId == mLastBufId)
+        return;
+    int last = (fd >= 0) ? dup(fd) : -1;
+    if(mLastFd >= 0)
+        ::close(mLastFd);
+    mLastFd = last;
+    mLastSrcFd = (last >= 0) ? fd : -1;
+    mLastOffset = offset;
+    mLastBufId = (last >= 0) ? bufId : NULL;
 }
 
 Overlay* Overlay::sInstance = 0;
 int Overlay::sExtFbIndex = 1;
 int Overlay::PipeBook::NUM_PIPES = 0;
-int Overlay::PipeBook::sPipeUsageBitmap = 0;
-int Overlay::PipeBook::sLastUsageBitmap = 0;
-int Overlay::PipeBook::sAllocatedBitmap = 0;
+volatile int32_t Overlay::PipeBook::sPipeUsageBitmap = 0;
+int32_t Overlay::PipeBook::sLastUsageBitmap = 0;
+volatile int32_t Overlay::PipeBook::sAllocatedBitmap = 0;
 
 }; // namespace overlay
@@ -30,8 +30,13 @@
 #ifndef OVERLAY_H
 #define OVERLAY_H
 
+#include <cutils/atomic.h>
 #include "overlayUtils.h"
 #include "utils/threads.h"
+#include <utils/Timers.h>
+
+//Displays a pipe demand can be set for
+#define MAX_DEMAND_DISPLAYS 3
 
 namespace overlay {
 class GenericPipe;
@@ -50,22 +55,79 @@ public:
      * Will do garbage collection of pipe objects and thus calling UNSETs,
      * closing FDs, removing rotator objects and memory, if allocated.
      * Should be called after all pipe configs are done.
+     * Pipes unused in this round are parked instead, for up to
+     * debug.overlay.pipe.grace rounds or debug.overlay.pipe.grace.ms, and
+     * are only destroyed if they stay unused that long or another display
+     * needs them.
      */
     void configDone();
 
+    /* Destroys the pipes parked longer than the grace time, or all parked
+     * pipes if "all", e.g. on blank. For screens that stop composing, so
+     * no round ages the parked pipes */
+    void expireParked(bool all);
+    /* Returns when the next parked pipe expires, 0 if none is parked */
+    nsecs_t getParkDeadline();
+
     /* Returns an available pipe based on the type of pipe requested. When ANY
      * is requested, the first available VG or RGB is returned. If no pipe is
      * available for the display "dpy" then INV is returned. Note: If a pipe is
      * assigned to a certain display, then it cannot be assigned to another
-     * display without being garbage-collected once */
-    utils::eDest nextPipe(utils::eMdpPipeType, int dpy);
+     * display without being garbage-collected once, or being parked and
+     * reclaimed when no other pipe is available.
+     * A "fallback" request could also be served by a less capable type, e.g.
+     * a UI layer asking for VG once RGB ran out. It is refused a pipe that
+     * would leave a display short of the demand set with setDemand() */
+    utils::eDest nextPipe(utils::eMdpPipeType, int dpy, bool fallback = false);
+
+    /* Sets how many pipes of "type" display "dpy" needs in this round for
+     * requests that only that type can serve, e.g. video on VG. Call after
+     * configBegin(), before any display allocates */
+    void setDemand(utils::eMdpPipeType type, int dpy, int count);
+
+    /* Releases the pipes allocated and committed by display "dpy" in the
+     * current round, so that the display can retry with another strategy.
+     * Pipes not reacquired by configDone() are garbage-collected */
+    void clear(int dpy);
+
+    /* Marks the pipes committed by display "dpy" in the last round as used in
+     * the current round, with their config untouched. For displays reusing
+     * the last round's setup as is. Returns the number of pipes reused */
+    int reusePipes(int dpy);
+
+    /* Lets the displays in "dpyMask" allocate pipes concurrently in this
+     * round. A display waits for all higher numbered displays in the mask to
+     * call reserveDone() before it looks at pipes not owned by it, so the
+     * allocation is the same as preparing the displays serially from the
+     * highest one down. Call after configBegin() */
+    void reserveBegin(int dpyMask);
+
+    /* Display "dpy" is done allocating pipes for this round */
+    void reserveDone(int dpy);
 
     void setSource(const utils::PipeArgs args, utils::eDest dest);
     void setCrop(const utils::Dim& d, utils::eDest dest);
     void setTransform(const int orientation, utils::eDest dest);
     void setPosition(const utils::Dim& dim, utils::eDest dest);
     bool commit(utils::eDest dest);
-    bool queueBuffer(int fd, uint32_t offset, utils::eDest dest);
+    /* "bufId" identifies the buffer across frames, e.g. its gralloc handle,
+     * so the rotator can skip a source it already holds. NULL if unknown */
+    bool queueBuffer(int fd, uint32_t offset, utils::eDest dest,
+            const void *bufId);
+
+    /* Starts a frame of display "dpy". Until frameCommit(), queueBuffer() on
+     * its pipes only gathers the buffers and validates the pipes */
+    void frameBegin(int dpy);
+    /* Plays the buffers gathered for display "dpy" as one batch. Nothing is
+     * played if any pipe of the frame failed validation. If a play fails
+     * midway, the pipes already played go back to their last good buffers.
+     * Returns false in both cases, the panel keeps the last frame on the
+     * pipes of the display */
+    bool frameCommit(int dpy);
+
+    /* Sets the release fence of the frame being committed on display "dpy".
+     * Rotator memory given up now is freed only once it signals */
+    void setReleaseFence(int dpy, int fd);
 
     /* Closes open pipes, called during startup */
     static void initOverlay();
@@ -73,6 +135,10 @@ public:
     static Overlay* getInstance();
     /* Returns available ("unallocated") pipes for a display */
     int availablePipes(int dpy);
+    /* Returns pipes committed in the current drawing round */
+    int usedPipes();
+    /* Returns pipes committed by display "dpy" in the current drawing round */
+    int usedPipes(int dpy);
     /* set the framebuffer index for external display */
     void setExtFbNum(int fbNum);
     /* Returns framebuffer index of the current external display */
@@ -88,6 +154,25 @@ private:
     /*Validate index range, abort if invalid */
     void validate(int index);
     void dump() const;
+    /* Waits till displays ahead of "dpy" are done allocating. Called with
+     * mLock held, which is released while waiting */
+    void waitForTurn(int dpy);
+    /* Returns true if display "dpy" can be given pipe "index" in this
+     * round. Waits for its turn if that depends on the displays ahead.
+     * Pipes parked by other displays count only if "reclaim". Called with
+     * mLock held */
+    bool isAvailable(int index, int dpy, bool reclaim);
+    /* Plays the last good buffers again on the pipes of display "dpy" that
+     * were played in its frame before pipe "failed" */
+    void frameRollback(int dpy, int failed);
+    /* Pipes of "type" display "dpy" still needs for its demand */
+    int pendingDemand(utils::eMdpPipeType type, int dpy);
+    /* Returns true if pipe "index" could still be allocated to display
+     * "dpy" in this round, by allocation state and ownership alone */
+    bool isFreeFor(int index, int dpy);
+    /* Returns true if taking pipe "index" leaves every display enough
+     * pipes of its type for its pending demand. Called with mLock held */
+    bool isSpare(int index);
 
     /* Just like a Facebook for pipes, but much less profile info */
     struct PipeBook {
@@ -95,6 +180,10 @@ private:
 
         void init();
         void destroy();
+        /* Remembers the buffer last played successfully, keeping a dup of
+         * "fd" since the client may close or reuse it. The dup is taken
+         * only when the buffer differs from the last. -1 forgets it */
+        void setLast(int fd, uint32_t offset, const void *bufId);
         /* Check if pipe exists and return true, false otherwise */
         bool valid();
 
@@ -102,6 +191,20 @@ private:
         GenericPipe *mPipe;
         /* Display using this pipe. Refer to enums above */
         int mDisplay;
+        /* Rounds the pipe has been parked for, 0 if in use */
+        int mIdleRounds;
+        /* When the pipe was parked */
+        nsecs_t mParkTime;
+        /* Buffer gathered for the frame of mDisplay, -1 if none */
+        int mFrameFd;
+        uint32_t mFrameOffset;
+        const void *mFrameBufId;
+        /* Dup of the buffer last played successfully, -1 if none */
+        int mLastFd;
+        uint32_t mLastOffset;
+        const void *mLastBufId;
+        /* Client fd mLastFd was dup'ed from */
+        int mLastSrcFd;
 
         /* operations on bitmap */
         static bool pipeUsageUnchanged();
@@ -109,6 +212,7 @@ private:
         static void resetUse(int index);
         static bool isUsed(int index);
         static bool isNotUsed(int index);
+        static bool wasUsed(int index);
         static void save();
 
         static void setAllocation(int index);
@@ -123,13 +227,15 @@ private:
         //allocated to a display, but it may not end up using it for various
         //reasons. If one display actually uses a pipe then it amy not be
         //used by another display, without an UNSET in between.
-        static int sPipeUsageBitmap;
-        static int sLastUsageBitmap;
+        //Displays may update their bits from different threads, hence the
+        //atomic updates.
+        static volatile int32_t sPipeUsageBitmap;
+        static int32_t sLastUsageBitmap;
         //Tracks which pipe objects are allocated. This does not imply that they
         //will actually be used. For example, a display might choose to acquire
         //3 pipe objects in one shot and proceed with config only if it gets all
         //3. The bitmap helps allocate different pipe objects on each request.
-        static int sAllocatedBitmap;
+        static volatile int32_t sAllocatedBitmap;
     };
 
     PipeBook mPipeBook[utils::OV_INVALID]; //Used as max
@@ -137,6 +243,36 @@ private:
     /* Dump string */
     char mDumpStr[256];
 
+    /* Rounds, and time, an unused pipe stays parked before it is
+     * destroyed */
+    int mGraceRounds;
+    nsecs_t mGraceTime;
+    /* Pipe retention stats */
+    uint32_t mParks;
+    uint32_t mRevives;
+    uint32_t mReclaims;
+    uint32_t mExpiries;
+
+    /* Displays gathering a frame, and those whose frame failed validation */
+    volatile int32_t mFrameMask;
+    volatile int32_t mFrameFailMask;
+    /* Frame commit stats */
+    uint32_t mFramesCommitted;
+    uint32_t mFramesRejected;
+    uint32_t mFramesRolledBack;
+
+    /* Demand per pipe type and display set for this round */
+    int mDemand[utils::OV_MDP_PIPE_ANY][MAX_DEMAND_DISPLAYS];
+    /* Pipes allocated to the demand in this round */
+    volatile int32_t mDemandMask;
+
+    /* Displays yet to call reserveDone() in this round */
+    volatile int32_t mPendingMask;
+    /* Guards mPendingMask, mDumpStr and which display owns each pipe
+     * (mDisplay, mIdleRounds, mPipe) while displays allocate in parallel */
+    android::Mutex mLock;
+    android::Condition mReserveCond;
+
     /* Singleton Instance*/
     static Overlay *sInstance;
     static int sExtFbIndex;
@@ -149,15 +285,13 @@ inline void Overlay::validate(int index) {
             utils::getDestStr((utils::eDest)index));
 }
 
-inline int Overlay::availablePipes(int dpy) {
-     int avail = 0;
-     for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
-       if((mPipeBook[i].mDisplay == PipeBook::DPY_UNUSED ||
-           mPipeBook[i].mDisplay == dpy) && PipeBook::isNotAllocated(i)) {
-                avail++;
-        }
+inline int Overlay::usedPipes() {
+    int used = 0;
+    for(int i = 0; i < PipeBook::NUM_PIPES; i++) {
+        if(PipeBook::isUsed(i))
+            used++;
     }
-    return avail;
+    return used;
 }
 
 inline void Overlay::setExtFbNum(int fbNum) {
@@ -177,11 +311,11 @@ inline bool Overlay::PipeBook::pipeUsageUnchanged() {
 }
 
 inline void Overlay::PipeBook::setUse(int index) {
-    sPipeUsageBitmap |= (1 << index);
+    android_atomic_or((1 << index), &sPipeUsageBitmap);
 }
 
 inline void Overlay::PipeBook::resetUse(int index) {
-    sPipeUsageBitmap &= ~(1 << index);
+    android_atomic_and(~(1 << index), &sPipeUsageBitmap);
 }
 
 inline bool Overlay::PipeBook::isUsed(int index) {
@@ -192,16 +326,20 @@ inline bool Overlay::PipeBook::isNotUsed(int index) {
     return !isUsed(index);
 }
 
+inline bool Overlay::PipeBook::wasUsed(int index) {
+    return sLastUsageBitmap & (1 << index);
+}
+
 inline void Overlay::PipeBook::save() {
     sLastUsageBitmap = sPipeUsageBitmap;
 }
 
 inline void Overlay::PipeBook::setAllocation(int index) {
-    sAllocatedBitmap |= (1 << index);
+    android_atomic_or((1 << index), &sAllocatedBitmap);
 }
 
 inline void Overlay::PipeBook::resetAllocation(int index) {
-    sAllocatedBitmap &= ~(1 << index);
+    android_atomic_and(~(1 << index), &sAllocatedBitmap);
 }
 
 inline bool Overlay::PipeBook::isAllocated(int index) {
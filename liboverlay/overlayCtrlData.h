@@ -56,6 +56,8 @@ public:
     bool init(uint32_t fbnum);
     /* close underlying mdp */
     bool close();
+    /* take the pipe off the display, keeping the fd */
+    bool unset();
 
     /* set source using whf, orient and wait flag */
     bool setSource(const utils::PipeArgs& args);
@@ -171,6 +173,10 @@ inline bool Ctrl::close() {
     return true;
 }
 
+inline bool Ctrl::unset() {
+    return mMdp.unset();
+}
+
 inline bool Ctrl::commit() {
     if(!mMdp.set()) {
         ALOGE("Ctrl commit failed set overlay");
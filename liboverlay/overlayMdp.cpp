@@ -56,6 +56,15 @@ void MdpCtrl::reset() {
 }
 
 bool MdpCtrl::close() {
+    bool result = unset();
+    if(!mFd.close()) {
+        result = false;
+    }
+
+    return result;
+}
+
+bool MdpCtrl::unset() {
     bool result = true;
 
     if(MSMFB_NEW_REQUEST != static_cast<int>(mOVInfo.id)) {
@@ -66,10 +75,6 @@ bool MdpCtrl::close() {
     }
 
     reset();
-    if(!mFd.close()) {
-        result = false;
-    }
-
     return result;
 }
 
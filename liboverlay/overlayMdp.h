@@ -43,6 +43,9 @@ public:
     /* unset overlay, reset and close fd */
     bool close();
 
+    /* unset overlay and reset, keeping the fd open */
+    bool unset();
+
     /* reset and set ov id to -1 / MSMFB_NEW_REQUEST */
     void reset();
 
@@ -141,6 +141,8 @@ inline void MdpRot::doTransform() {
 bool MdpRot::commit() {
     doTransform();
     if(rotConfChanged()) {
+        // The output rotated with the old config can't be played again
+        mCache.invalidate();
         if(!overlay::mdp_wrapper::startRotator(mFd.getFD(), mRotImgInfo)) {
             ALOGE("MdpRot commit failed");
             dump();
@@ -160,22 +162,17 @@ uint32_t MdpRot::calcOutputBufSize() {
 
 bool MdpRot::open_i(uint32_t numbufs, uint32_t bufsz)
 {
-    OvMem mem;
-
-    OVASSERT(MAP_FAILED == mem.addr(), "MAP failed in open_i");
-
-    if(!mem.open(numbufs, bufsz, mRotImgInfo.secure)){
+    //Comes from the rot mem pool, without ION allocation in steady state
+    if(!mMem.curr().open(numbufs, bufsz, mRotImgInfo.secure)){
         ALOGE("%s: Failed to open", __func__);
-        mem.close();
         return false;
     }
 
-    OVASSERT(MAP_FAILED != mem.addr(), "MAP failed");
-    OVASSERT(mem.getFD() != -1, "getFd is -1");
+    OVASSERT(MAP_FAILED != mMem.curr().m.addr(), "MAP failed");
+    OVASSERT(mMem.curr().m.getFD() != -1, "getFd is -1");
 
-    mRotDataInfo.dst.memory_id = mem.getFD();
+    mRotDataInfo.dst.memory_id = mMem.curr().m.getFD();
     mRotDataInfo.dst.offset = 0;
-    mMem.curr().m = mem;
     return true;
 }
 
@@ -232,10 +229,15 @@ void MdpRot::reset() {
     mMem.curr().mCurrOffset = 0;
     mMem.prev().mCurrOffset = 0;
     mOrientation = utils::OVERLAY_TRANSFORM_0;
+    mCache.invalidate();
 }
 
-bool MdpRot::queueBuffer(int fd, uint32_t offset) {
+bool MdpRot::queueBuffer(int fd, uint32_t offset, const void *bufId) {
     if(enabled()) {
+        // Nothing to rotate, the output still holds this buffer
+        if(mCache.hit(bufId, offset))
+            return true;
+
         mRotDataInfo.src.memory_id = fd;
         mRotDataInfo.src.offset = offset;
 
@@ -250,14 +252,14 @@ bool MdpRot::queueBuffer(int fd, uint32_t offset) {
         if(!overlay::mdp_wrapper::rotate(mFd.getFD(), mRotDataInfo)) {
             ALOGE("MdpRot failed rotate");
             dump();
+            mCache.invalidate();
             return false;
         }
+        mCache.save(bufId, offset);
 
-        // if the prev mem is valid, we need to close
+        // if the prev mem is valid, we need to close. The pool holds on
+        // to it until the frame that scanned it out retires.
         if(mMem.prev().valid()) {
-            // FIXME if no wait for vsync the above
-            // play will return immediatly and might cause
-            // tearing when prev.close is called.
             if(!mMem.prev().close()) {
                 ALOGE("%s error in closing prev rot mem", __FUNCTION__);
                 return false;
@@ -279,6 +281,7 @@ void MdpRot::dump() const {
 void MdpRot::getDump(char *buf, size_t len) const {
     ovutils::getDump(buf, len, "MdpRotCtrl(msm_rotator_img_info)", mRotImgInfo);
     ovutils::getDump(buf, len, "MdpRotData(msm_rotator_data_info)", mRotDataInfo);
+    mCache.getDump(buf, len);
 }
 
 } // namespace overlay
@@ -127,22 +127,42 @@ inline void MdssRot::doTransform() {
         utils::swap(mRotInfo.dst_rect.w, mRotInfo.dst_rect.h);
 }
 
+inline void MdssRot::save() {
+    mLSRotInfo = mRotInfo;
+}
+
+inline bool MdssRot::rotConfChanged() const {
+    // 0 means same
+    if(0 == ::memcmp(&mRotInfo, &mLSRotInfo, sizeof (mdp_overlay))) {
+        return false;
+    }
+    return true;
+}
+
 bool MdssRot::commit() {
     doTransform();
     mRotInfo.flags |= MDSS_MDP_ROT_ONLY;
+    // The output rotated with the old config can't be played again
+    if(rotConfChanged())
+        mCache.invalidate();
     if(!overlay::mdp_wrapper::setOverlay(mFd.getFD(), mRotInfo)) {
         ALOGE("MdssRot commit failed!");
         dump();
         return false;
     }
     mRotData.id = mRotInfo.id;
+    save();
     // reset rotation flags to avoid stale orientation values
     mRotInfo.flags &= ~MDSS_ROT_MASK;
     return true;
 }
 
-bool MdssRot::queueBuffer(int fd, uint32_t offset) {
+bool MdssRot::queueBuffer(int fd, uint32_t offset, const void *bufId) {
     if(enabled()) {
+        // Nothing to rotate, the output still holds this buffer
+        if(mCache.hit(bufId, offset))
+            return true;
+
         mRotData.data.memory_id = fd;
         mRotData.data.offset = offset;
 
@@ -157,14 +177,14 @@ bool MdssRot::queueBuffer(int fd, uint32_t offset) {
         if(!overlay::mdp_wrapper::play(mFd.getFD(), mRotData)) {
             ALOGE("MdssRot play failed!");
             dump();
+            mCache.invalidate();
             return false;
         }
+        mCache.save(bufId, offset);
 
-        // if the prev mem is valid, we need to close
+        // if the prev mem is valid, we need to close. The pool holds on
+        // to it until the frame that scanned it out retires.
         if(mMem.prev().valid()) {
-            // FIXME if no wait for vsync the above
-            // play will return immediatly and might cause
-            // tearing when prev.close is called.
             if(!mMem.prev().close()) {
                 ALOGE("%s error in closing prev rot mem", __FUNCTION__);
                 return false;
@@ -176,22 +196,19 @@ bool MdssRot::queueBuffer(int fd, uint32_t offset) {
 
 bool MdssRot::open_i(uint32_t numbufs, uint32_t bufsz)
 {
-    OvMem mem;
-    OVASSERT(MAP_FAILED == mem.addr(), "MAP failed in open_i");
     bool isSecure = mRotInfo.flags & utils::OV_MDP_SECURE_OVERLAY_SESSION;
 
-    if(!mem.open(numbufs, bufsz, isSecure)){
+    //Comes from the rot mem pool, without ION allocation in steady state
+    if(!mMem.curr().open(numbufs, bufsz, isSecure)){
         ALOGE("%s: Failed to open", __func__);
-        mem.close();
         return false;
     }
 
-    OVASSERT(MAP_FAILED != mem.addr(), "MAP failed");
-    OVASSERT(mem.getFD() != -1, "getFd is -1");
+    OVASSERT(MAP_FAILED != mMem.curr().m.addr(), "MAP failed");
+    OVASSERT(mMem.curr().m.getFD() != -1, "getFd is -1");
 
-    mRotData.dst_data.memory_id = mem.getFD();
+    mRotData.dst_data.memory_id = mMem.curr().m.getFD();
     mRotData.dst_data.offset = 0;
-    mMem.curr().m = mem;
     return true;
 }
 
@@ -243,6 +260,7 @@ bool MdssRot::close() {
 
 void MdssRot::reset() {
     ovutils::memset0(mRotInfo);
+    ovutils::memset0(mLSRotInfo);
     ovutils::memset0(mRotData);
     mRotData.data.memory_id = -1;
     mRotInfo.id = MSMFB_NEW_REQUEST;
@@ -251,6 +269,7 @@ void MdssRot::reset() {
     mMem.curr().mCurrOffset = 0;
     mMem.prev().mCurrOffset = 0;
     mOrientation = utils::OVERLAY_TRANSFORM_0;
+    mCache.invalidate();
 }
 
 void MdssRot::dump() const {
@@ -278,6 +297,7 @@ uint32_t MdssRot::calcOutputBufSize() {
 void MdssRot::getDump(char *buf, size_t len) const {
     ovutils::getDump(buf, len, "MdssRotCtrl(mdp_overlay)", mRotInfo);
     ovutils::getDump(buf, len, "MdssRotData(msmfb_overlay_data)", mRotData);
+    mCache.getDump(buf, len);
 }
 
 } // namespace overlay
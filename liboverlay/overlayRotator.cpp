@@ -17,11 +17,15 @@
  * limitations under the License.
 */
 
+#include <unistd.h>
+#include <sync/sync.h>
 #include "overlayRotator.h"
 #include "overlayUtils.h"
 #include "mdp_version.h"
 #include "gr.h"
 
+#define ROT_POOL_DEBUG 0
+
 namespace ovutils = overlay::utils;
 
 namespace overlay {
@@ -56,6 +60,255 @@ int Rotator::getRotatorHwType() {
     return TYPE_MDP;
 }
 
+RotMemPool *RotMemPool::sInstance = NULL;
+pthread_once_t RotMemPool::sOnce = PTHREAD_ONCE_INIT;
+
+void RotMemPool::init() {
+    sInstance = new RotMemPool();
+}
+
+RotMemPool* RotMemPool::getInstance() {
+    //The first caller can be a rotator or a dumpsys
+    pthread_once(&sOnce, init);
+    return sInstance;
+}
+
+RotMemPool::RotMemPool() : mTotalSize(0), mHits(0), mAllocs(0),
+        mDeferred(0), mFrees(0) {
+    for(int i = 0; i < MAX_ROT_POOL_MEMS; i++) {
+        for(int d = 0; d < MAX_ROT_POOL_DISPLAYS; d++)
+            mEntries[i].fence[d] = -1;
+    }
+    for(int i = 0; i < MAX_ROT_POOL_DISPLAYS; i++)
+        mReleaseFence[i] = -1;
+    pthread_mutex_init(&mLock, NULL);
+}
+
+uint32_t RotMemPool::getBucketSize(uint32_t size) {
+    if(size < ROT_POOL_LARGE_BUCKET)
+        return utils::align(size, ROT_POOL_SMALL_BUCKET);
+    return utils::align(size, ROT_POOL_LARGE_BUCKET);
+}
+
+bool RotMemPool::isRetired(Entry& e) {
+    for(int d = 0; d < MAX_ROT_POOL_DISPLAYS; d++) {
+        if(e.fence[d] == FENCE_NEXT)
+            return false;
+        if(e.fence[d] < 0)
+            continue;
+        //Zero timeout only polls the fence
+        if(sync_wait(e.fence[d], 0) < 0)
+            return false;
+        ::close(e.fence[d]);
+        e.fence[d] = -1;
+    }
+    return true;
+}
+
+void RotMemPool::holdFences(Entry& e) {
+    for(int d = 0; d < MAX_ROT_POOL_DISPLAYS; d++) {
+        e.fence[d] = -1;
+        if(mReleaseFence[d] < 0)
+            continue;
+        e.fence[d] = dup(mReleaseFence[d]);
+        if(e.fence[d] < 0) {
+            ALOGE("%s: dup failed for dpy=%d: %s", __FUNCTION__, d,
+                    strerror(errno));
+            e.fence[d] = FENCE_NEXT;
+        }
+    }
+}
+
+int RotMemPool::getFreeSlot() const {
+    for(int i = 0; i < MAX_ROT_POOL_MEMS; i++) {
+        if(!mEntries[i].mem.valid())
+            return i;
+    }
+    return -1;
+}
+
+bool RotMemPool::evict() {
+    int victim = -1;
+    for(int i = 0; i < MAX_ROT_POOL_MEMS; i++) {
+        Entry& e = mEntries[i];
+        if(!e.mem.valid() || !isRetired(e))
+            continue;
+        if(victim < 0 || e.mem.bufSz() * e.mem.numBufs() >
+                mEntries[victim].mem.bufSz() * mEntries[victim].mem.numBufs())
+            victim = i;
+    }
+    if(victim < 0)
+        return false;
+
+    Entry& e = mEntries[victim];
+    uint32_t size = e.mem.bufSz() * e.mem.numBufs();
+    ALOGD_IF(ROT_POOL_DEBUG, "%s: freeing %u bytes", __FUNCTION__, size);
+    if(!e.mem.close())
+        ALOGE("%s: error freeing rot mem", __FUNCTION__);
+    mTotalSize -= size;
+    mFrees++;
+    return true;
+}
+
+void RotMemPool::reap() {
+    for(size_t i = 0; i < mPendingFrees.size(); ) {
+        Entry& e = mPendingFrees.editItemAt(i);
+        if(!isRetired(e)) {
+            i++;
+            continue;
+        }
+        if(!e.mem.close())
+            ALOGE("%s: error freeing rot mem", __FUNCTION__);
+        mFrees++;
+        mPendingFrees.removeAt(i);
+    }
+}
+
+bool RotMemPool::get(OvMem& mem, uint32_t numbufs, uint32_t bufSz,
+        bool isSecure) {
+    uint32_t bucket = getBucketSize(bufSz);
+
+    pthread_mutex_lock(&mLock);
+    reap();
+    for(int i = 0; !isSecure && i < MAX_ROT_POOL_MEMS; i++) {
+        Entry& e = mEntries[i];
+        if(!e.mem.valid() || e.mem.numBufs() != numbufs ||
+                e.mem.bufSz() != bucket || !isRetired(e))
+            continue;
+        mem = e.mem;
+        mTotalSize -= bucket * numbufs;
+        e.mem = OvMem();
+        mHits++;
+        pthread_mutex_unlock(&mLock);
+        ALOGD_IF(ROT_POOL_DEBUG, "%s: reusing %u x %u bytes", __FUNCTION__,
+                numbufs, bucket);
+        return true;
+    }
+    mAllocs++;
+    pthread_mutex_unlock(&mLock);
+
+    if(!mem.open(numbufs, bucket, isSecure)) {
+        ALOGE("%s: Failed to open", __FUNCTION__);
+        mem.close();
+        return false;
+    }
+    return true;
+}
+
+void RotMemPool::put(OvMem& mem, bool isSecure) {
+    if(!mem.valid())
+        return;
+    uint32_t size = mem.bufSz() * mem.numBufs();
+
+    pthread_mutex_lock(&mLock);
+    reap();
+    Entry e;
+    e.mem = mem;
+    holdFences(e);
+    mem = OvMem();
+
+    int index = -1;
+    if(!isSecure) {
+        //Make room within the cap, and for the entry itself
+        while(mTotalSize + size > ROT_POOL_MAX_SIZE && evict());
+        index = getFreeSlot();
+        if(index < 0 && evict())
+            index = getFreeSlot();
+        if(mTotalSize + size > ROT_POOL_MAX_SIZE)
+            index = -1;
+    }
+
+    if(index >= 0) {
+        mEntries[index] = e;
+        mTotalSize += size;
+    } else if(isRetired(e)) {
+        if(!e.mem.close())
+            ALOGE("%s: error freeing rot mem", __FUNCTION__);
+        mFrees++;
+    } else {
+        //Still scanned out, freed once a later call finds it retired
+        mPendingFrees.push(e);
+        mDeferred++;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+void RotMemPool::setReleaseFence(int dpy, int fd) {
+    if(dpy < 0 || dpy >= MAX_ROT_POOL_DISPLAYS)
+        return;
+    pthread_mutex_lock(&mLock);
+    //No fence, e.g. a failed buffer sync, says nothing of when the frame
+    //retires. Keep the previous one, and keep those waiting for this one
+    //waiting, rather than take memory still scanned out for retired
+    if(fd >= 0) {
+        if(mReleaseFence[dpy] >= 0)
+            ::close(mReleaseFence[dpy]);
+        mReleaseFence[dpy] = dup(fd);
+        //Memories missing a fence of this display wait for this one, later
+        //than the one they missed
+        for(int i = 0; i < MAX_ROT_POOL_MEMS; i++) {
+            if(mEntries[i].fence[dpy] == FENCE_NEXT)
+                mEntries[i].fence[dpy] = dup(fd);
+        }
+        for(size_t i = 0; i < mPendingFrees.size(); i++) {
+            Entry& e = mPendingFrees.editItemAt(i);
+            if(e.fence[dpy] == FENCE_NEXT)
+                e.fence[dpy] = dup(fd);
+        }
+    }
+    //Runs every frame, so memory kept aside goes soon after it retired
+    reap();
+    pthread_mutex_unlock(&mLock);
+}
+
+void RotMemPool::getDump(char *buf, size_t len) {
+    char str[256] = {'\0'};
+    pthread_mutex_lock(&mLock);
+    int count = 0;
+    for(int i = 0; i < MAX_ROT_POOL_MEMS; i++) {
+        if(mEntries[i].mem.valid())
+            count++;
+    }
+    snprintf(str, sizeof(str), "Rot mem pool: idle=%d bytes=%u "
+            "pending frees=%zu hits=%u allocs=%u deferred=%u freed=%u\n",
+            count, mTotalSize, mPendingFrees.size(), mHits, mAllocs,
+            mDeferred, mFrees);
+    pthread_mutex_unlock(&mLock);
+    strlcat(buf, str, len);
+}
+
+bool RotMem::Mem::open(uint32_t numbufs, uint32_t bufSz, bool isSecure) {
+    if(!RotMemPool::getInstance()->get(m, numbufs, bufSz, isSecure))
+        return false;
+    mSize = bufSz;
+    mSecure = isSecure;
+    return true;
+}
+
+bool RotMem::Mem::close() {
+    //The pool frees it once it is off the screen
+    RotMemPool::getInstance()->put(m, mSecure);
+    mSize = 0;
+    return true;
+}
+
+bool RotCache::hit(const void *bufId, uint32_t offset) {
+    if(mBufId && mBufId == bufId && mOffset == offset) {
+        mQueued = true;
+        mHits++;
+        return true;
+    }
+    mMisses++;
+    return false;
+}
+
+void RotCache::getDump(char *buf, size_t len) const {
+    char str[64] = {'\0'};
+    snprintf(str, 64, "\tcache buf=%p offset=%u hits=%u misses=%u\n",
+            mBufId, mOffset, mHits, mMisses);
+    strncat(buf, str, strlen(str));
+}
+
 bool RotMem::close() {
     bool ret = true;
     for(uint32_t i=0; i < RotMem::MAX_ROT_MEM; ++i) {
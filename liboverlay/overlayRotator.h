@@ -31,6 +31,8 @@
 #define OVERlAY_ROTATOR_H
 
 #include <stdlib.h>
+#include <pthread.h>
+#include <utils/Vector.h>
 
 #include "mdpWrapper.h"
 #include "overlayUtils.h"
@@ -60,7 +62,14 @@ public:
     virtual void setDisable() = 0;
     virtual bool enabled () const = 0;
     virtual uint32_t getSessId() const = 0;
-    virtual bool queueBuffer(int fd, uint32_t offset) = 0;
+    /* "bufId" identifies the source buffer across rounds, e.g. its gralloc
+     * handle. NULL if unknown, such a source is always rotated */
+    virtual bool queueBuffer(int fd, uint32_t offset, const void *bufId) = 0;
+    /* Ends a round. The source kept from it is played again only if the
+     * next round queues it too */
+    virtual void roundDone() = 0;
+    /* Drops the source kept, the next queue rotates again */
+    virtual void invalidateCache() = 0;
     virtual void dump() const = 0;
     virtual void getDump(char *buf, size_t len) const = 0;
     static Rotator *getRotator();
@@ -74,6 +83,84 @@ private:
     static int getRotatorHwType();
 };
 
+//Rotator memories the pool holds at most, while not in use
+#define MAX_ROT_POOL_MEMS 8
+//Bytes the pool may hold while not in use
+#define ROT_POOL_MAX_SIZE (32 * 1024 * 1024)
+//Displays whose release fences the pool tracks
+#define MAX_ROT_POOL_DISPLAYS 3
+//Buffer sizes are rounded up to these steps, so that memory fits the
+//neighbouring sizes too, e.g. across a 90 degree rotation
+#define ROT_POOL_SMALL_BUCKET (64 * 1024)
+#define ROT_POOL_LARGE_BUCKET (1024 * 1024)
+
+/*
+* Rotator output memory shared by all rotator sessions. A session done with
+* its memory, on a resolution change or a close, returns it along with the
+* release fences of the frames in flight. The memory is handed out again,
+* to any session of the same size class, or freed only once those fences
+* signal, i.e. once the frame that scanned it out retired. Steady state
+* rotation and resolution switches thus do no ION allocation and don't
+* free memory still being scanned out. Nothing waits on a fence: memory to
+* free is kept aside until a later get(), put() or setReleaseFence() finds
+* it retired.
+* Secure memory is never pooled, the secure heap is too small to hold it
+* idle.
+* */
+class RotMemPool {
+public:
+    static RotMemPool* getInstance();
+    /* Gets memory of "numbufs" buffers of at least "bufSz" bytes each,
+     * reusing a retired one that fits or allocating one */
+    bool get(OvMem& mem, uint32_t numbufs, uint32_t bufSz, bool isSecure);
+    /* Returns memory from get(). It may still be scanned out */
+    void put(OvMem& mem, bool isSecure);
+    /* Sets the release fence of the frame being committed on "dpy". The
+     * pool keeps a dup of it, or the previous one if "fd" is -1. Frees
+     * the memories kept aside that retired */
+    void setReleaseFence(int dpy, int fd);
+    void getDump(char *buf, size_t len);
+
+private:
+    //Stands for a display's release fence that couldn't be dup'ed, the
+    //one of its next frame is waited for instead
+    enum { FENCE_NEXT = -2 };
+
+    struct Entry {
+        OvMem mem;
+        int fence[MAX_ROT_POOL_DISPLAYS];
+    };
+
+    RotMemPool();
+    static void init();
+    /* Returns true if all the entry's fences signalled, closing them */
+    static bool isRetired(Entry& e);
+    static uint32_t getBucketSize(uint32_t size);
+    /* Makes "e" wait for the frames in flight on all displays */
+    void holdFences(Entry& e);
+    /* Frees a retired idle entry, preferring the largest, to make room */
+    bool evict();
+    /* Frees the memories kept aside that retired */
+    void reap();
+    int getFreeSlot() const;
+
+    //Idle memories, up for reuse
+    Entry mEntries[MAX_ROT_POOL_MEMS];
+    uint32_t mTotalSize;
+    //Memories to free once retired
+    android::Vector<Entry> mPendingFrees;
+    int mReleaseFence[MAX_ROT_POOL_DISPLAYS];
+    pthread_mutex_t mLock;
+    static RotMemPool *sInstance;
+    static pthread_once_t sOnce;
+
+    //Stats
+    uint32_t mHits;
+    uint32_t mAllocs;
+    uint32_t mDeferred;
+    uint32_t mFrees;
+};
+
 /*
    Manages the case where new rotator memory needs to be
    allocated, before previous is freed, due to resolution change etc. If we make
@@ -86,16 +173,24 @@ struct RotMem {
 
     //Manages the rotator buffer offsets.
     struct Mem {
-        Mem() : mCurrOffset(0) {utils::memset0(mRotOffset); }
+        Mem() : mCurrOffset(0), mSize(0), mSecure(false) {
+            utils::memset0(mRotOffset);
+        }
         bool valid() { return m.valid(); }
-        bool close() { return m.close(); }
-        uint32_t size() const { return m.bufSz(); }
+        /* Gets memory from the rotator pool */
+        bool open(uint32_t numbufs, uint32_t bufSz, bool isSecure);
+        /* Returns the memory to the rotator pool */
+        bool close();
+        uint32_t size() const { return mSize; }
         // Max rotator buffers
         enum { ROT_NUM_BUFS = 2 };
         // rotator data info dst offset
         uint32_t mRotOffset[ROT_NUM_BUFS];
         // current offset slot from mRotOffset
         uint32_t mCurrOffset;
+        // buffer size asked for, pooled memory can be bigger
+        uint32_t mSize;
+        bool mSecure;
         OvMem m;
     };
 
@@ -109,6 +204,41 @@ struct RotMem {
     Mem m[MAX_ROT_MEM];
 };
 
+/*
+* Remembers the source buffer last rotated by a rotator session. The rotator
+* output keeps holding that buffer, rotated as per the session config, so
+* while neither the buffer nor the config change, e.g. for paused video or
+* a still frame, the rotator pass is skipped and the output played again.
+* Config changes (crop, transform, downscale) must invalidate it. The source
+* is keyed on the buffer id from the client, not the fd, whose number is
+* reused for other buffers. As the id of a freed buffer may come back too,
+* the source is only trusted for the round right after the one it was
+* queued in.
+* */
+struct RotCache {
+    RotCache() : mBufId(NULL), mOffset(0), mQueued(false), mHits(0),
+            mMisses(0) {}
+    /* Returns true if the output holds "bufId" at "offset", counting it */
+    bool hit(const void *bufId, uint32_t offset);
+    void save(const void *bufId, uint32_t offset) {
+        mBufId = bufId; mOffset = offset; mQueued = (bufId != NULL);
+    }
+    void invalidate() { mBufId = NULL; mOffset = 0; mQueued = false; }
+    /* Ends a round, dropping the source unless queued in it */
+    void roundDone() {
+        if(!mQueued) invalidate();
+        mQueued = false;
+    }
+    void getDump(char *buf, size_t len) const;
+    const void *mBufId;
+    uint32_t mOffset;
+    //Whether the source was queued in this round
+    bool mQueued;
+    //Stats
+    uint32_t mHits;
+    uint32_t mMisses;
+};
+
 /*
 * MDP rot holds MDP's rotation related structures.
 *
@@ -133,7 +263,9 @@ public:
     virtual void setDisable();
     virtual bool enabled () const;
     virtual uint32_t getSessId() const;
-    virtual bool queueBuffer(int fd, uint32_t offset);
+    virtual bool queueBuffer(int fd, uint32_t offset, const void *bufId);
+    virtual void roundDone() { mCache.roundDone(); }
+    virtual void invalidateCache() { mCache.invalidate(); }
     virtual void dump() const;
     virtual void getDump(char *buf, size_t len) const;
 
@@ -167,6 +299,8 @@ private:
     OvFD mFd;
     /* Rotator memory manager */
     RotMem mMem;
+    /* Last rotated source */
+    RotCache mCache;
 
     friend Rotator* Rotator::getRotator();
 };
@@ -195,7 +329,9 @@ public:
     virtual void setDisable();
     virtual bool enabled () const;
     virtual uint32_t getSessId() const;
-    virtual bool queueBuffer(int fd, uint32_t offset);
+    virtual bool queueBuffer(int fd, uint32_t offset, const void *bufId);
+    virtual void roundDone() { mCache.roundDone(); }
+    virtual void invalidateCache() { mCache.invalidate(); }
     virtual void dump() const;
     virtual void getDump(char *buf, size_t len) const;
 
@@ -208,12 +344,19 @@ private:
     void doTransform();
     /* reset underlying data, basically memset 0 */
     void reset();
+    /* return true if current rotator config is different
+     * than last known config */
+    bool rotConfChanged() const;
+    /* save mRotInfo to be last known good config*/
+    void save();
     /* Calculates the rotator's o/p buffer size post the transform calcs and
      * knowing the o/p format depending on whether fastYuv is enabled or not */
     uint32_t calcOutputBufSize();
 
     /* MdssRot info structure */
     mdp_overlay   mRotInfo;
+    /* Last saved MdssRot info */
+    mdp_overlay   mLSRotInfo;
     /* MdssRot data structure */
     msmfb_overlay_data mRotData;
     /* Orientation */
@@ -222,6 +365,8 @@ private:
     OvFD mFd;
     /* Rotator memory manager */
     RotMem mMem;
+    /* Last rotated source */
+    RotCache mCache;
     /* Enable/Disable Mdss Rot*/
     bool mEnabled;
 
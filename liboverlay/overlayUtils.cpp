@@ -73,6 +73,10 @@ struct IOFile {
 
 namespace overlay {
 
+namespace mdp_wrapper {
+volatile int32_t sIoctlCount = 0;
+}
+
 //----------From class Res ------------------------------
 const char* const Res::fbPath = "/dev/graphics/fb%u";
 const char* const Res::rotPath = "/dev/msm_rotator";
@@ -172,7 +176,7 @@ int initOverlay() {
             }
             //Get the mixer configuration */
             req.mixer_num = i;
-            if (ioctl(fd, MSMFB_MIXER_INFO, &req) == -1) {
+            if (qdutils::devIoctl(fd, MSMFB_MIXER_INFO, &req) == -1) {
                 ALOGE("ERROR: MSMFB_MIXER_INFO ioctl failed");
                 close(fd);
                 return -1;
@@ -186,7 +190,8 @@ int initOverlay() {
                 if((minfo->z_order) != -1) {
                     int index = minfo->pndx;
                     ALOGD("Unset overlay with index: %d at mixer %d", index, i);
-                    if(ioctl(fd, MSMFB_OVERLAY_UNSET, &index) == -1) {
+                    if(qdutils::devIoctl(fd, MSMFB_OVERLAY_UNSET,
+                                         &index) == -1) {
                         ALOGE("ERROR: MSMFB_OVERLAY_UNSET failed");
                         close(fd);
                         return -1;
@@ -87,6 +87,24 @@ bool GenericPipe::close() {
     return ret;
 }
 
+bool GenericPipe::park() {
+    bool ret = mCtrlData.ctrl.unset();
+    //The source may be gone by the time the pipe comes back
+    invalidateRotCache();
+    setClosed();
+    return ret;
+}
+
+void GenericPipe::roundDone() {
+    if(mRot)
+        mRot->roundDone();
+}
+
+void GenericPipe::invalidateRotCache() {
+    if(mRot)
+        mRot->invalidateCache();
+}
+
 bool GenericPipe::setSource(
         const utils::PipeArgs& args)
 {
@@ -171,6 +189,10 @@ bool GenericPipe::commit() {
          * whether fastyuv mode is enabled in the rotator.
          */
         mCtrlData.ctrl.updateSrcformat(mRot->getDstFormat());
+    } else {
+        //Rounds stop being ended once off the rotator, see
+        //Overlay::configDone()
+        invalidateRotCache();
     }
 
     ret = mCtrlData.ctrl.commit();
@@ -186,7 +208,7 @@ bool GenericPipe::commit() {
     return ret;
 }
 
-bool GenericPipe::queueBuffer(int fd, uint32_t offset) {
+bool GenericPipe::queueBuffer(int fd, uint32_t offset, const void *bufId) {
     //TODO Move pipe-id transfer to CtrlData class. Make ctrl and data private.
     OVASSERT(isOpen(), "State is closed, cannot queueBuffer");
     int pipeId = mCtrlData.ctrl.getPipeId();
@@ -198,7 +220,7 @@ bool GenericPipe::queueBuffer(int fd, uint32_t offset) {
     uint32_t finalOffset = offset;
     //If rotator is to be used, queue to it, so it can ROTATE.
     if(mRotUsed) {
-        if(!mRot->queueBuffer(fd, offset)) {
+        if(!mRot->queueBuffer(fd, offset, bufId)) {
             ALOGE("GenPipe Rotator play failed");
             return false;
         }
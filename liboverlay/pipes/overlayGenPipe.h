@@ -47,6 +47,15 @@ public:
     bool init();
     /* CTRL/DATA close. Not owning rotator, will not close it */
     bool close();
+    /* Takes the pipe off the display. Fds, rotator session and memory are
+     * kept, so a commit brings it back without reopening them */
+    bool park();
+    /* Ends a round, see Rotator::roundDone() */
+    void roundDone();
+    /* Whether the last commit set the rotator up */
+    bool isRotUsed() const { return mRotUsed; }
+    /* Makes the next queue go through the rotator again */
+    void invalidateRotCache();
 
     /* Control APIs */
     /* set source using whf, orient and wait flag */
@@ -61,8 +70,9 @@ public:
     bool commit();
 
     /* Data APIs */
-    /* queue buffer to the overlay */
-    bool queueBuffer(int fd, uint32_t offset);
+    /* queue buffer to the overlay. "bufId" identifies the buffer, see
+     * Rotator::queueBuffer() */
+    bool queueBuffer(int fd, uint32_t offset, const void *bufId);
 
     /* return cached startup args */
     const utils::PipeArgs& getArgs() const;
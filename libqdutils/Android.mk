@@ -10,7 +10,8 @@ LOCAL_CFLAGS                  := $(common_flags) -DLOG_TAG=\"qdutils\"
 LOCAL_ADDITIONAL_DEPENDENCIES := $(common_deps)
 LOCAL_SRC_FILES               := profiler.cpp mdp_version.cpp \
                                  idle_invalidator.cpp \
-                                 comptype.cpp
+                                 comptype.cpp display_config.cpp \
+                                 ioctl_backend.cpp ioctl_stats.cpp
 include $(BUILD_SHARED_LIBRARY)
 
 ifeq ($(TARGET_USES_QCOM_BSP),true)
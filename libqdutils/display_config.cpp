@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation or the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <cutils/log.h>
+#include "display_config.h"
+
+#define DISPLAY_CONFIG_DEBUG 0
+
+ANDROID_SINGLETON_STATIC_INSTANCE(qdutils::DisplayConfig);
+namespace qdutils {
+
+static bool getBoolProperty(const char *name) {
+    char property[PROPERTY_VALUE_MAX];
+    if(property_get(name, property, NULL) > 0 &&
+            (!strncmp(property, "1", PROPERTY_VALUE_MAX) ||
+             !strncasecmp(property, "true", PROPERTY_VALUE_MAX))) {
+        return true;
+    }
+    return false;
+}
+
+static int getIntProperty(const char *name, const char *defaultValue) {
+    char property[PROPERTY_VALUE_MAX];
+    property_get(name, property, defaultValue);
+    return atoi(property);
+}
+
+DisplayConfig::DisplayConfig() : generation(0)
+{
+    reload();
+}
+
+void DisplayConfig::reload()
+{
+    swapInterval = getIntProperty("debug.egl.swapinterval", "-1");
+    actionSafeWidth = getIntProperty("hw.actionsafe.width", "0");
+    actionSafeHeight = getIntProperty("hw.actionsafe.height", "0");
+    wfdVirtual = getBoolProperty("persist.sys.wfd.virtual");
+    hdmiResolution = getIntProperty("hw.hdmi.resolution", "-1");
+    generation++;
+    ALOGD_IF(DISPLAY_CONFIG_DEBUG, "%s: swapinterval=%d actionsafe=%dx%d "
+            "wfdvirtual=%d hdmi=%d gen=%u", __FUNCTION__, swapInterval,
+            actionSafeWidth, actionSafeHeight, wfdVirtual, hdmiResolution,
+            generation);
+}
+}; //namespace qdutils
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2013, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation or the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INCLUDE_LIBQCOMUTILS_DISPLAY_CONFIG
+#define INCLUDE_LIBQCOMUTILS_DISPLAY_CONFIG
+
+#include <stdint.h>
+#include <utils/Singleton.h>
+#include <cutils/properties.h>
+
+using namespace android;
+namespace qdutils {
+
+/* Snapshot of the display properties read on the composition and hotplug
+ * paths. Loaded once, and again only when reload() is called, which is done
+ * on the display.qservice INVALIDATE_CONFIG command. Readers just use the
+ * fields, no property lookups on the hot paths.
+ */
+class DisplayConfig : public Singleton <DisplayConfig>
+{
+public:
+    DisplayConfig();
+    ~DisplayConfig() { }
+    void reload();
+
+    //debug.egl.swapinterval, -1 if not set
+    int swapInterval;
+    //hw.actionsafe.width/height, percentage of the external display
+    int actionSafeWidth;
+    int actionSafeHeight;
+    //persist.sys.wfd.virtual, WFD is driven as a virtual display
+    bool wfdVirtual;
+    //hw.hdmi.resolution, -1 if not set
+    int hdmiResolution;
+    //Bumped on every reload, lets users notice a change
+    volatile uint32_t generation;
+};
+}; //namespace qdutils
+#endif //INCLUDE_LIBQCOMUTILS_DISPLAY_CONFIG
@@ -29,60 +29,146 @@
 
 #include "idle_invalidator.h"
 #include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/timerfd.h>
 
 #define II_DEBUG 0
 
-static const char *threadName = "Invalidator";
 InvalidatorHandler IdleInvalidator::mHandler = NULL;
-android::sp<IdleInvalidator> IdleInvalidator::sInstance(0);
+IdleInvalidator *IdleInvalidator::sInstance = NULL;
 
-IdleInvalidator::IdleInvalidator(): Thread(false), mHwcContext(0),
-    mSleepAgain(false), mSleepTime(0) {
+IdleInvalidator::IdleInvalidator(): mHwcContext(0), mArmed(false),
+    mSleepTime(0), mMinSleepTime(0), mTimerFd(-1), mDeadline(0),
+    mLastFrame(0), mNumIntervals(0), mFrames(0), mFiredAt(0), mHits(0),
+    mFalsePositives(0), mLastLatency(0), mTotalLatency(0) {
         ALOGD_IF(II_DEBUG, "%s", __func__);
+        memset(mIntervals, 0, sizeof(mIntervals));
     }
 
+IdleInvalidator::~IdleInvalidator() {
+    if(mTimerFd >= 0)
+        close(mTimerFd);
+}
+
 int IdleInvalidator::init(InvalidatorHandler reg_handler, void* user_data,
-                          unsigned int idleSleepTime) {
+                          unsigned int idleSleepTime,
+                          unsigned int minIdleSleepTime) {
     ALOGD_IF(II_DEBUG, "%s", __func__);
 
     /* store registered handler */
     mHandler = reg_handler;
     mHwcContext = user_data;
     mSleepTime = idleSleepTime; //Time in millis
+    mMinSleepTime = minIdleSleepTime < idleSleepTime ? minIdleSleepTime :
+            idleSleepTime;
+    if(mTimerFd < 0)
+        mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if(mTimerFd < 0) {
+        ALOGE("%s: timerfd_create failed: %s", __func__, strerror(errno));
+        return -1;
+    }
     return 0;
 }
 
-bool IdleInvalidator::threadLoop() {
-    ALOGD_IF(II_DEBUG, "%s", __func__);
-    usleep(mSleepTime * 500);
-    if(mSleepAgain) {
-        //We need to sleep again!
-        mSleepAgain = false;
-        return true;
+//Idle time for the current frame history. Called with mLock held.
+nsecs_t IdleInvalidator::getIdleTime() const {
+    nsecs_t maxTime = ms2ns(mSleepTime);
+    //Too few frames to tell a static screen from a slow animation
+    if(mMinSleepTime == mSleepTime || mNumIntervals < IDLE_HISTORY)
+        return maxTime;
+    nsecs_t longest = 0;
+    for(uint32_t i = 0; i < IDLE_HISTORY; i++) {
+        if(mIntervals[i] > longest)
+            longest = mIntervals[i];
     }
-
-    mHandler((void*)mHwcContext);
-    return false;
+    nsecs_t idleTime = longest * IDLE_INTERVAL_FACTOR;
+    if(idleTime < ms2ns(mMinSleepTime))
+        idleTime = ms2ns(mMinSleepTime);
+    if(idleTime > maxTime)
+        idleTime = maxTime;
+    return idleTime;
 }
 
-int IdleInvalidator::readyToRun() {
-    ALOGD_IF(II_DEBUG, "%s", __func__);
-    return 0; /*NO_ERROR*/
+//Times out at the absolute "deadline". Called with mLock held.
+void IdleInvalidator::arm(nsecs_t deadline) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = deadline / 1000000000LL;
+    spec.it_value.tv_nsec = deadline % 1000000000LL;
+    if(timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        ALOGE("%s: timerfd_settime failed: %s", __func__, strerror(errno));
+        return;
+    }
+    mDeadline = deadline;
+    mArmed = true;
 }
 
-void IdleInvalidator::onFirstRef() {
+void IdleInvalidator::handleTimeout() {
     ALOGD_IF(II_DEBUG, "%s", __func__);
+    uint64_t expirations;
+    if(read(mTimerFd, &expirations, sizeof(expirations)) < 0)
+        return;
+
+    {
+        android::Mutex::Autolock lock(mLock);
+        nsecs_t now = systemTime();
+        nsecs_t deadline = mLastFrame + getIdleTime();
+        if(now < deadline) {
+            //There were frames since the timer was armed
+            arm(deadline);
+            return;
+        }
+        mArmed = false;
+        mFiredAt = now;
+        mHits++;
+        mLastLatency = now - mLastFrame;
+        mTotalLatency += mLastLatency;
+        ALOGD_IF(II_DEBUG, "%s: idle after %lld ms", __func__,
+                 ns2ms(mLastLatency));
+    }
+    mHandler((void*)mHwcContext);
 }
 
 void IdleInvalidator::markForSleep() {
-    mSleepAgain = true;
-    //Triggers the threadLoop to run, if not already running.
-    run(threadName, android::PRIORITY_AUDIO);
+    if(mTimerFd < 0)
+        return;
+    android::Mutex::Autolock lock(mLock);
+    nsecs_t now = systemTime();
+    if(mFrames) {
+        mIntervals[mFrames % IDLE_HISTORY] = now - mLastFrame;
+        if(mNumIntervals < IDLE_HISTORY)
+            mNumIntervals++;
+    }
+    mFrames++;
+    //Content changed soon after a timeout, the screen was not static
+    if(mFiredAt && now - mFiredAt < ms2ns(mSleepTime))
+        mFalsePositives++;
+    mFiredAt = 0;
+    mLastFrame = now;
+
+    //An armed timer only notes the activity, unless the idle time shrank,
+    //so frames don't cost a syscall each
+    nsecs_t deadline = now + getIdleTime();
+    if(!mArmed || deadline < mDeadline)
+        arm(deadline);
+}
+
+void IdleInvalidator::getDump(char *buf, size_t len) {
+    android::Mutex::Autolock lock(mLock);
+    char str[256] = {'\0'};
+    snprintf(str, sizeof(str), "  Idle timeout: current=%lld ms min=%u ms "
+             "max=%u ms hits=%u falsePositives=%u latency last=%lld ms "
+             "avg=%lld ms\n", ns2ms(getIdleTime()), mMinSleepTime,
+             mSleepTime, mHits, mFalsePositives, ns2ms(mLastLatency),
+             mHits ? ns2ms(mTotalLatency / mHits) : 0LL);
+    strlcat(buf, str, len);
 }
 
 IdleInvalidator *IdleInvalidator::getInstance() {
     ALOGD_IF(II_DEBUG, "%s", __func__);
-    if(sInstance.get() == NULL)
+    if(sInstance == NULL)
         sInstance = new IdleInvalidator();
-    return sInstance.get();
+    return sInstance;
 }
@@ -32,26 +32,59 @@
 
 #include <cutils/log.h>
 #include <utils/threads.h>
+#include <utils/Timers.h>
 
 typedef void (*InvalidatorHandler)(void*);
 
-class IdleInvalidator : public android::Thread {
+/* Frame intervals the adaptive timeout is learnt from */
+#define IDLE_HISTORY 32
+/* The timeout is this many times the longest recent frame interval */
+#define IDLE_INTERVAL_FACTOR 4
+
+/* Calls the registered handler once the display has been idle for the
+ * given time. Backed by a timerfd, which the owner polls and hands to
+ * handleTimeout() when readable.
+ * The idle time adapts to the recent frame intervals between a minimum
+ * and a maximum, so static screens time out early while slow animations,
+ * whose frames are far apart, do not time out at all */
+class IdleInvalidator {
     void *mHwcContext;
-    bool mSleepAgain;
-    unsigned int mSleepTime;
+    bool mArmed;
+    unsigned int mSleepTime;    //Max idle time in ms
+    unsigned int mMinSleepTime; //Min idle time in ms
+    int mTimerFd;
+    nsecs_t mDeadline;          //Time the timer is armed for
+    nsecs_t mLastFrame;
+    nsecs_t mIntervals[IDLE_HISTORY];
+    uint32_t mNumIntervals;
+    uint32_t mFrames;
+    android::Mutex mLock;
     static InvalidatorHandler mHandler;
-    static android::sp<IdleInvalidator> sInstance;
+    static IdleInvalidator *sInstance;
+
+    //Stats
+    nsecs_t mFiredAt;           //Last timeout, until the next frame
+    uint32_t mHits;
+    uint32_t mFalsePositives;
+    nsecs_t mLastLatency;
+    nsecs_t mTotalLatency;
+
+    nsecs_t getIdleTime() const;
+    void arm(nsecs_t deadline);
 
     public:
     IdleInvalidator();
-    /* init timer obj */
+    ~IdleInvalidator();
+    /* init timer obj. The idle time adapts between minIdleSleepTime and
+     * idleSleepTime, and is fixed if the min is not below the max */
     int init(InvalidatorHandler reg_handler, void* user_data, unsigned int
-             idleSleepTime);
+             idleSleepTime, unsigned int minIdleSleepTime = 0);
     void markForSleep();
-    /*Overrides*/
-    virtual bool        threadLoop();
-    virtual int         readyToRun();
-    virtual void        onFirstRef();
+    /* Returns the timerfd to poll for POLLIN */
+    int getFd() const { return mTimerFd; }
+    /* Called when the timerfd is readable */
+    void handleTimeout();
+    void getDump(char *buf, size_t len);
     static IdleInvalidator *getInstance();
 };
 
@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fb.h>
+#include <linux/msm_mdp.h>
+#include <linux/msm_rotator.h>
+#include <linux/msm_ion.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <utils/Timers.h>
+#include "ioctl_backend.h"
+#include "ioctl_stats.h"
+
+#define IOCTL_DEBUG 0
+#define IOCTL_REC_MAGIC 0x4f494451 //"QDIO"
+#define IOCTL_REC_VERSION 1
+
+namespace qdutils {
+
+IoctlBackend *IoctlBackend::sInstance = NULL;
+
+struct IoctlRecord {
+    uint32_t request;
+    int32_t ret;
+    int32_t err;
+    uint32_t size; //bytes of argument that follow
+};
+
+//Requests whose argument points to more memory, which is not recorded
+static bool hasPointers(int request) {
+    return (request == (int)MSMFB_BUFFER_SYNC) ||
+            (request == (int)ION_IOC_CUSTOM);
+}
+
+//Requests the driver fills the argument of
+static bool isOutput(int request) {
+    if(hasPointers(request))
+        return false;
+    switch(request) {
+        case FBIOGET_VSCREENINFO:
+        case FBIOPUT_VSCREENINFO:
+        case FBIOGET_FSCREENINFO:
+            return true;
+    }
+    return (_IOC_DIR(request) & _IOC_READ);
+}
+
+//Picks the backend when the library is loaded, so that devIoctl() needs
+//neither a once guard nor a virtual call on the real device path
+static void resolveBackend() __attribute__((constructor));
+static void resolveBackend() {
+    IoctlBackend::init();
+}
+
+IoctlBackend* IoctlBackend::getInstance() {
+    static RealIoctl sReal;
+    return sInstance ? sInstance : &sReal;
+}
+
+void IoctlBackend::setInstance(IoctlBackend *backend) {
+    sInstance = backend;
+}
+
+void IoctlBackend::init() {
+    char property[PROPERTY_VALUE_MAX];
+    if(sInstance)
+        return;
+    //A NULL backend leaves ioctls to the real device nodes
+    if(property_get("debug.qdutils.ioctl", property, NULL) > 0) {
+        if(!strncmp(property, "record:", 7)) {
+            sInstance = new RecordIoctl(property + 7);
+        } else if(!strncmp(property, "replay:", 7)) {
+            sInstance = new ReplayIoctl(property + 7);
+        } else if(!strncmp(property, "fake", 4)) {
+            sInstance = FakeIoctl::fromConfig(property + 4);
+        }
+        ALOGD_IF(IOCTL_DEBUG, "%s: backend %s", __FUNCTION__, property);
+    }
+}
+
+size_t IoctlBackend::getArgSize(int request) {
+    //The fb ioctls predate the size encoding
+    switch(request) {
+        case FBIOGET_VSCREENINFO:
+        case FBIOPUT_VSCREENINFO:
+            return sizeof(struct fb_var_screeninfo);
+        case FBIOGET_FSCREENINFO:
+            return sizeof(struct fb_fix_screeninfo);
+        case FBIOBLANK:
+            return 0;
+    }
+    if(_IOC_DIR(request) == _IOC_NONE)
+        return 0;
+    return _IOC_SIZE(request);
+}
+
+int devIoctl(int fd, int request, void *arg) {
+    nsecs_t start = systemTime();
+    IoctlBackend *backend = IoctlBackend::sInstance;
+    int ret = backend ? backend->ioctl(fd, request, arg) :
+            ::ioctl(fd, request, arg);
+    int err = errno;
+    IoctlStats::record(request, systemTime() - start);
+    errno = err;
+    return ret;
+}
+
+//------------------------- Real -------------------------
+
+int RealIoctl::ioctl(int fd, int request, void *arg) {
+    return ::ioctl(fd, request, arg);
+}
+
+//------------------------- Record -------------------------
+
+RecordIoctl::RecordIoctl(const char *path) {
+    pthread_mutex_init(&mLock, NULL);
+    mFd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(mFd < 0) {
+        ALOGE("%s: cannot open %s: %s", __FUNCTION__, path, strerror(errno));
+        return;
+    }
+    uint32_t header[2] = {IOCTL_REC_MAGIC, IOCTL_REC_VERSION};
+    if(write(mFd, header, sizeof(header)) != sizeof(header)) {
+        close(mFd);
+        mFd = -1;
+    }
+}
+
+RecordIoctl::~RecordIoctl() {
+    if(mFd >= 0)
+        close(mFd);
+    pthread_mutex_destroy(&mLock);
+}
+
+int RecordIoctl::ioctl(int fd, int request, void *arg) {
+    int ret = ::ioctl(fd, request, arg);
+    int err = errno;
+    if(mFd >= 0) {
+        IoctlRecord rec;
+        rec.request = request;
+        rec.ret = ret;
+        rec.err = (ret < 0) ? err : 0;
+        rec.size = arg ? getArgSize(request) : 0;
+        pthread_mutex_lock(&mLock);
+        if(write(mFd, &rec, sizeof(rec)) != sizeof(rec) ||
+                (rec.size && write(mFd, arg, rec.size) != (ssize_t)rec.size)) {
+            ALOGE("%s: recording stopped: %s", __FUNCTION__, strerror(errno));
+            close(mFd);
+            mFd = -1;
+        }
+        pthread_mutex_unlock(&mLock);
+    }
+    errno = err;
+    return ret;
+}
+
+//------------------------- Replay -------------------------
+
+ReplayIoctl::ReplayIoctl(const char *path) : mCount(0), mMismatches(0) {
+    pthread_mutex_init(&mLock, NULL);
+    mFd = open(path, O_RDONLY);
+    if(mFd < 0) {
+        ALOGE("%s: cannot open %s: %s", __FUNCTION__, path, strerror(errno));
+        return;
+    }
+    uint32_t header[2] = {0, 0};
+    if(read(mFd, header, sizeof(header)) != sizeof(header) ||
+            header[0] != IOCTL_REC_MAGIC || header[1] != IOCTL_REC_VERSION) {
+        ALOGE("%s: %s is not an ioctl recording", __FUNCTION__, path);
+        close(mFd);
+        mFd = -1;
+    }
+}
+
+ReplayIoctl::~ReplayIoctl() {
+    if(mFd >= 0)
+        close(mFd);
+    pthread_mutex_destroy(&mLock);
+}
+
+int ReplayIoctl::ioctl(int /*fd*/, int request, void *arg) {
+    IoctlRecord rec;
+    uint8_t data[1024];
+    pthread_mutex_lock(&mLock);
+    if(mFd < 0 || read(mFd, &rec, sizeof(rec)) != sizeof(rec)) {
+        pthread_mutex_unlock(&mLock);
+        ALOGE("%s: recording ended after %u ioctls", __FUNCTION__, mCount);
+        errno = EIO;
+        return -1;
+    }
+    if(rec.size > sizeof(data)) {
+        //Not something this build records, fail the call and move past it
+        mCount++;
+        off_t skipped = lseek(mFd, rec.size, SEEK_CUR);
+        pthread_mutex_unlock(&mLock);
+        ALOGE("%s: ioctl %u (0x%x) has a %u byte argument, over %u%s",
+                __FUNCTION__, mCount, rec.request, rec.size,
+                (unsigned)sizeof(data), (skipped < 0) ? ", cannot skip it" : "");
+        errno = EIO;
+        return -1;
+    }
+    if(read(mFd, data, rec.size) != (ssize_t)rec.size) {
+        pthread_mutex_unlock(&mLock);
+        ALOGE("%s: recording truncated at ioctl %u", __FUNCTION__,
+                mCount + 1);
+        errno = EIO;
+        return -1;
+    }
+    mCount++;
+    if(rec.request != (uint32_t)request) {
+        mMismatches++;
+        pthread_mutex_unlock(&mLock);
+        ALOGE("%s: ioctl %u is 0x%x, recorded 0x%x (%u mismatches)",
+                __FUNCTION__, mCount, request, rec.request, mMismatches);
+        errno = EIO;
+        return -1;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    if(arg && rec.size && rec.size == getArgSize(request) &&
+            isOutput(request)) {
+        memcpy(arg, data, rec.size);
+    }
+    if(arg && request == (int)MSMFB_BUFFER_SYNC) {
+        //Recorded fences are long gone
+        struct mdp_buf_sync *sync = (struct mdp_buf_sync *)arg;
+        if(sync->rel_fen_fd)
+            *sync->rel_fen_fd = -1;
+    }
+    errno = rec.err;
+    return rec.ret;
+}
+
+//------------------------- Fake -------------------------
+
+FakeIoctl::FakeIoctl(int numPipes, int numRotSessions, int xres, int yres,
+        int mdpVersion, char panel) :
+        mNumPipes(numPipes), mNumRotSessions(numRotSessions), mXres(xres),
+        mYres(yres), mMdpVersion(mdpVersion), mPanel(panel), mPipeMask(0),
+        mRotMask(0), mPipesSet(0), mRotSessions(0), mSyncPending(false),
+        mPlays(0), mCommits(0), mSyncOverruns(0) {
+    pthread_mutex_init(&mLock, NULL);
+}
+
+FakeIoctl::~FakeIoctl() {
+    pthread_mutex_destroy(&mLock);
+}
+
+FakeIoctl* FakeIoctl::fromConfig(const char *config) {
+    int xres = FAKE_XRES, yres = FAKE_YRES;
+    int mdpVersion = FAKE_MDP_VERSION;
+    char panel = FAKE_PANEL;
+    //Fields not given, or not parsed, keep their defaults
+    if(*config == ':') {
+        sscanf(config + 1, "%dx%d:%d:%c", &xres, &yres, &mdpVersion, &panel);
+        if(xres <= 0 || yres <= 0) {
+            ALOGE("%s: bad geometry in %s", __FUNCTION__, config);
+            xres = FAKE_XRES;
+            yres = FAKE_YRES;
+        }
+    }
+    return new FakeIoctl(FAKE_NUM_PIPES, FAKE_NUM_ROT_SESSIONS, xres, yres,
+            mdpVersion, panel);
+}
+
+int FakeIoctl::fail(int err) {
+    errno = err;
+    return -1;
+}
+
+int FakeIoctl::ioctl(int /*fd*/, int request, void *arg) {
+    int ret = 0;
+    pthread_mutex_lock(&mLock);
+    switch(request) {
+        case MSMFB_OVERLAY_SET:
+            ret = setOverlay(arg);
+            break;
+        case MSMFB_OVERLAY_UNSET:
+            ret = unsetOverlay(arg);
+            break;
+        case MSMFB_OVERLAY_PLAY:
+            ret = play(arg);
+            break;
+        case MSM_ROTATOR_IOCTL_START:
+            ret = startRotator(arg);
+            break;
+        case MSM_ROTATOR_IOCTL_ROTATE:
+            ret = rotate(arg);
+            break;
+        case MSM_ROTATOR_IOCTL_FINISH:
+            ret = finishRotator(arg);
+            break;
+        case MSMFB_BUFFER_SYNC:
+            ret = bufferSync(arg);
+            break;
+        case MSMFB_DISPLAY_COMMIT:
+            mSyncPending = false;
+            mCommits++;
+            break;
+        case FBIOGET_FSCREENINFO:
+            getFixInfo(arg);
+            break;
+        case FBIOGET_VSCREENINFO:
+            getVarInfo(arg);
+            break;
+        case MSMFB_OVERLAY_GET:
+        case MSMFB_MIXER_INFO:
+        case MSMFB_METADATA_GET:
+            //Nothing staged that the caller does not know of
+            break;
+        case FBIOPUT_VSCREENINFO:
+        case FBIOBLANK:
+        case MSMFB_OVERLAY_VSYNC_CTRL:
+        case MSMFB_METADATA_SET:
+            break;
+        default:
+            ret = fail(ENOTTY);
+            break;
+    }
+    pthread_mutex_unlock(&mLock);
+    ALOGD_IF(IOCTL_DEBUG, "%s: 0x%x ret=%d", __FUNCTION__, request, ret);
+    return ret;
+}
+
+//Named the way the fb driver of that MDP names itself, see MDPVersion
+void FakeIoctl::getFixInfo(void *arg) {
+    struct fb_fix_screeninfo *finfo = (struct fb_fix_screeninfo *)arg;
+    memset(finfo, 0, sizeof(*finfo));
+    if(mMdpVersion >= 500) {
+        snprintf(finfo->id, sizeof(finfo->id), "mdssfb_%c0000", mPanel);
+    } else {
+        //MDP 3.0.3 keeps all three digits, the others drop the last one
+        int version = (mMdpVersion == 303) ? 303 : mMdpVersion / 10;
+        snprintf(finfo->id, sizeof(finfo->id), "msmfb%d_%c0000", version,
+                mPanel);
+    }
+    finfo->line_length = mXres * 4;
+    finfo->smem_len = finfo->line_length * mYres * 3;
+}
+
+void FakeIoctl::getVarInfo(void *arg) {
+    struct fb_var_screeninfo *vinfo = (struct fb_var_screeninfo *)arg;
+    memset(vinfo, 0, sizeof(*vinfo));
+    vinfo->xres = vinfo->xres_virtual = mXres;
+    vinfo->yres = mYres;
+    vinfo->yres_virtual = mYres * 3;
+    vinfo->bits_per_pixel = 32;
+}
+
+int FakeIoctl::setOverlay(void *arg) {
+    struct mdp_overlay *ov = (struct mdp_overlay *)arg;
+    if(!ov->src.width || !ov->src.height || !ov->src_rect.w ||
+            !ov->src_rect.h || !ov->dst_rect.w || !ov->dst_rect.h ||
+            ov->src_rect.x + ov->src_rect.w > ov->src.width ||
+            ov->src_rect.y + ov->src_rect.h > ov->src.height)
+        return fail(EINVAL);
+    if((int)ov->id != MSMFB_NEW_REQUEST) {
+        //Reconfiguring a pipe already set
+        if(ov->id >= (uint32_t)mNumPipes || !(mPipeMask & (1 << ov->id)))
+            return fail(EINVAL);
+        return 0;
+    }
+    for(int i = 0; i < mNumPipes; i++) {
+        if(!(mPipeMask & (1 << i))) {
+            mPipeMask |= (1 << i);
+            mPipesSet++;
+            ov->id = i;
+            return 0;
+        }
+    }
+    return fail(EBUSY);
+}
+
+int FakeIoctl::unsetOverlay(void *arg) {
+    int id = *(int *)arg;
+    if(id < 0 || id >= mNumPipes || !(mPipeMask & (1 << id)))
+        return fail(EINVAL);
+    mPipeMask &= ~(1 << id);
+    mPipesSet--;
+    return 0;
+}
+
+int FakeIoctl::play(void *arg) {
+    struct msmfb_overlay_data *od = (struct msmfb_overlay_data *)arg;
+    if(od->id >= (uint32_t)mNumPipes || !(mPipeMask & (1 << od->id)) ||
+            od->data.memory_id < 0)
+        return fail(EINVAL);
+    mPlays++;
+    return 0;
+}
+
+//Session ids start at 1, a 0 asks for a new session
+int FakeIoctl::startRotator(void *arg) {
+    struct msm_rotator_img_info *info = (struct msm_rotator_img_info *)arg;
+    int index = (int)info->session_id - 1;
+    if(index >= 0 && index < mNumRotSessions && (mRotMask & (1 << index)))
+        return 0;
+    for(int i = 0; i < mNumRotSessions; i++) {
+        if(!(mRotMask & (1 << i))) {
+            mRotMask |= (1 << i);
+            mRotSessions++;
+            info->session_id = i + 1;
+            return 0;
+        }
+    }
+    return fail(EBUSY);
+}
+
+int FakeIoctl::rotate(void *arg) {
+    struct msm_rotator_data_info *data = (struct msm_rotator_data_info *)arg;
+    int index = (int)data->session_id - 1;
+    if(index < 0 || index >= mNumRotSessions || !(mRotMask & (1 << index)))
+        return fail(EINVAL);
+    return 0;
+}
+
+int FakeIoctl::finishRotator(void *arg) {
+    int index = *(int *)arg - 1;
+    if(index < 0 || index >= mNumRotSessions || !(mRotMask & (1 << index)))
+        return fail(EINVAL);
+    mRotMask &= ~(1 << index);
+    mRotSessions--;
+    return 0;
+}
+
+int FakeIoctl::bufferSync(void *arg) {
+    struct mdp_buf_sync *sync = (struct mdp_buf_sync *)arg;
+    if(sync->acq_fen_fd_cnt && !sync->acq_fen_fd)
+        return fail(EINVAL);
+    //Each sync hands out a release fence signaled by the next commit
+    if(mSyncPending)
+        mSyncOverruns++;
+    mSyncPending = true;
+    //Fences have no timeline to live on here, -1 means signaled
+    if(sync->rel_fen_fd)
+        *sync->rel_fen_fd = -1;
+    return 0;
+}
+
+}; //namespace qdutils
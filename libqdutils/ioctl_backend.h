@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INCLUDE_LIBQDUTILS_IOCTL_BACKEND
+#define INCLUDE_LIBQDUTILS_IOCTL_BACKEND
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define FAKE_NUM_PIPES 8
+#define FAKE_NUM_ROT_SESSIONS 4
+#define FAKE_XRES 1080
+#define FAKE_YRES 1920
+#define FAKE_MDP_VERSION 500 //MDSS_V5
+#define FAKE_PANEL '8' //MIPI_VIDEO_PANEL
+
+namespace qdutils {
+
+/* All the ioctls of the display HAL go through a backend, picked once per
+ * process from the debug.qdutils.ioctl property:
+ *   (unset)        - ioctls on the real device nodes
+ *   record:<file>  - real ioctls, logged with their results to <file>
+ *   replay:<file>  - results played back from a recorded <file>
+ *   fake[:<xres>x<yres>[:<mdp version>[:<panel>]]]
+ *                  - in-process model of the MDP, rotator and fb nodes
+ * The backend is picked when the library is loaded. Tests can install one
+ * of their own with setInstance(), before the first ioctl.
+ */
+class IoctlBackend {
+public:
+    virtual ~IoctlBackend() {}
+    /* Same contract as ioctl(2): returns -1 and sets errno on failure */
+    virtual int ioctl(int fd, int request, void *arg) = 0;
+
+    static IoctlBackend* getInstance();
+    static void setInstance(IoctlBackend *backend);
+    /* Reads debug.qdutils.ioctl, once, when the library is loaded */
+    static void init();
+    /* Returns the size of the struct "request" takes, 0 if its argument is
+     * passed by value */
+    static size_t getArgSize(int request);
+
+private:
+    friend int devIoctl(int fd, int request, void *arg);
+    //NULL while ioctls go straight to the device nodes
+    static IoctlBackend *sInstance;
+};
+
+class RealIoctl : public IoctlBackend {
+public:
+    virtual int ioctl(int fd, int request, void *arg);
+};
+
+/* Real ioctls, each logged as request, result, errno and the argument as
+ * the driver left it */
+class RecordIoctl : public IoctlBackend {
+public:
+    explicit RecordIoctl(const char *path);
+    virtual ~RecordIoctl();
+    virtual int ioctl(int fd, int request, void *arg);
+private:
+    int mFd;
+    pthread_mutex_t mLock;
+};
+
+/* Plays back a recording in order, without touching any device. Arguments
+ * the driver would fill are filled from the recording */
+class ReplayIoctl : public IoctlBackend {
+public:
+    explicit ReplayIoctl(const char *path);
+    virtual ~ReplayIoctl();
+    virtual int ioctl(int fd, int request, void *arg);
+private:
+    int mFd;
+    uint32_t mCount;
+    uint32_t mMismatches;
+    pthread_mutex_t mLock;
+};
+
+/* Model of an MDP panel: a limited set of pipes and rotator sessions that
+ * must be set before being played or rotated, and buffer syncs that must
+ * be followed by a display commit. The panel geometry, MDP version (in
+ * the units of qdutils::mdp_version) and panel type are reported through
+ * the fb ioctls. Device fds are not looked at */
+class FakeIoctl : public IoctlBackend {
+public:
+    explicit FakeIoctl(int numPipes = FAKE_NUM_PIPES,
+            int numRotSessions = FAKE_NUM_ROT_SESSIONS,
+            int xres = FAKE_XRES, int yres = FAKE_YRES,
+            int mdpVersion = FAKE_MDP_VERSION, char panel = FAKE_PANEL);
+    virtual ~FakeIoctl();
+    /* Parses the ":<xres>x<yres>:<mdp version>:<panel>" tail of the
+     * property, any part of which may be left out */
+    static FakeIoctl* fromConfig(const char *config);
+    virtual int ioctl(int fd, int request, void *arg);
+
+    int getNumPipes() const { return mNumPipes; }
+    int getPipesSet() const { return mPipesSet; }
+    int getRotSessions() const { return mRotSessions; }
+    uint32_t getPlays() const { return mPlays; }
+    uint32_t getCommits() const { return mCommits; }
+    /* Buffer syncs not followed by a commit */
+    uint32_t getSyncOverruns() const { return mSyncOverruns; }
+
+private:
+    int fail(int err);
+    int setOverlay(void *arg);
+    int unsetOverlay(void *arg);
+    int play(void *arg);
+    int startRotator(void *arg);
+    int rotate(void *arg);
+    int finishRotator(void *arg);
+    int bufferSync(void *arg);
+    void getFixInfo(void *arg);
+    void getVarInfo(void *arg);
+
+    int mNumPipes;
+    int mNumRotSessions;
+    int mXres;
+    int mYres;
+    int mMdpVersion;
+    char mPanel;
+    uint32_t mPipeMask;
+    uint32_t mRotMask;
+    int mPipesSet;
+    int mRotSessions;
+    bool mSyncPending;
+    uint32_t mPlays;
+    uint32_t mCommits;
+    uint32_t mSyncOverruns;
+    pthread_mutex_t mLock;
+};
+
+/* ioctl(2) through the backend, with its latency recorded in IoctlStats */
+int devIoctl(int fd, int request, void *arg);
+
+}; //namespace qdutils
+
+#endif //INCLUDE_LIBQDUTILS_IOCTL_BACKEND
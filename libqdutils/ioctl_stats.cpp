@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <linux/msm_mdp.h>
+#include <linux/msm_rotator.h>
+#include <cutils/atomic.h>
+#include "ioctl_stats.h"
+
+namespace qdutils {
+
+IoctlStats::Histogram IoctlStats::sHist[NUM_IOCTLS][IOCTL_STATS_DISPLAYS];
+pthread_key_t IoctlStats::sDisplayKey;
+pthread_once_t IoctlStats::sOnce = PTHREAD_ONCE_INIT;
+
+static const char *sIoctlNames[] = {
+    "OVERLAY_SET",
+    "OVERLAY_UNSET",
+    "OVERLAY_PLAY",
+    "BUFFER_SYNC",
+    "DISPLAY_COMMIT",
+    "ROTATOR_START",
+    "ROTATOR_ROTATE",
+    "ROTATOR_FINISH",
+    "OTHER",
+};
+
+void IoctlStats::initKey() {
+    pthread_key_create(&sDisplayKey, NULL);
+}
+
+void IoctlStats::setDisplay(int dpy) {
+    pthread_once(&sOnce, initKey);
+    //Stored off by one, as threads that never set it read 0
+    pthread_setspecific(sDisplayKey, (void *)(intptr_t)(dpy + 1));
+}
+
+int IoctlStats::getIndex(int request) {
+    switch(request) {
+        case MSMFB_OVERLAY_SET:         return OVERLAY_SET;
+        case MSMFB_OVERLAY_UNSET:       return OVERLAY_UNSET;
+        case MSMFB_OVERLAY_PLAY:        return OVERLAY_PLAY;
+        case MSMFB_BUFFER_SYNC:         return BUFFER_SYNC;
+        case MSMFB_DISPLAY_COMMIT:      return DISPLAY_COMMIT;
+        case MSM_ROTATOR_IOCTL_START:   return ROTATOR_START;
+        case MSM_ROTATOR_IOCTL_ROTATE:  return ROTATOR_ROTATE;
+        case MSM_ROTATOR_IOCTL_FINISH:  return ROTATOR_FINISH;
+    }
+    return OTHER;
+}
+
+void IoctlStats::record(int request, nsecs_t duration) {
+    pthread_once(&sOnce, initKey);
+    int dpy = (int)(intptr_t)pthread_getspecific(sDisplayKey) - 1;
+    if(dpy < 0 || dpy >= IOCTL_STATS_DISPLAYS - 1)
+        dpy = IOCTL_STATS_DISPLAYS - 1;
+    Histogram& hist = sHist[getIndex(request)][dpy];
+
+    uint64_t ns = (duration > 0) ? (uint64_t)duration : 1;
+    int bucket = 63 - __builtin_clzll(ns);
+    if(bucket >= IOCTL_STATS_BUCKETS)
+        bucket = IOCTL_STATS_BUCKETS - 1;
+    android_atomic_inc(&hist.buckets[bucket]);
+    android_atomic_inc(&hist.count);
+
+    int32_t us = (int32_t)(ns / 1000);
+    int32_t max = hist.max;
+    //Retry only while another thread raced us with a lower max
+    while(us > max && android_atomic_cmpxchg(max, us, &hist.max))
+        max = hist.max;
+}
+
+void IoctlStats::reset() {
+    //Calls racing a reset may be lost, which is fine for stats
+    memset((void *)sHist, 0, sizeof(sHist));
+}
+
+uint32_t IoctlStats::getPercentile(const Histogram& hist, int32_t count,
+        int percent) {
+    int64_t target = ((int64_t)count * percent + 99) / 100;
+    int64_t seen = 0;
+    for(int i = 0; i < IOCTL_STATS_BUCKETS; i++) {
+        seen += hist.buckets[i];
+        if(seen >= target) {
+            //Upper end of the bucket, within what was seen
+            uint32_t upper = (uint32_t)((2ULL << i) / 1000);
+            return (upper < (uint32_t)hist.max) ? upper : hist.max;
+        }
+    }
+    return hist.max;
+}
+
+void IoctlStats::dump(android::String8& buf) {
+    bool header = false;
+    for(int i = 0; i < NUM_IOCTLS; i++) {
+        for(int dpy = 0; dpy < IOCTL_STATS_DISPLAYS; dpy++) {
+            const Histogram& hist = sHist[i][dpy];
+            int32_t count = hist.count;
+            if(!count)
+                continue;
+            if(!header) {
+                buf.appendFormat("Ioctl latency (us): ioctl dpy count p50 "
+                        "p99 max\n");
+                header = true;
+            }
+            char dpyStr[4] = "-";
+            if(dpy < IOCTL_STATS_DISPLAYS - 1)
+                snprintf(dpyStr, sizeof(dpyStr), "%d", dpy);
+            buf.appendFormat("  %-15s %s %d %u %u %d\n", sIoctlNames[i],
+                    dpyStr, count, getPercentile(hist, count, 50),
+                    getPercentile(hist, count, 99), hist.max);
+        }
+    }
+}
+
+}; //namespace qdutils
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2013, The Linux Foundation. All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INCLUDE_LIBQDUTILS_IOCTL_STATS
+#define INCLUDE_LIBQDUTILS_IOCTL_STATS
+
+#include <stdint.h>
+#include <pthread.h>
+#include <utils/Timers.h>
+#include <utils/String8.h>
+
+//Bucket i counts calls that took [2^i, 2^(i+1)) ns
+#define IOCTL_STATS_BUCKETS 32
+//Displays the HAL knows of, plus one for calls outside any display
+#define IOCTL_STATS_DISPLAYS 4
+
+namespace qdutils {
+
+/* Latency histograms of the display ioctls, per ioctl and display. Calls
+ * are recorded from any thread without locks; a call costs two atomic
+ * increments and rarely a compare and swap for the max */
+class IoctlStats {
+public:
+    enum {
+        OVERLAY_SET,
+        OVERLAY_UNSET,
+        OVERLAY_PLAY,
+        BUFFER_SYNC,
+        DISPLAY_COMMIT,
+        ROTATOR_START,
+        ROTATOR_ROTATE,
+        ROTATOR_FINISH,
+        OTHER,
+        NUM_IOCTLS,
+    };
+
+    /* Ioctls of the calling thread are accounted to "dpy" from now on,
+     * -1 for none */
+    static void setDisplay(int dpy);
+    static void record(int request, nsecs_t duration);
+    static void reset();
+    /* Appends count, p50, p99 and max in us of each histogram in use */
+    static void dump(android::String8& buf);
+
+private:
+    struct Histogram {
+        volatile int32_t count;
+        volatile int32_t buckets[IOCTL_STATS_BUCKETS];
+        volatile int32_t max; //us
+    };
+
+    static void initKey();
+    static int getIndex(int request);
+    static uint32_t getPercentile(const Histogram& hist, int32_t count,
+            int percent);
+
+    static Histogram sHist[NUM_IOCTLS][IOCTL_STATS_DISPLAYS];
+    static pthread_key_t sDisplayKey;
+    static pthread_once_t sOnce;
+};
+
+}; //namespace qdutils
+
+#endif //INCLUDE_LIBQDUTILS_IOCTL_STATS
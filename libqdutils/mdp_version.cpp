@@ -30,6 +30,7 @@
 #include <fcntl.h>
 #include <linux/fb.h>
 #include "mdp_version.h"
+#include "ioctl_backend.h"
 
 ANDROID_SINGLETON_STATIC_INSTANCE(qdutils::MDPVersion);
 namespace qdutils {
@@ -40,7 +41,7 @@ MDPVersion::MDPVersion()
     int mdp_version = MDP_V_UNKNOWN;
     char panel_type = 0;
     struct fb_fix_screeninfo fb_finfo;
-    if (ioctl(fb_fd, FBIOGET_FSCREENINFO, &fb_finfo) < 0) {
+    if (qdutils::devIoctl(fb_fd, FBIOGET_FSCREENINFO, &fb_finfo) < 0) {
         ALOGE("FBIOGET_FSCREENINFO failed");
         mdp_version =  MDP_V_UNKNOWN;
     } else {
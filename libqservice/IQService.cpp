@@ -71,6 +71,22 @@ public:
         status_t result = reply.readInt32();
         return result;
     }
+
+    virtual status_t invalidateConfig() {
+        Parcel data, reply;
+        data.writeInterfaceToken(IQService::getInterfaceDescriptor());
+        remote()->transact(INVALIDATE_CONFIG, data, &reply);
+        status_t result = reply.readInt32();
+        return result;
+    }
+
+    virtual status_t resetIoctlStats() {
+        Parcel data, reply;
+        data.writeInterfaceToken(IQService::getInterfaceDescriptor());
+        remote()->transact(RESET_IOCTL_STATS, data, &reply);
+        status_t result = reply.readInt32();
+        return result;
+    }
 };
 
 IMPLEMENT_META_INTERFACE(QService, "android.display.IQService");
@@ -141,6 +157,34 @@ status_t BnQService::onTransact(
             }
             return screenRefresh();
         } break;
+        case INVALIDATE_CONFIG: {
+            CHECK_INTERFACE(IQService, data, reply);
+            //Sent after a setprop, from the shell or system processes
+            if(callerUid != AID_GRAPHICS && callerUid != AID_SHELL &&
+                    callerUid != AID_ROOT && callerUid != AID_SYSTEM) {
+                ALOGE("display.qservice INVALIDATE_CONFIG access denied: \
+                      pid=%d uid=%d process=%s",callerPid,
+                      callerUid, callingProcName);
+                return PERMISSION_DENIED;
+            }
+            status_t result = invalidateConfig();
+            reply->writeInt32(result);
+            return NO_ERROR;
+        } break;
+        case RESET_IOCTL_STATS: {
+            CHECK_INTERFACE(IQService, data, reply);
+            //Sent before a measurement, from the shell or system processes
+            if(callerUid != AID_GRAPHICS && callerUid != AID_SHELL &&
+                    callerUid != AID_ROOT && callerUid != AID_SYSTEM) {
+                ALOGE("display.qservice RESET_IOCTL_STATS access denied: \
+                      pid=%d uid=%d process=%s",callerPid,
+                      callerUid, callingProcName);
+                return PERMISSION_DENIED;
+            }
+            status_t result = resetIoctlStats();
+            reply->writeInt32(result);
+            return NO_ERROR;
+        } break;
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
@@ -41,6 +41,8 @@ public:
         UNSECURING, // Hardware unsecuring start/end notification
         CONNECT,
         SCREEN_REFRESH,
+        INVALIDATE_CONFIG, // Reload the cached display properties
+        RESET_IOCTL_STATS, // Clear the ioctl latency histograms
     };
     enum {
         END = 0,
@@ -50,6 +52,8 @@ public:
     virtual void unsecuring(uint32_t startEnd) = 0;
     virtual void connect(const android::sp<qClient::IQClient>& client) = 0;
     virtual android::status_t screenRefresh() = 0;
+    virtual android::status_t invalidateConfig() = 0;
+    virtual android::status_t resetIoctlStats() = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -71,6 +71,22 @@ android::status_t QService::screenRefresh() {
     return result;
 }
 
+android::status_t QService::invalidateConfig() {
+    status_t result = NO_ERROR;
+    if(mClient.get()) {
+        result = mClient->notifyCallback(INVALIDATE_CONFIG, 0);
+    }
+    return result;
+}
+
+android::status_t QService::resetIoctlStats() {
+    status_t result = NO_ERROR;
+    if(mClient.get()) {
+        result = mClient->notifyCallback(RESET_IOCTL_STATS, 0);
+    }
+    return result;
+}
+
 void QService::init()
 {
     if(!sQService) {
@@ -49,6 +49,8 @@ public:
     virtual void unsecuring(uint32_t startEnd);
     virtual void connect(const android::sp<qClient::IQClient>& client);
     virtual android::status_t screenRefresh();
+    virtual android::status_t invalidateConfig();
+    virtual android::status_t resetIoctlStats();
     static void init();
 private:
     QService();